@@ -0,0 +1,38 @@
+// Copyright (c) 2023-2024 tsl0922. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+#ifndef MPV_PLUGIN_BACKEND_H
+#define MPV_PLUGIN_BACKEND_H
+
+#include "plugin.h"
+
+// presentation backend of the plugin
+//
+// the core (event loop, menu model, client messages) is platform neutral,
+// the backend presents the published menu model, and shows it. one backend
+// is built into the plugin:
+//
+//   win32.c     native popup menu on the mpv window
+//   headless.c  menu kept in memory, driven by client messages
+//
+// the backend also implements the requests of clipboard.h and dialog.h,
+// which run on the worker thread.
+//
+// unless noted, these are called on the plugin thread. the backend may
+// apply the menu model on its own UI thread.
+
+// called after plugin context is created
+void backend_init(plugin_ctx *ctx);
+// called before plugin context is destroyed
+void backend_uninit(plugin_ctx *ctx);
+// mpv window is created, wid is the value of window-id property
+void backend_attach(plugin_ctx *ctx, int64_t wid);
+// a new menu model is published, apply it with apply_menu()
+void backend_update(plugin_ctx *ctx);
+// show menu, by client message "show"
+void backend_show(plugin_ctx *ctx);
+// called on worker thread, before and after the requests
+void backend_thread_init(void);
+void backend_thread_uninit(void);
+
+#endif
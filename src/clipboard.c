@@ -4,10 +4,12 @@
 #include <windows.h>
 #include "mpv_talloc.h"
 #include "clipboard.h"
+#include "utf.h"
+#include "win32.h"
 
 // get clipboard text, always return utf8 string
 char *get_clipboard(plugin_ctx *ctx, void *talloc_ctx) {
-    if (!OpenClipboard(ctx->hwnd)) return NULL;
+    if (!OpenClipboard(ctx->backend->hwnd)) return NULL;
 
     // try to get unicode text first
     HANDLE hData = GetClipboardData(CF_UNICODETEXT);
@@ -52,15 +54,16 @@ done:
 
 // set clipboard text, always convert to wide string
 void set_clipboard(plugin_ctx *ctx, const char *text) {
-    if (!OpenClipboard(ctx->hwnd)) return;
+    if (!OpenClipboard(ctx->backend->hwnd)) return;
     EmptyClipboard();
 
-    int len = MultiByteToWideChar(CP_UTF8, 0, text, -1, NULL, 0);
-    HGLOBAL hData = GlobalAlloc(GMEM_MOVEABLE, len * sizeof(wchar_t));
+    size_t len = strlen(text);
+    HGLOBAL hData =
+        GlobalAlloc(GMEM_MOVEABLE, (UTF16_MAX_LEN(len) + 1) * sizeof(wchar_t));
     if (hData != NULL) {
         wchar_t *data = (wchar_t *)GlobalLock(hData);
         if (data != NULL) {
-            MultiByteToWideChar(CP_UTF8, 0, text, -1, data, len);
+            data[utf8_to_utf16((uint16_t *)data, text, len)] = L'\0';
             GlobalUnlock(hData);
             SetClipboardData(CF_UNICODETEXT, hData);
         }
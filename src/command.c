@@ -0,0 +1,254 @@
+// Copyright (c) 2023-2024 tsl0922. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+#include <string.h>
+#include "mpv_talloc.h"
+#include "hist.h"
+#include "command.h"
+#include "stats.h"
+
+// command string, its statements are run one after another, they are
+// allocated under the command
+struct command {
+    uint64_t id;    // reply_userdata of the running statement
+    int64_t start;  // submit time, when the menu item is clicked
+    char ***stmts;  // NULL terminated argument list of each statement
+    int num_stmts;
+    int next;  // next statement to run
+};
+
+struct command_queue {
+    mpv_handle *mpv;
+    int max_inflight;
+
+    struct command **inflight;  // running commands, in no particular order
+    int num_inflight;
+    struct command **queued;    // commands waiting for the window
+    int num_queued;
+
+    uint64_t next_id;
+    uint64_t failed;    // commands failed to start or failed in mpv
+    uint64_t fallback;  // commands run with mpv_command_string()
+    histogram latency;  // submit to reply time in nanoseconds
+};
+
+static bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// unescape double quoted string in place, s points after the opening quote
+//
+// return the char after the closing quote, NULL if it's not terminated or
+// has an escape that is left to mpv to handle
+static char *read_escaped(char *s) {
+    char *w = s;
+    while (*s != '"') {
+        if (*s == '\0') return NULL;
+        if (*s != '\\') {
+            *w++ = *s++;
+            continue;
+        }
+        switch (s[1]) {
+            case '"':
+            case '\'':
+            case '\\':
+                *w++ = s[1];
+                break;
+            case 'n':
+                *w++ = '\n';
+                break;
+            case 't':
+                *w++ = '\t';
+                break;
+            case 'r':
+                *w++ = '\r';
+                break;
+            case 'e':
+                *w++ = '\033';
+                break;
+            default:
+                return NULL;
+        }
+        s += 2;
+    }
+    *w = '\0';
+    return s + 1;
+}
+
+// read a quoted token in place, return the char after it, or NULL
+//
+//   "text"   escaped string
+//   'text'   raw string
+//   !Xtext!  raw string, closed by X followed by !
+static char *read_quoted(char *s, char **tok) {
+    char *end = NULL;
+    switch (s[0]) {
+        case '"':
+            *tok = s + 1;
+            return read_escaped(s + 1);
+        case '\'':
+            *tok = s + 1;
+            end = strchr(s + 1, '\'');
+            if (end == NULL) return NULL;
+            *end = '\0';
+            return end + 1;
+        default:
+            if (s[1] == '\0') return NULL;
+            *tok = s + 2;
+            for (end = s + 2; *end; end++) {
+                if (end[0] == s[1] && end[1] == '!') {
+                    *end = '\0';
+                    return end + 2;
+                }
+            }
+            return NULL;
+    }
+}
+
+// split command string to statements with the input.conf syntax
+//
+// statements are separated by ';', an unquoted '#' starts a comment. each
+// statement is a NULL terminated argument list, prefixed with the flags
+// that mpv_command_string() implies. return false if the string can't be
+// split exactly like mpv does, the string is modified in place.
+static bool split_command(void *ta, char *s, char ****stmts, int *num_stmts) {
+    char **args = NULL;
+    int num_args = 0;
+
+    while (true) {
+        while (is_space(*s)) s++;
+
+        if (*s == '\0' || *s == '#' || *s == ';') {
+            if (num_args > 0) {
+                MP_TARRAY_APPEND(ta, args, num_args, NULL);
+                MP_TARRAY_APPEND(ta, *stmts, *num_stmts, args);
+                args = NULL;
+                num_args = 0;
+            }
+            if (*s != ';') break;
+            s++;
+            continue;
+        }
+
+        if (num_args == 0) {
+            MP_TARRAY_APPEND(ta, args, num_args, "osd-auto");
+            MP_TARRAY_APPEND(ta, args, num_args, "expand-properties");
+        }
+
+        char *tok = NULL;
+        if (*s == '"' || *s == '\'' || *s == '!') {
+            s = read_quoted(s, &tok);
+            if (s == NULL) return false;
+            if (*s && !is_space(*s) && *s != ';' && *s != '#') return false;
+        } else {
+            size_t len = strcspn(s, " \t\n\r#;");
+            tok = talloc_strndup(ta, s, len);
+            s += len;
+        }
+        MP_TARRAY_APPEND(ta, args, num_args, tok);
+    }
+
+    return true;
+}
+
+// start the next statement of command, the failed ones are skipped, return
+// false if there's none left
+static bool start_next(command_queue *q, struct command *cmd) {
+    while (cmd->next < cmd->num_stmts) {
+        cmd->id = ++q->next_id;
+        const char **args = (const char **)cmd->stmts[cmd->next++];
+        if (mpv_command_async(q->mpv, cmd->id, args) >= 0) return true;
+        q->failed++;
+    }
+    return false;
+}
+
+// all statements of command are done
+static void finish_command(command_queue *q, struct command *cmd) {
+    hist_add(&q->latency, mpv_get_time_ns(q->mpv) - cmd->start);
+    talloc_free(cmd);
+}
+
+static void start_command(command_queue *q, struct command *cmd) {
+    if (start_next(q, cmd)) {
+        MP_TARRAY_APPEND(q, q->inflight, q->num_inflight, cmd);
+    } else {
+        finish_command(q, cmd);
+    }
+}
+
+// start queued commands while the window has room
+static void flush_queue(command_queue *q) {
+    int n = 0;
+    while (n < q->num_queued && q->num_inflight < q->max_inflight)
+        start_command(q, q->queued[n++]);
+
+    q->num_queued -= n;
+    memmove(q->queued, q->queued + n, q->num_queued * sizeof(*q->queued));
+}
+
+command_queue *command_queue_create(void *talloc_ctx, mpv_handle *mpv,
+                                    int max_inflight) {
+    command_queue *q = talloc_zero(talloc_ctx, command_queue);
+    q->mpv = mpv;
+    q->max_inflight = max_inflight > 0 ? max_inflight : COMMAND_MAX_INFLIGHT;
+    return q;
+}
+
+// run command string, start is the time it's requested, in mpv_get_time_ns()
+//
+// the statements run in order, the next one is started when the previous
+// one replies, like mpv_command_string() runs them. the window counts
+// command strings, not statements.
+void command_submit(command_queue *q, const char *str, int64_t start) {
+    struct command *cmd = talloc_zero(q, struct command);
+    cmd->start = start;
+
+    if (!split_command(cmd, talloc_strdup(cmd, str), &cmd->stmts,
+                       &cmd->num_stmts)) {
+        q->fallback++;
+        if (mpv_command_string(q->mpv, str) < 0) q->failed++;
+        finish_command(q, cmd);
+        return;
+    }
+
+    if (q->num_queued == 0 && q->num_inflight < q->max_inflight) {
+        start_command(q, cmd);
+    } else {
+        MP_TARRAY_APPEND(q, q->queued, q->num_queued, cmd);
+    }
+}
+
+// handle MPV_EVENT_COMMAND_REPLY, replies of other requests are ignored
+void command_reply(command_queue *q, mpv_event *event) {
+    for (int i = 0; i < q->num_inflight; i++) {
+        struct command *cmd = q->inflight[i];
+        if (cmd->id != event->reply_userdata) continue;
+
+        if (event->error < 0) q->failed++;
+        if (start_next(q, cmd)) return;
+
+        finish_command(q, cmd);
+        q->inflight[i] = q->inflight[--q->num_inflight];
+        flush_queue(q);
+        return;
+    }
+}
+
+// build metrics node of commands, the latency is from submit to reply
+//
+// MPV_FORMAT_NODE_MAP (see stats_hist_node())
+//    "failed"         MPV_FORMAT_INT64
+//    "fallback"       MPV_FORMAT_INT64
+//    "in-flight"      MPV_FORMAT_INT64
+//    "queued"         MPV_FORMAT_INT64
+//    "max-in-flight"  MPV_FORMAT_INT64
+void command_metrics(command_queue *q, void *talloc_ctx, mpv_node *dst) {
+    mpv_node_list *list = stats_hist_node(&q->latency, talloc_ctx, dst, 5);
+
+    stats_add_int(list, "failed", q->failed);
+    stats_add_int(list, "fallback", q->fallback);
+    stats_add_int(list, "in-flight", q->num_inflight);
+    stats_add_int(list, "queued", q->num_queued);
+    stats_add_int(list, "max-in-flight", q->max_inflight);
+}
@@ -0,0 +1,29 @@
+// Copyright (c) 2023-2024 tsl0922. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+#ifndef MPV_PLUGIN_COMMAND_H
+#define MPV_PLUGIN_COMMAND_H
+
+#include <mpv/client.h>
+
+#define COMMAND_MAX_INFLIGHT 8
+
+// queue of asynchronous mpv commands, with a bounded in-flight window
+//
+// command strings are split to statements with the input.conf syntax, and
+// run with mpv_command_async(), so the caller is not blocked by slow
+// commands. the statements of a command string run in order, each one
+// starts when the previous one replies. commands that can't be split are
+// run with mpv_command_string(). the window limits the running command
+// strings, when it's full, they wait in submission order.
+//
+// all functions must be called by the thread that handles the mpv events.
+typedef struct command_queue command_queue;
+
+command_queue *command_queue_create(void *talloc_ctx, mpv_handle *mpv,
+                                    int max_inflight);
+void command_submit(command_queue *q, const char *cmd, int64_t start);
+void command_reply(command_queue *q, mpv_event *event);
+void command_metrics(command_queue *q, void *talloc_ctx, mpv_node *dst);
+
+#endif
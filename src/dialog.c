@@ -5,7 +5,9 @@
 #include <shobjidl.h>
 #include <mpv/client.h>
 #include "mpv_talloc.h"
+#include "keys.h"
 #include "dialog.h"
+#include "win32.h"
 
 #define DIALOG_FILTER_PROP "user-data/menu/dialog/filters"
 #define DIALOG_DEF_PATH_PROP "user-data/menu/dialog/default-path"
@@ -31,12 +33,19 @@ static void add_filters(mpv_handle *mpv, IFileDialog *pfd) {
         mpv_node_list *values = item->u.list;
 
         for (int j = 0; j < values->num; j++) {
-            char *key = values->keys[j];
             mpv_node *value = &values->values[j];
             if (value->format != MPV_FORMAT_STRING) continue;
 
-            if (strcmp(key, "name") == 0) name = value->u.string;
-            if (strcmp(key, "spec") == 0) spec = value->u.string;
+            switch (node_key(values->keys[j])) {
+                case KEY_NAME:
+                    name = value->u.string;
+                    break;
+                case KEY_SPEC:
+                    spec = value->u.string;
+                    break;
+                default:
+                    break;
+            }
         }
 
         if (name != NULL && spec != NULL) {
@@ -162,7 +171,7 @@ char *open_dialog(void *talloc_ctx, plugin_ctx *ctx) {
     set_default_path(ctx->mpv, (IFileDialog *)pfd);
     add_options((IFileDialog *)pfd, FOS_FORCEFILESYSTEM);
 
-    return show_dialog(talloc_ctx, ctx->hwnd, (IFileDialog *)pfd);
+    return show_dialog(talloc_ctx, ctx->backend->hwnd, (IFileDialog *)pfd);
 }
 
 // multiple file open dialog
@@ -177,7 +186,7 @@ char **open_dialog_multi(void *talloc_ctx, plugin_ctx *ctx) {
     set_default_path(ctx->mpv, (IFileDialog *)pfd);
     add_options((IFileDialog *)pfd, FOS_FORCEFILESYSTEM | FOS_ALLOWMULTISELECT);
 
-    return show_dialog_multi(talloc_ctx, ctx->hwnd, pfd);
+    return show_dialog_multi(talloc_ctx, ctx->backend->hwnd, pfd);
 }
 
 // folder open dialog
@@ -191,7 +200,7 @@ char *open_folder(void *talloc_ctx, plugin_ctx *ctx) {
     set_default_path(ctx->mpv, (IFileDialog *)pfd);
     add_options((IFileDialog *)pfd, FOS_FORCEFILESYSTEM | FOS_PICKFOLDERS);
 
-    return show_dialog(talloc_ctx, ctx->hwnd, (IFileDialog *)pfd);
+    return show_dialog(talloc_ctx, ctx->backend->hwnd, (IFileDialog *)pfd);
 }
 
 // save dialog
@@ -207,5 +216,5 @@ char *save_dialog(void *talloc_ctx, plugin_ctx *ctx) {
     set_default_name(ctx->mpv, (IFileDialog *)pfd);
     add_options((IFileDialog *)pfd, FOS_FORCEFILESYSTEM);
 
-    return show_dialog(talloc_ctx, ctx->hwnd, (IFileDialog *)pfd);
+    return show_dialog(talloc_ctx, ctx->backend->hwnd, (IFileDialog *)pfd);
 }
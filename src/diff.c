@@ -0,0 +1,160 @@
+// Copyright (c) 2023-2024 tsl0922. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+#include <string.h>
+#include "mpv_talloc.h"
+#include "diff.h"
+
+struct diff_ctx {
+    const struct diff_ops *ops;
+    void *ctx;
+    menu_model *a;  // old model
+    menu_model *b;  // new model
+    int *stack;     // visible items of the submenus being diffed
+    int num_stack;
+};
+
+// items with the same type and label are treated as the same item
+static bool same_item(struct diff_ctx *d, int i, int j) {
+    return d->a->type[i] == d->b->type[j] &&
+           strcmp(model_str(d->a, d->a->label[i]),
+                  model_str(d->b, d->b->label[j])) == 0;
+}
+
+// insert item of new model, submenu items are deferred to menu_load()
+static void insert_item(struct diff_ctx *d, int parent, int pos, int item) {
+    d->b->loaded[item] = false;
+    d->ops->insert(d->ctx, d->b, parent, pos, item);
+}
+
+static void remove_item(struct diff_ctx *d, int parent, int pos, int item) {
+    d->ops->remove(d->ctx, d->a, parent, pos, item);
+}
+
+static void diff_items(struct diff_ctx *d, int old, int new);
+
+// move native state of old item to new item
+static void move_state(struct diff_ctx *d, int old, int new) {
+    menu_model *a = d->a, *b = d->b;
+    b->handle[new] = a->handle[old];
+    b->id[new] = a->id[old];
+    b->loaded[new] = a->loaded[old];
+}
+
+// move native state of an unchanged subtree, the items are identical, so
+// they are matched by position without touching the native menu
+static void move_subtree(struct diff_ctx *d, int old, int new) {
+    move_state(d, old, new);
+    if (d->b->type[new] != MENU_SUBMENU || !d->b->loaded[new]) return;
+
+    for (int i = 0; i < d->b->count[new]; i++)
+        move_subtree(d, d->a->first[old] + i, d->b->first[new] + i);
+}
+
+// reuse native state of old item, and update the changed fields
+static void match_item(struct diff_ctx *d, int parent, int pos, int old,
+                       int new) {
+    menu_model *a = d->a, *b = d->b;
+    if (a->hash[old] == b->hash[new]) {
+        move_subtree(d, old, new);
+        return;
+    }
+    move_state(d, old, new);
+
+    int changes = 0;
+    if (strcmp(model_str(a, a->label[old]), model_str(b, b->label[new])) != 0)
+        changes |= DIFF_TITLE;
+    if (a->flags[old] != b->flags[new]) changes |= DIFF_FLAGS;
+    if (changes) d->ops->update(d->ctx, b, parent, pos, new, changes);
+
+    // submenu that is never opened has no native items to diff
+    if (b->type[new] == MENU_SUBMENU && b->loaded[new]) diff_items(d, old, new);
+}
+
+// push visible submenu items of item to stack, return the item count
+static int push_visible(struct diff_ctx *d, menu_model *m, int item) {
+    int n = 0;
+    for (int i = m->first[item]; i < m->first[item] + m->count[item]; i++) {
+        if (!model_visible(m, i)) continue;
+        MP_TARRAY_APPEND(NULL, d->stack, d->num_stack, i);
+        n++;
+    }
+    return n;
+}
+
+// diff submenu items of old and new
+//
+// only visible items have native items, so they are collected first, the
+// stack may be reallocated by the nested diffs, so it's indexed by offset.
+//
+// the common prefix and suffix are matched first, the remaining items are
+// matched by position, items of different type are replaced, and the extra
+// items are removed or inserted.
+static void diff_items(struct diff_ctx *d, int old, int new) {
+    int base = d->num_stack;
+    int m = push_visible(d, d->a, old);
+    int n = push_visible(d, d->b, new);
+
+#define A(i) d->stack[base + (i)]
+#define B(j) d->stack[base + m + (j)]
+
+    int start = 0;
+    while (start < m && start < n && same_item(d, A(start), B(start))) {
+        match_item(d, new, start, A(start), B(start));
+        start++;
+    }
+
+    int end = 0;
+    while (end < m - start && end < n - start &&
+           same_item(d, A(m - 1 - end), B(n - 1 - end)))
+        end++;
+
+    int i = start, j = start, pos = start;
+    while (i < m - end && j < n - end) {
+        if (d->a->type[A(i)] == d->b->type[B(j)]) {
+            match_item(d, new, pos, A(i), B(j));
+        } else {
+            remove_item(d, old, pos, A(i));
+            insert_item(d, new, pos, B(j));
+        }
+        i++, j++, pos++;
+    }
+    for (; i < m - end; i++) remove_item(d, old, pos, A(i));
+    for (; j < n - end; j++) insert_item(d, new, pos++, B(j));
+
+    for (int k = 0; k < end; k++)
+        match_item(d, new, pos++, A(m - end + k), B(n - end + k));
+
+#undef A
+#undef B
+    d->num_stack = base;
+}
+
+// apply the difference between old and new menu model to native menu
+//
+// native state (handle, id) of matched items is moved to the new model,
+// so old can be freed after this call.
+void menu_diff(menu_model *old, menu_model *new, const struct diff_ops *ops,
+               void *ctx) {
+    struct diff_ctx d = {.ops = ops, .ctx = ctx, .a = old, .b = new};
+    if (old->hash[0] == new->hash[0]) {
+        move_subtree(&d, 0, 0);
+        return;
+    }
+    move_state(&d, 0, 0);
+    diff_items(&d, 0, 0);
+    talloc_free(d.stack);
+}
+
+// create native items of submenu, if it's not loaded yet
+void menu_load(menu_model *m, int item, const struct diff_ops *ops, void *ctx) {
+    if (m->type[item] != MENU_SUBMENU || m->loaded[item]) return;
+
+    m->loaded[item] = true;
+    int pos = 0;
+    for (int i = 0; i < m->count[item]; i++) {
+        int child = m->first[item] + i;
+        m->loaded[child] = false;
+        if (model_visible(m, child)) ops->insert(ctx, m, item, pos++, child);
+    }
+}
@@ -0,0 +1,34 @@
+// Copyright (c) 2023-2024 tsl0922. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+#ifndef MPV_PLUGIN_DIFF_H
+#define MPV_PLUGIN_DIFF_H
+
+#include "model.h"
+
+// changed fields passed to diff_ops.update
+enum diff_change {
+    DIFF_TITLE = 1 << 0,
+    DIFF_FLAGS = 1 << 1,
+};
+
+// native menu operations
+//
+// items are referenced by index of model m, pos is the item position in
+// the parent menu.
+struct diff_ops {
+    // insert item, set handle for submenu, the submenu items are inserted
+    // by menu_load() when the submenu is about to open
+    void (*insert)(void *ctx, menu_model *m, int parent, int pos, int item);
+    // remove item of the old model, including its loaded submenu items
+    void (*remove)(void *ctx, menu_model *m, int parent, int pos, int item);
+    // update changed fields of item
+    void (*update)(void *ctx, menu_model *m, int parent, int pos, int item,
+                   int changes);
+};
+
+void menu_diff(menu_model *old, menu_model *new, const struct diff_ops *ops,
+               void *ctx);
+void menu_load(menu_model *m, int item, const struct diff_ops *ops, void *ctx);
+
+#endif
@@ -0,0 +1,94 @@
+// Copyright (c) 2023-2024 tsl0922. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+#include "mpv_talloc.h"
+#include "epoch.h"
+
+// retired pointer, and the epoch it was retired in
+struct retired {
+    void *ptr;
+    uint64_t epoch;
+};
+
+struct epoch {
+    atomic_uint_least64_t global;  // global epoch, starts at 1
+    atomic_uint_least64_t *slots;  // epoch seen by reader, 0 if inactive
+    int num_slots;
+
+    struct retired *retired;  // pointers waiting to be freed
+    int num_retired;
+};
+
+static void epoch_destructor(void *ptr) {
+    epoch *e = ptr;
+    for (int i = 0; i < e->num_retired; i++) talloc_free(e->retired[i].ptr);
+}
+
+epoch *epoch_create(void *talloc_ctx, int num_slots) {
+    epoch *e = talloc_zero(talloc_ctx, epoch);
+    e->slots = talloc_zero_array(e, atomic_uint_least64_t, num_slots);
+    e->num_slots = num_slots;
+    for (int i = 0; i < num_slots; i++) atomic_init(&e->slots[i], 0);
+    atomic_init(&e->global, 1);
+    talloc_set_destructor(e, epoch_destructor);
+    return e;
+}
+
+// announce the current epoch in slot, pointers loaded after this are
+// valid until epoch_leave()
+//
+// the epoch is read again after the store, if the writer advanced it in
+// between, it may have missed the slot, so announce the new one.
+void epoch_enter(epoch *e, int slot) {
+    uint64_t g = atomic_load(&e->global);
+    while (1) {
+        atomic_store(&e->slots[slot], g);
+        uint64_t cur = atomic_load(&e->global);
+        if (cur == g) break;
+        g = cur;
+    }
+}
+
+void epoch_leave(epoch *e, int slot) {
+    atomic_store_explicit(&e->slots[slot], 0, memory_order_release);
+}
+
+// retire ptr, it must be unpublished already, so new readers can't see it
+void epoch_retire(epoch *e, void *ptr) {
+    if (ptr == NULL) return;
+
+    MP_TARRAY_APPEND(e, e->retired, e->num_retired,
+                     (struct retired){ptr, atomic_load(&e->global)});
+    epoch_reclaim(e);
+}
+
+// every active reader has seen epoch g
+static bool can_advance(epoch *e, uint64_t g) {
+    for (int i = 0; i < e->num_slots; i++) {
+        uint64_t v = atomic_load(&e->slots[i]);
+        if (v != 0 && v != g) return false;
+    }
+    return true;
+}
+
+// advance the global epoch while every active reader has seen it, and free
+// the pointers retired 2 epochs ago: a reader that could see them would
+// have kept the epoch from advancing that far
+//
+// return the number of pointers still waiting.
+int epoch_reclaim(epoch *e) {
+    uint64_t g = atomic_load(&e->global);
+    for (int k = 0; k < 2 && can_advance(e, g); k++)
+        atomic_store(&e->global, ++g);
+
+    int n = 0;
+    for (int i = 0; i < e->num_retired; i++) {
+        if (e->retired[i].epoch + 2 <= g) {
+            talloc_free(e->retired[i].ptr);
+        } else {
+            e->retired[n++] = e->retired[i];
+        }
+    }
+    e->num_retired = n;
+    return n;
+}
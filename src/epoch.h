@@ -0,0 +1,29 @@
+// Copyright (c) 2023-2024 tsl0922. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+#ifndef MPV_PLUGIN_EPOCH_H
+#define MPV_PLUGIN_EPOCH_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+// epoch based reclamation of published pointers
+//
+// a reader enters a critical section with its own slot before loading a
+// published pointer, and leaves it when done with the pointer. the writer
+// swaps in a new pointer, and retires the old one, which is freed once no
+// reader can still see it.
+//
+// readers may run on any thread, but each slot is used by one thread at a
+// time. epoch_retire() and epoch_reclaim() must be called by one writer
+// thread. retired pointers are talloc allocations, the pending ones are
+// freed with the epoch.
+typedef struct epoch epoch;
+
+epoch *epoch_create(void *talloc_ctx, int num_slots);
+void epoch_enter(epoch *e, int slot);
+void epoch_leave(epoch *e, int slot);
+void epoch_retire(epoch *e, void *ptr);
+int epoch_reclaim(epoch *e);
+
+#endif
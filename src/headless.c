@@ -0,0 +1,186 @@
+// Copyright (c) 2023-2024 tsl0922. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+// headless backend, the menu is kept in memory, and driven by client
+// messages, so the plugin runs without a window system:
+//
+//   show                   show the menu
+//   headless/click <path>  click item by 1-based path, e.g. "2/3", and
+//                          close the menu
+//   headless/close         close the menu
+//
+// the clipboard is kept in memory. dialogs return the value of
+// HEADLESS_DIALOG_PROP, one path per line, or are cancelled if it's not
+// set.
+
+#include <stdlib.h>
+#include <string.h>
+#include "mpv_talloc.h"
+#include "backend.h"
+#include "clipboard.h"
+#include "dialog.h"
+#include "menu.h"
+#include "router.h"
+#include "stats.h"
+
+#define HEADLESS_DIALOG_PROP "user-data/menu/headless/dialog"
+
+// headless backend state
+struct backend {
+    char *clipboard;  // clipboard text, only used by the worker thread
+};
+
+// diff_ops.insert: allocate menu identifier, there's no native item
+static void diff_insert(void *data, menu_model *m, int parent, int pos,
+                        int item) {
+    plugin_ctx *ctx = data;
+    m->id[item] = idmap_alloc(ctx->idmap, item);
+}
+
+// diff_ops.remove: release menu identifiers
+static void diff_remove(void *data, menu_model *m, int parent, int pos,
+                        int item) {
+    free_menu_ids(data, m, item);
+}
+
+// diff_ops.update: nothing to update
+static void diff_update(void *data, menu_model *m, int parent, int pos,
+                        int item, int changes) {}
+
+static const struct diff_ops menu_diff_ops = {
+    .insert = diff_insert,
+    .remove = diff_remove,
+    .update = diff_update,
+};
+
+// find visible item by 1-based path, hidden items are counted, like the
+// paths of patch ops. submenus on the path are loaded, as if they are
+// opened. return -1 if not found.
+static int find_item(plugin_ctx *ctx, menu_model *m, const char *path) {
+    int item = 0;
+    while (*path) {
+        char *end;
+        long pos = strtol(path, &end, 10);
+        if (end == path || m->type[item] != MENU_SUBMENU || pos < 1 ||
+            pos > m->count[item])
+            return -1;
+
+        menu_load(m, item, &menu_diff_ops, ctx);
+        item = m->first[item] + pos - 1;
+        if (!model_visible(m, item)) return -1;
+
+        path = end;
+        if (*path == '/') {
+            path++;
+        } else if (*path) {
+            return -1;
+        }
+    }
+    return item;
+}
+
+// client message: headless/click <path>
+static void cmd_click(void *data, int num_args, const char **args) {
+    plugin_ctx *ctx = data;
+    if (!ctx->menu_open) return;
+
+    menu_model *m = atomic_load(&ctx->model);
+    int i = find_item(ctx, m, args[1]);
+    unsigned int id = 0;
+    if (i > 0 && m->type[i] == MENU_ITEM && !(m->flags[i] & MENU_DISABLED))
+        id = m->id[i];
+
+    close_menu(ctx, &menu_diff_ops, id);
+}
+
+// client message: headless/close
+static void cmd_close(void *data, int num_args, const char **args) {
+    plugin_ctx *ctx = data;
+    if (ctx->menu_open) close_menu(ctx, &menu_diff_ops, 0);
+}
+
+void backend_init(plugin_ctx *ctx) {
+    ctx->backend = talloc_zero(ctx, struct backend);
+    router_add(ctx->router, "headless/click", 1, cmd_click);
+    router_add(ctx->router, "headless/close", 0, cmd_close);
+
+    // the menu is in memory, it's created with the context
+    atomic_store(&ctx->stats->native_menu_ns,
+                 mpv_get_time_ns(ctx->mpv) - ctx->stats->startup);
+}
+
+void backend_uninit(plugin_ctx *ctx) { talloc_free(ctx->backend->clipboard); }
+
+void backend_attach(plugin_ctx *ctx, int64_t wid) {}
+
+// the plugin thread is the UI thread, the menu is applied at once
+void backend_update(plugin_ctx *ctx) { apply_menu(ctx, &menu_diff_ops); }
+
+void backend_show(plugin_ctx *ctx) {
+    if (ctx->menu_open) return;
+    open_menu(ctx);
+}
+
+void backend_thread_init(void) {}
+
+void backend_thread_uninit(void) {}
+
+// get clipboard text
+char *get_clipboard(plugin_ctx *ctx, void *talloc_ctx) {
+    char *text = ctx->backend->clipboard;
+    return text ? talloc_strdup(talloc_ctx, text) : NULL;
+}
+
+// set clipboard text, it's not a child of the backend, which is allocated
+// by another thread
+void set_clipboard(plugin_ctx *ctx, const char *text) {
+    talloc_free(ctx->backend->clipboard);
+    ctx->backend->clipboard = talloc_strdup(NULL, text);
+}
+
+// read dialog result, split to lines
+static char **read_dialog(void *talloc_ctx, plugin_ctx *ctx) {
+    char *value = mpv_get_property_string(ctx->mpv, HEADLESS_DIALOG_PROP);
+    if (value == NULL) return NULL;
+
+    char **paths = NULL;
+    int count = 0;
+    for (char *s = value; *s;) {
+        size_t len = strcspn(s, "\n");
+        if (len > 0)
+            MP_TARRAY_APPEND(talloc_ctx, paths, count,
+                             talloc_strndup(talloc_ctx, s, len));
+        s += len;
+        if (*s) s++;
+    }
+    mpv_free(value);
+
+    if (count == 0) return NULL;
+    MP_TARRAY_APPEND(talloc_ctx, paths, count, NULL);
+    return paths;
+}
+
+// first line of dialog result
+static char *read_dialog_single(void *talloc_ctx, plugin_ctx *ctx) {
+    void *tmp = talloc_new(NULL);
+    char **paths = read_dialog(tmp, ctx);
+    char *ret = paths ? talloc_strdup(talloc_ctx, paths[0]) : NULL;
+    talloc_free(tmp);
+    return ret;
+}
+
+char *open_dialog(void *talloc_ctx, plugin_ctx *ctx) {
+    return read_dialog_single(talloc_ctx, ctx);
+}
+
+char **open_dialog_multi(void *talloc_ctx, plugin_ctx *ctx) {
+    return read_dialog(talloc_ctx, ctx);
+}
+
+char *open_folder(void *talloc_ctx, plugin_ctx *ctx) {
+    return read_dialog_single(talloc_ctx, ctx);
+}
+
+char *save_dialog(void *talloc_ctx, plugin_ctx *ctx) {
+    return read_dialog_single(talloc_ctx, ctx);
+}
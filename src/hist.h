@@ -0,0 +1,49 @@
+// Copyright (c) 2023-2024 tsl0922. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+#ifndef MPV_PLUGIN_HIST_H
+#define MPV_PLUGIN_HIST_H
+
+#include <stdint.h>
+
+#define HIST_BUCKETS 40
+
+// log2 histogram of non-negative values, e.g. latency in nanoseconds
+//
+// bucket i counts values in [2^i, 2^(i+1)), bucket 0 also counts 0. the
+// last bucket counts everything larger.
+typedef struct histogram {
+    uint64_t count;                  // number of values
+    int64_t total;                   // sum of values
+    int64_t max;                     // largest value
+    uint64_t buckets[HIST_BUCKETS];  // value count of each bucket
+} histogram;
+
+static inline void hist_add(histogram *h, int64_t value) {
+    int b = 0;
+    for (int64_t v = value; v > 1 && b < HIST_BUCKETS - 1; v >>= 1) b++;
+    h->buckets[b]++;
+    h->count++;
+    h->total += value;
+    if (value > h->max) h->max = value;
+}
+
+// estimate the p-th percentile (0-100), as the upper bound of its bucket
+static inline int64_t hist_percentile(const histogram *h, double p) {
+    if (h->count == 0) return 0;
+
+    uint64_t rank = (uint64_t)(h->count * p / 100.0);
+    if (rank >= h->count) rank = h->count - 1;
+
+    uint64_t seen = 0;
+    for (int b = 0; b < HIST_BUCKETS; b++) {
+        seen += h->buckets[b];
+        if (seen > rank) {
+            int64_t upper = ((int64_t)2 << b) - 1;
+            return upper < h->max ? upper : h->max;
+        }
+    }
+    return h->max;
+}
+
+#endif
@@ -0,0 +1,82 @@
+// Copyright (c) 2023-2024 tsl0922. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+#include "mpv_talloc.h"
+#include "idmap.h"
+
+struct idmap_entry {
+    int32_t index;  // model item index, -1 if id is free
+    uint32_t gen;   // generation when id was allocated
+};
+
+struct idmap {
+    unsigned int base;            // first id
+    unsigned int size;            // number of ids
+    struct idmap_entry *entries;  // indexed by id - base
+    uint32_t *free;               // ring buffer of free slots
+    unsigned int free_head;       // first free slot in ring
+    unsigned int free_count;      // number of free slots
+    uint32_t gen;                 // current generation
+};
+
+// create allocator for ids in range [base, max]
+idmap *idmap_create(void *talloc_ctx, unsigned int base, unsigned int max) {
+    idmap *map = talloc_zero(talloc_ctx, idmap);
+    map->base = base;
+    map->size = max - base + 1;
+    map->entries = talloc_array(map, struct idmap_entry, map->size);
+    map->free = talloc_array(map, uint32_t, map->size);
+    for (unsigned int i = 0; i < map->size; i++) {
+        map->entries[i] = (struct idmap_entry){.index = -1};
+        map->free[i] = i;
+    }
+    map->free_count = map->size;
+    return map;
+}
+
+// allocate an id for model item index, return 0 if all ids are in use
+unsigned int idmap_alloc(idmap *map, int index) {
+    if (map->free_count == 0) return 0;
+
+    uint32_t slot = map->free[map->free_head];
+    map->free_head = (map->free_head + 1) % map->size;
+    map->free_count--;
+
+    map->entries[slot] = (struct idmap_entry){.index = index, .gen = map->gen};
+    return map->base + slot;
+}
+
+// release id, it will be reused after all other free ids
+void idmap_free(idmap *map, unsigned int id) {
+    uint32_t slot = id - map->base;
+    if (slot >= map->size || map->entries[slot].index < 0) return;
+
+    map->entries[slot].index = -1;
+    map->free[(map->free_head + map->free_count) % map->size] = slot;
+    map->free_count++;
+}
+
+// update model item index of allocated id
+void idmap_set(idmap *map, unsigned int id, int index) {
+    uint32_t slot = id - map->base;
+    if (slot >= map->size || map->entries[slot].index < 0) return;
+
+    map->entries[slot].index = index;
+}
+
+// get model item index of id, return -1 if the id is not allocated, or it
+// was allocated after generation gen
+int idmap_get(idmap *map, unsigned int id, uint32_t gen) {
+    uint32_t slot = id - map->base;
+    if (slot >= map->size) return -1;
+
+    struct idmap_entry *e = &map->entries[slot];
+    if (e->index < 0 || e->gen > gen) return -1;
+    return e->index;
+}
+
+// get current generation
+uint32_t idmap_gen(idmap *map) { return map->gen; }
+
+// start a new generation, ids allocated from now on belong to it
+uint32_t idmap_next_gen(idmap *map) { return ++map->gen; }
@@ -0,0 +1,25 @@
+// Copyright (c) 2023-2024 tsl0922. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+#ifndef MPV_PLUGIN_IDMAP_H
+#define MPV_PLUGIN_IDMAP_H
+
+#include <stdint.h>
+
+// menu identifier allocator, with a dense id to model index table
+//
+// freed ids are recycled in FIFO order, so an id is reused as late as
+// possible. each allocation records the current generation, which lets
+// the caller reject ids allocated after a given point (e.g. a click on a
+// menu that was shown before the item was replaced).
+typedef struct idmap idmap;
+
+idmap *idmap_create(void *talloc_ctx, unsigned int base, unsigned int max);
+unsigned int idmap_alloc(idmap *map, int index);
+void idmap_free(idmap *map, unsigned int id);
+void idmap_set(idmap *map, unsigned int id, int index);
+int idmap_get(idmap *map, unsigned int id, uint32_t gen);
+uint32_t idmap_gen(idmap *map);
+uint32_t idmap_next_gen(idmap *map);
+
+#endif
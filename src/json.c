@@ -0,0 +1,249 @@
+// Copyright (c) 2023-2024 tsl0922. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+// in-place json parser, producing mpv_node
+//
+// the input buffer is modified: strings are unescaped in place and
+// terminated, and the resulting string nodes and map keys point into the
+// buffer. so the buffer must outlive the parsed node. lists are allocated
+// with talloc, use talloc_free() instead of mpv_free_node_contents() to
+// free the node.
+
+#include <stdlib.h>
+#include <string.h>
+#include "mpv_talloc.h"
+#include "json.h"
+
+// skip whitespace, e.g. after the root value, to check it's the whole input
+void json_skip_whitespace(char **src) {
+    while (**src == ' ' || **src == '\t' || **src == '\n' || **src == '\r')
+        (*src)++;
+}
+
+static bool eat_c(char **src, char c) {
+    json_skip_whitespace(src);
+    if (**src != c) return false;
+    (*src)++;
+    return true;
+}
+
+static int read_hex4(const char *s) {
+    int v = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = s[i];
+        v <<= 4;
+        if (c >= '0' && c <= '9') {
+            v |= c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            v |= c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            v |= c - 'A' + 10;
+        } else {
+            return -1;
+        }
+    }
+    return v;
+}
+
+// write code point as utf8, return number of bytes written
+static int write_utf8(char *out, unsigned int cp) {
+    unsigned char *d = (unsigned char *)out;
+    if (cp < 0x80) {
+        d[0] = cp;
+        return 1;
+    } else if (cp < 0x800) {
+        d[0] = 0xC0 | (cp >> 6);
+        d[1] = 0x80 | (cp & 0x3F);
+        return 2;
+    } else if (cp < 0x10000) {
+        d[0] = 0xE0 | (cp >> 12);
+        d[1] = 0x80 | ((cp >> 6) & 0x3F);
+        d[2] = 0x80 | (cp & 0x3F);
+        return 3;
+    }
+    d[0] = 0xF0 | (cp >> 18);
+    d[1] = 0x80 | ((cp >> 12) & 0x3F);
+    d[2] = 0x80 | ((cp >> 6) & 0x3F);
+    d[3] = 0x80 | (cp & 0x3F);
+    return 4;
+}
+
+// read \uXXXX escape (without the leading backslash), may be a surrogate
+// pair, return number of input chars consumed
+static int read_unicode(const char *in, char **out) {
+    int cp = read_hex4(in + 1);
+    if (cp < 0) return -1;
+    int len = 5;
+
+    if (cp >= 0xD800 && cp <= 0xDBFF && in[5] == '\\' && in[6] == 'u') {
+        int lo = read_hex4(in + 7);
+        if (lo >= 0xDC00 && lo <= 0xDFFF) {
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+            len += 6;
+        }
+    }
+    if (cp >= 0xD800 && cp <= 0xDFFF) cp = 0xFFFD;  // lone surrogate
+
+    *out += write_utf8(*out, cp);
+    return len;
+}
+
+// unescape string in place, the output is never longer than the input
+static int read_str(mpv_node *dst, char **src) {
+    if (!eat_c(src, '"')) return -1;
+
+    char *in = *src, *out = *src;
+    while (*in && *in != '"') {
+        if ((unsigned char)*in < 0x20) return -1;  // unescaped control char
+        if (*in != '\\') {
+            *out++ = *in++;
+            continue;
+        }
+        in++;
+        switch (*in) {
+            case '"':
+            case '\\':
+            case '/':
+                *out++ = *in++;
+                break;
+            case 'b':
+                *out++ = '\b', in++;
+                break;
+            case 'f':
+                *out++ = '\f', in++;
+                break;
+            case 'n':
+                *out++ = '\n', in++;
+                break;
+            case 'r':
+                *out++ = '\r', in++;
+                break;
+            case 't':
+                *out++ = '\t', in++;
+                break;
+            case 'u': {
+                int len = read_unicode(in, &out);
+                if (len < 0) return -1;
+                in += len;
+                break;
+            }
+            default:
+                return -1;
+        }
+    }
+    if (*in != '"') return -1;
+
+    dst->format = MPV_FORMAT_STRING;
+    dst->u.string = *src;
+    *out = '\0';
+    *src = in + 1;
+    return 0;
+}
+
+// skip decimal digits, return the number of digits skipped
+static int skip_digits(char **p) {
+    char *start = *p;
+    while (**p >= '0' && **p <= '9') (*p)++;
+    return *p - start;
+}
+
+// read number, its syntax is checked first, as strtod() also accepts hex,
+// inf, nan and a leading '+', which are not valid json
+//
+// number = [ "-" ] ( "0" / 1-9 *DIGIT ) [ "." 1*DIGIT ]
+//          [ ( "e" / "E" ) [ "+" / "-" ] 1*DIGIT ]
+static int read_num(mpv_node *dst, char **src) {
+    char *p = *src;
+    if (*p == '-') p++;
+    if (*p == '0') {
+        p++;
+    } else if (skip_digits(&p) == 0) {
+        return -1;
+    }
+    if (*p == '.') {
+        p++;
+        if (skip_digits(&p) == 0) return -1;
+    }
+    if (*p == 'e' || *p == 'E') {
+        p++;
+        if (*p == '+' || *p == '-') p++;
+        if (skip_digits(&p) == 0) return -1;
+    }
+
+    char *end = NULL;
+    double d = strtod(*src, &end);
+    if (end != p) return -1;
+
+    dst->format = MPV_FORMAT_DOUBLE;
+    dst->u.double_ = d;
+    *src = end;
+    return 0;
+}
+
+static int read_id(mpv_node *dst, char **src) {
+    if (strncmp(*src, "true", 4) == 0) {
+        dst->format = MPV_FORMAT_FLAG;
+        dst->u.flag = 1;
+        *src += 4;
+    } else if (strncmp(*src, "false", 5) == 0) {
+        dst->format = MPV_FORMAT_FLAG;
+        dst->u.flag = 0;
+        *src += 5;
+    } else if (strncmp(*src, "null", 4) == 0) {
+        dst->format = MPV_FORMAT_NONE;
+        *src += 4;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+static int read_sub(void *talloc_ctx, mpv_node *dst, char **src,
+                    int max_depth) {
+    bool is_arr = eat_c(src, '[');
+    if (!is_arr && !eat_c(src, '{')) return -1;
+    char term = is_arr ? ']' : '}';
+
+    mpv_node_list *list = talloc_zero(talloc_ctx, mpv_node_list);
+    dst->format = is_arr ? MPV_FORMAT_NODE_ARRAY : MPV_FORMAT_NODE_MAP;
+    dst->u.list = list;
+    if (eat_c(src, term)) return 0;
+
+    while (1) {
+        char *key = NULL;
+        if (!is_arr) {
+            mpv_node keynode;
+            if (read_str(&keynode, src) < 0) return -1;
+            if (!eat_c(src, ':')) return -1;
+            key = keynode.u.string;
+        }
+
+        MP_TARRAY_GROW(list, list->values, list->num);
+        if (!is_arr) MP_TARRAY_GROW(list, list->keys, list->num);
+        if (json_parse(list, &list->values[list->num], src, max_depth) < 0)
+            return -1;
+        if (!is_arr) list->keys[list->num] = key;
+        list->num++;
+
+        if (eat_c(src, ',')) continue;
+        if (eat_c(src, term)) return 0;
+        return -1;
+    }
+}
+
+// parse a json value from *src, and advance *src past it
+// return 0 on success, -1 on syntax error or if max_depth is exceeded
+int json_parse(void *talloc_ctx, mpv_node *dst, char **src, int max_depth) {
+    json_skip_whitespace(src);
+
+    char c = **src;
+    if (c == '{' || c == '[') {
+        if (max_depth <= 0) return -1;
+        return read_sub(talloc_ctx, dst, src, max_depth - 1);
+    } else if (c == '"') {
+        return read_str(dst, src);
+    } else if (c == '-' || (c >= '0' && c <= '9')) {
+        return read_num(dst, src);
+    }
+    return read_id(dst, src);
+}
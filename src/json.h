@@ -0,0 +1,15 @@
+// Copyright (c) 2023-2024 tsl0922. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+#ifndef MPV_PLUGIN_JSON_H
+#define MPV_PLUGIN_JSON_H
+
+#include <mpv/client.h>
+
+// default maximum nesting level of json_parse()
+#define JSON_MAX_DEPTH 50
+
+int json_parse(void *talloc_ctx, mpv_node *dst, char **src, int max_depth);
+void json_skip_whitespace(char **src);
+
+#endif
@@ -0,0 +1,143 @@
+// Copyright (c) 2023-2024 tsl0922. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+#ifndef MPV_PLUGIN_KEYS_H
+#define MPV_PLUGIN_KEYS_H
+
+#include <string.h>
+
+// known keys and values of menu, patch and dialog filter nodes
+enum node_key {
+    KEY_UNKNOWN = 0,
+    // menu item keys
+    KEY_TYPE,
+    KEY_TITLE,
+    KEY_CMD,
+    KEY_SHORTCUT,
+    KEY_STATE,
+    KEY_SUBMENU,  // also a "type" value
+    // menu item "type" values
+    KEY_SEPARATOR,
+    // menu item "state" values
+    KEY_HIDDEN,
+    KEY_CHECKED,
+    KEY_DISABLED,
+    // patch op keys
+    KEY_OP,
+    KEY_PATH,
+    KEY_ITEM,
+    // patch "op" values
+    KEY_SET_STATE,
+    KEY_SET_TITLE,
+    KEY_REPLACE_SUBMENU,
+    KEY_INSERT,
+    KEY_REMOVE,
+    // dialog filter keys
+    KEY_NAME,
+    KEY_SPEC,
+};
+
+#define KEY_MAX_LEN 15
+
+// classify node key or value, dispatched by length and first char, so that
+// at most one memcmp is needed
+static inline enum node_key node_key(const char *s) {
+    int len = 0;
+    while (len <= KEY_MAX_LEN && s[len]) len++;
+
+#define KEY_MATCH(str, key) \
+    if (memcmp(s, str, sizeof(str) - 1) == 0) return key
+
+    switch (len) {
+        case 2:
+            KEY_MATCH("op", KEY_OP);
+            break;
+        case 3:
+            KEY_MATCH("cmd", KEY_CMD);
+            break;
+        case 4:
+            switch (s[0]) {
+                case 't':
+                    KEY_MATCH("type", KEY_TYPE);
+                    break;
+                case 'n':
+                    KEY_MATCH("name", KEY_NAME);
+                    break;
+                case 's':
+                    KEY_MATCH("spec", KEY_SPEC);
+                    break;
+                case 'p':
+                    KEY_MATCH("path", KEY_PATH);
+                    break;
+                case 'i':
+                    KEY_MATCH("item", KEY_ITEM);
+                    break;
+            }
+            break;
+        case 5:
+            switch (s[0]) {
+                case 't':
+                    KEY_MATCH("title", KEY_TITLE);
+                    break;
+                case 's':
+                    KEY_MATCH("state", KEY_STATE);
+                    break;
+            }
+            break;
+        case 6:
+            switch (s[0]) {
+                case 'h':
+                    KEY_MATCH("hidden", KEY_HIDDEN);
+                    break;
+                case 'i':
+                    KEY_MATCH("insert", KEY_INSERT);
+                    break;
+                case 'r':
+                    KEY_MATCH("remove", KEY_REMOVE);
+                    break;
+            }
+            break;
+        case 7:
+            switch (s[0]) {
+                case 'c':
+                    KEY_MATCH("checked", KEY_CHECKED);
+                    break;
+                case 's':
+                    KEY_MATCH("submenu", KEY_SUBMENU);
+                    break;
+            }
+            break;
+        case 8:
+            switch (s[0]) {
+                case 's':
+                    KEY_MATCH("shortcut", KEY_SHORTCUT);
+                    break;
+                case 'd':
+                    KEY_MATCH("disabled", KEY_DISABLED);
+                    break;
+            }
+            break;
+        case 9:
+            // "separator", "set-state" and "set-title" differ at s[4]
+            switch (s[4]) {
+                case 'r':
+                    KEY_MATCH("separator", KEY_SEPARATOR);
+                    break;
+                case 's':
+                    KEY_MATCH("set-state", KEY_SET_STATE);
+                    break;
+                case 't':
+                    KEY_MATCH("set-title", KEY_SET_TITLE);
+                    break;
+            }
+            break;
+        case 15:
+            KEY_MATCH("replace-submenu", KEY_REPLACE_SUBMENU);
+            break;
+    }
+
+#undef KEY_MATCH
+    return KEY_UNKNOWN;
+}
+
+#endif
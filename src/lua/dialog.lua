@@ -16,9 +16,8 @@ local o = {
 opts.read_options(o)
 
 local menu_native = 'menu'
-local open_action = ''
-local save_action = ''
-local save_arg1 = nil
+local requests = {}
+local last_id = 0
 
 -- show error message on screen and log
 local function show_error(message)
@@ -97,15 +96,15 @@ local function open_file(i, path, action)
 end
 
 -- open callback
-local function open_cb(...)
+local function open_cb(state, ...)
     for i, v in ipairs({ ... }) do
         local path = tostring(v)
-        open_file(i, path, open_action)
+        open_file(i, path, state.action)
     end
 end
 
 -- open folder callback
-local function open_folder_cb(path)
+local function open_folder_cb(state, path)
     if utils.file_info(utils.join_path(path, 'BDMV')) then
         open_bluray(path)
     elseif utils.file_info(utils.join_path(path, 'VIDEO_TS')) then
@@ -116,29 +115,48 @@ local function open_folder_cb(path)
 end
 
 -- save callback
-local function save_cb(path)
-    if save_action == 'screenshot' then
-        mp_commandv('screenshot-to-file', path, save_arg1)
-    elseif save_action == 'playlist' then
+local function save_cb(state, path)
+    if state.action == 'screenshot' then
+        mp_commandv('screenshot-to-file', path, state.arg1)
+    elseif state.action == 'playlist' then
         write_playlist(path)
     end
 end
 
 -- clipboard callback
-local function clipboard_cb(clipboard)
+local function clipboard_cb(state, clipboard)
     mp.osd_message('clipboard: ' .. clipboard)
     local i = 1
     for line in string.gmatch(clipboard, '[^\r\n]+') do
-        open_file(i, line, open_action)
+        open_file(i, line, state.action)
         i = i + 1
     end
 end
 
+-- send request to menu plugin, it's replied asynchronously with the id,
+-- the state is kept for the reply callback
+local function request(cmd, state)
+    last_id = last_id + 1
+    local id = tostring(last_id)
+    requests[id] = state or {}
+    mp.commandv('script-message-to', menu_native, cmd, mp.get_script_name(), id)
+end
+
+-- handle request reply, a cancelled request is replied without result
+local function on_reply(name, cb)
+    mp.register_script_message(name, function(id, ...)
+        local state = requests[id]
+        if not state then return end
+        requests[id] = nil
+        if select('#', ...) > 0 then cb(state, ...) end
+    end)
+end
+
 -- handle message replies
-mp.register_script_message('dialog-open-multi-reply', open_cb)
-mp.register_script_message('dialog-open-folder-reply', open_folder_cb)
-mp.register_script_message('dialog-save-reply', save_cb)
-mp.register_script_message('clipboard-get-reply', clipboard_cb)
+on_reply('dialog-open-multi-reply', open_cb)
+on_reply('dialog-open-folder-reply', open_folder_cb)
+on_reply('dialog-save-reply', save_cb)
+on_reply('clipboard-get-reply', clipboard_cb)
 
 -- detect dll client name
 mp.register_script_message('menu-init', function(name) menu_native = name end)
@@ -152,7 +170,7 @@ mp.register_script_message('open', function(action)
         append_raw(filters, name, o[type])
     end
 
-    open_action = action or ''
+    local open_action = action or ''
     local filters = {}
 
     if open_action == '' or open_action == 'append' then
@@ -178,18 +196,17 @@ mp.register_script_message('open', function(action)
     end
 
     mp.set_property_native('user-data/menu/dialog/filters', filters)
-    mp.commandv('script-message-to', menu_native, 'dialog/open-multi', mp.get_script_name())
+    request('dialog/open-multi', { action = open_action })
 end)
 
 -- open folder dialog
 mp.register_script_message('open-folder', function()
-    mp.commandv('script-message-to', menu_native, 'dialog/open-folder', mp.get_script_name())
+    request('dialog/open-folder')
 end)
 
 -- save dialog
 mp.register_script_message('save', function(action, arg1)
-    save_action = action or ''
-    save_arg1 = arg1
+    local save_action = action or ''
     if save_action == 'screenshot' then
         if not mp.get_property_number('vid') then
             mp.osd_message('no video track')
@@ -217,13 +234,12 @@ mp.register_script_message('save', function(action, arg1)
         mp.osd_message('unknown save action: ' .. save_action)
         return
     end
-    mp.commandv('script-message-to', menu_native, 'dialog/save', mp.get_script_name())
+    request('dialog/save', { action = save_action, arg1 = arg1 })
 end)
 
 -- open clipboard
 mp.register_script_message('open-clipboard', function(action)
-    open_action = action
-    mp.commandv('script-message-to', menu_native, 'clipboard/get', mp.get_script_name())
+    request('clipboard/get', { action = action })
 end)
 
 -- set clipboard
@@ -12,11 +12,23 @@ local o = {
     escape_title = true,     -- escape & to && in menu title
     max_title_length = 80,   -- limit the title length, set to 0 to disable.
     max_playlist_items = 20, -- limit the playlist items in submenu, set to 0 to disable.
+    json_transport = false,  -- commit menu data as json string, native menu only
+    patch_updates = false,   -- send dynamic menu changes as patches, native menu only,
+                             -- user-data/menu/items is not updated by patches
 }
 opts.read_options(o)
 
 local use_mpv_impl = o.use_mpv_impl and (mp.get_property_native('menu-data') ~= nil)
 local menu_prop = use_mpv_impl and 'menu-data' or 'user-data/menu/items' -- menu data property
+local use_json = o.json_transport and not use_mpv_impl
+local menu_json_prop = 'user-data/menu/json' -- menu data property, json transport
+local json_cache = setmetatable({}, { __mode = 'k' }) -- item -> serialized json
+local use_patch = o.patch_updates and not use_mpv_impl
+local patch_ops = {}                     -- pending patch ops
+local menu_seq_prop = 'user-data/menu/seq' -- commit sequence number, patch only
+local commit_seq = 0                     -- commit sequence number, odd while committing
+local menu_native = 'menu'               -- native menu client name
+local native_ready = false               -- menu-init received from native menu
 local menu_items = {}                    -- raw menu data
 local menu_items_dirty = false           -- menu data dirty flag
 local dyn_menus = {}                     -- dynamic menu list
@@ -279,14 +291,155 @@ local function build_track_items(list, type, prop, prefix)
     return items
 end
 
+-- serialize menu items to json, reusing the cached json of unchanged items
+local function items_to_json(items)
+    local list = {}
+    for i, item in ipairs(items) do
+        local json = json_cache[item]
+        if not json then
+            local fields = {}
+            for k, v in pairs(item) do
+                local value = k == 'submenu' and items_to_json(v) or utils.format_json(v)
+                fields[#fields + 1] = utils.format_json(k) .. ':' .. value
+            end
+            json = '{' .. table.concat(fields, ',') .. '}'
+            json_cache[item] = json
+        end
+        list[i] = json
+    end
+    return '[' .. table.concat(list, ',') .. ']'
+end
+
+-- invalidate the cached json of dynamic menu item and its ancestors
+local function invalidate_json(menu)
+    json_cache[menu.item] = nil
+    for _, parent in ipairs(menu.parents) do json_cache[parent] = nil end
+end
+
+-- compare two values, tables are compared by content
+local function equals(a, b)
+    if type(a) ~= 'table' or type(b) ~= 'table' then return a == b end
+    for k, v in pairs(a) do
+        if not equals(v, b[k]) then return false end
+    end
+    for k, _ in pairs(b) do
+        if a[k] == nil then return false end
+    end
+    return true
+end
+
+-- fields of menu item that can be patched, the submenu is patched by
+-- patch_menu() only for the changed dynamic menu item
+local patchable = { title = true, shortcut = true, state = true }
+local patchable_dyn = { title = true, shortcut = true, state = true, submenu = true }
+
+-- compare two menu items, ignoring the fields that can be patched
+local function same_item(a, b, fields)
+    fields = fields or patchable
+    for k, v in pairs(a) do
+        if not fields[k] and not equals(v, b[k]) then return false end
+    end
+    for k, _ in pairs(b) do
+        if not fields[k] and a[k] == nil then return false end
+    end
+    return true
+end
+
+-- shallow copy of menu item, to compare with after it's changed
+local function copy_item(item)
+    local copy = {}
+    for k, v in pairs(item) do copy[k] = v end
+    return copy
+end
+
+-- return path of the n-th submenu item
+local function child_path(path, n)
+    local child = { unpack(path) }
+    child[#child + 1] = n
+    return child
+end
+
+-- queue patch ops for the change of dynamic menu item, old is a copy of the
+-- item before the change
+--
+-- items of a submenu with the same layout are patched one by one, so that
+-- moving a checkmark only sends the state of 2 items. the item is replaced
+-- if a field that can't be patched is changed, e.g. its type or command.
+local function patch_menu(menu, old)
+    local item = menu.item
+    local ops = patch_ops
+
+    if not same_item(old, item, patchable_dyn) then
+        ops[#ops + 1] = { op = 'remove', path = menu.path }
+        ops[#ops + 1] = { op = 'insert', path = menu.path, item = item }
+        return
+    end
+    if not equals(old.state, item.state) then
+        ops[#ops + 1] = { op = 'set-state', path = menu.path, state = item.state or {} }
+    end
+    if old.title ~= item.title or old.shortcut ~= item.shortcut then
+        ops[#ops + 1] = {
+            op = 'set-title',
+            path = menu.path,
+            title = item.title,
+            shortcut = item.shortcut,
+        }
+    end
+
+    local submenu, old_submenu = item.submenu, old.submenu
+    if item.type ~= 'submenu' or equals(old_submenu, submenu) then return end
+
+    local item_ops = {}
+    if old_submenu and #old_submenu == #submenu then
+        for i, new in ipairs(submenu) do
+            local prev = old_submenu[i]
+            if not same_item(prev, new) then
+                item_ops = nil
+                break
+            end
+            if not equals(prev.state, new.state) then
+                item_ops[#item_ops + 1] = { op = 'set-state', path = child_path(menu.path, i), state = new.state or {} }
+            end
+            if prev.title ~= new.title or prev.shortcut ~= new.shortcut then
+                item_ops[#item_ops + 1] = {
+                    op = 'set-title',
+                    path = child_path(menu.path, i),
+                    title = new.title,
+                    shortcut = new.shortcut,
+                }
+            end
+        end
+    else
+        item_ops = nil
+    end
+
+    if item_ops then
+        for _, op in ipairs(item_ops) do ops[#ops + 1] = op end
+    else
+        ops[#ops + 1] = { op = 'replace-submenu', path = menu.path, submenu = submenu }
+    end
+end
+
+-- mark menu item changed, it's sent as patch or committed on idle, old is a
+-- copy of the item before the change
+--
+-- patches are only sent once the native menu is initialized, before that it
+-- reads the whole menu data anyway.
+local function menu_changed(menu, old)
+    invalidate_json(menu)
+    if use_patch and native_ready then
+        patch_menu(menu, old)
+    else
+        menu_items_dirty = true
+    end
+end
+
 -- update menu item to a submenu
 local function to_submenu(item)
     item.type = 'submenu'
     item.submenu = {}
     item.cmd = nil
 
-    menu_items_dirty = true
-
     return item.submenu
 end
 
@@ -464,7 +617,6 @@ local function update_menu_state(menu)
         for s in res:gmatch('[^,%s]+') do state[#state + 1] = s end
     end
     menu.item.state = state
-    menu_items_dirty = true
 end
 
 -- dynamic menu updaters
@@ -485,16 +637,21 @@ local dyn_updaters = {
 local function update_menu(menu)
     if menu.updater then
         msg.debug('update menu: ' .. menu.item.title)
+        local item = menu.item
+        local old = copy_item(item)
         current_menu = menu
         menu.updater(menu)
         current_menu = nil
+        menu_changed(menu, old)
     end
 end
 
 -- load dynamic menu item
-local function dyn_menu_load(item, keyword)
+local function dyn_menu_load(item, keyword, parents, path)
     local menu = {
         item = item,
+        parents = { unpack(parents) },
+        path = { unpack(path) },
         updater = nil,
         state = nil,
         dirty = false,
@@ -521,26 +678,30 @@ end
 -- parse the keyword from it.
 --
 -- example: ignore        #menu: Chapters #@chapters    # extra comment
-local function dyn_menu_check(items)
+local function dyn_menu_check(items, parents, path)
     if not items then return end
-    for _, item in ipairs(items) do
+    for i, item in ipairs(items) do
+        path[#path + 1] = i
         if item.type == 'submenu' then
-            dyn_menu_check(item.submenu)
+            parents[#parents + 1] = item
+            dyn_menu_check(item.submenu, parents, path)
+            parents[#parents] = nil
         else
             if item.type ~= 'separator' and item.cmd then
                 local keyword = item.cmd:match('%s*#@(.-)%s*$') or ''
                 if keyword ~= '' then
                     msg.debug('load menu: ' .. item.title, ', keyword: ' .. keyword)
-                    dyn_menu_load(item, keyword)
+                    dyn_menu_load(item, keyword, parents, path)
                 end
             end
         end
+        path[#path] = nil
     end
 end
 
 -- load dynamic menus
 local function load_dyn_menus()
-    dyn_menu_check(menu_items)
+    dyn_menu_check(menu_items, {}, {})
 
     -- broadcast menu ready message
     mp.commandv('script-message', 'menu-ready', mp.get_script_name())
@@ -662,12 +823,20 @@ mp.register_script_message('update', function(keyword, json)
     end
 
     local item = menu.item
+    local old = copy_item(item)
     if not data.title or data.title == '' then data.title = item.title end
     if not data.type or data.type == '' then data.type = item.type end
 
     for k, _ in pairs(item) do item[k] = nil end
     for k, v in pairs(data) do item[k] = v end
 
+    menu_changed(menu, old)
+end)
+
+-- script message: menu-patch-failed
+--
+-- the native menu is out of sync, commit the whole menu again
+mp.register_script_message('menu-patch-failed', function()
     menu_items_dirty = true
 end)
 
@@ -687,9 +856,32 @@ mp.register_idle(function()
     end
 
     if menu_items_dirty then
-        msg.debug('commit menu items: ' .. menu_prop)
-        mp.set_property_native(menu_prop, menu_items)
+        -- the native menu may read the menu data while it's written, it
+        -- checks the sequence number before and after reading
+        if use_patch then
+            commit_seq = commit_seq + 1
+            mp.set_property_native(menu_seq_prop, commit_seq)
+        end
+        if use_json then
+            msg.debug('commit menu items: ' .. menu_json_prop)
+            mp.set_property(menu_json_prop, items_to_json(menu_items))
+        else
+            msg.debug('commit menu items: ' .. menu_prop)
+            mp.set_property_native(menu_prop, menu_items)
+        end
+        if use_patch then
+            commit_seq = commit_seq + 1
+            mp.set_property_native(menu_seq_prop, commit_seq)
+        end
         menu_items_dirty = false
+        patch_ops = {}
+    elseif #patch_ops > 0 then
+        -- patches are based on the last commit, the native menu may get
+        -- them before the property change of the commit
+        msg.debug('patch menu items: ' .. #patch_ops .. ' ops')
+        mp.commandv('script-message-to', menu_native, 'patch', utils.format_json(patch_ops),
+            tostring(commit_seq))
+        patch_ops = {}
     end
 end)
 
@@ -704,10 +896,9 @@ if use_mpv_impl then
         mp.commandv('context-menu')
     end)
 else
-    local menu_native = 'menu'
-
     mp.register_script_message('menu-init', function(name)
         menu_native = name
+        native_ready = true
     end)
 
     mp.add_key_binding('MBTN_RIGHT', 'show', function()
@@ -1,173 +1,138 @@
 // Copyright (c) 2023-2024 tsl0922. All rights reserved.
 // SPDX-License-Identifier: GPL-2.0-only
 
-#include <windows.h>
 #include "mpv_talloc.h"
+#include "backend.h"
+#include "json.h"
+#include "patch.h"
 #include "menu.h"
 
-// append menu item to HMENU
-static int append_menu(HMENU hmenu, UINT fMask, UINT fType, UINT fState,
-                       wchar_t *title, HMENU submenu, void *data) {
-    static UINT id = WM_USER + 100;
-    MENUITEMINFOW mii = {0};
-
-    mii.cbSize = sizeof(mii);
-    mii.fMask = MIIM_ID | fMask;
-    mii.wID = id++;
-    // menu identifier should never be greater than the max value of unsigned 16-bit integer
-    if (id > 0xFFFF) id = WM_USER + 100;
-
-    if (fMask & MIIM_FTYPE) mii.fType = fType;
-    if (fMask & MIIM_STATE) mii.fState = fState;
-    if (fMask & MIIM_STRING) {
-        mii.dwTypeData = title;
-        mii.cch = wcslen(title);
+// publish menu model to the UI thread
+//
+// the model is built into a back buffer off the UI thread, and swapped in
+// by apply_menu(), so the presented menu is never touched here. a model
+// that is not applied yet is replaced, only the latest one is applied.
+//
+// the last published model is kept in ctx->latest, new models are compared
+// with it, and patched against it. the presented model can't be used, it
+// lags behind while the UI thread is applying a model. once the UI thread
+// takes it, it's freed by that thread when it's replaced, so it's only read
+// in the epoch section.
+static void publish_menu(plugin_ctx *ctx, menu_model *model) {
+    epoch_enter(ctx->epoch, MENU_READER_PLUGIN);
+    bool same = ctx->latest->hash[0] == model->hash[0];
+    epoch_leave(ctx->epoch, MENU_READER_PLUGIN);
+    if (same) {
+        talloc_free(model);
+        return;
     }
-    if (fMask & MIIM_SUBMENU) mii.hSubMenu = submenu;
-    if (fMask & MIIM_DATA) mii.dwItemData = (ULONG_PTR)data;
 
-    return InsertMenuItemW(hmenu, -1, TRUE, &mii) ? mii.wID : -1;
+    ctx->latest = model;
+    talloc_free(atomic_exchange(&ctx->pending, model));
+    backend_update(ctx);
 }
 
-// build fState for menu item creation
-static int build_state(mpv_node *node) {
-    int fState = 0;
-    for (int i = 0; i < node->u.list->num; i++) {
-        mpv_node *item = &node->u.list->values[i];
-        if (item->format != MPV_FORMAT_STRING) continue;
-
-        if (strcmp(item->u.string, "hidden") == 0) {
-            return -1;
-        } else if (strcmp(item->u.string, "checked") == 0) {
-            fState |= MFS_CHECKED;
-        } else if (strcmp(item->u.string, "disabled") == 0) {
-            fState |= MFS_DISABLED;
-        }
-    }
-    return fState;
+// build menu model from menu node, and publish it
+void update_menu(plugin_ctx *ctx, mpv_node *node) {
+    publish_menu(ctx, model_build(NULL, node));
 }
 
-// build dwTypeData for menu item creation
-static wchar_t *build_title(void *talloc_ctx, char *title, char *shortcut) {
-    if (shortcut && shortcut[0]) {
-        char *buf = talloc_asprintf(NULL, "%s\t%s", title, shortcut);
-        wchar_t *wbuf = mp_from_utf8(talloc_ctx, buf);
-        talloc_free(buf);
-        return wbuf;
-    }
-    return mp_from_utf8(talloc_ctx, title);
+// apply the published menu model to the presented menu with the backend
+// ops, only the changed items are touched
+//
+// this runs on the UI thread, and is deferred while the menu is shown, so
+// an open menu is never modified. the replaced model may still be read by
+// other threads, it's freed when they are done with it.
+void apply_menu(plugin_ctx *ctx, const struct diff_ops *ops) {
+    if (ctx->menu_open) return;
+    menu_model *model = atomic_exchange(&ctx->pending, NULL);
+    if (model == NULL) return;
+
+    menu_model *old = atomic_load(&ctx->model);
+    idmap_next_gen(ctx->idmap);
+    menu_diff(old, model, ops, ctx);
+
+    // matched items keep their ids, but may have moved in the model
+    for (int i = 1; i < model->num_items; i++)
+        idmap_set(ctx->idmap, model->id[i], i);
+
+    atomic_store(&ctx->model, model);
+    epoch_retire(ctx->epoch, old);
 }
 
-// build HMENU from mpv node
-//
-// node structure:
+// release menu identifiers of item and its submenu items, for diff_ops.remove
+void free_menu_ids(plugin_ctx *ctx, menu_model *m, int item) {
+    idmap_free(ctx->idmap, m->id[item]);
+    for (int i = 0; i < m->count[item]; i++)
+        free_menu_ids(ctx, m, m->first[item] + i);
+}
+
+// parse json menu data or patch ops, the whole input must be a single
+// json value, text after it is rejected
+static bool parse_json(void *tmp, mpv_node *dst, char *json) {
+    if (json_parse(tmp, dst, &json, JSON_MAX_DEPTH) < 0) return false;
+    json_skip_whitespace(&json);
+    return *json == '\0';
+}
+
+// update menu from json menu data
 //
-// MPV_FORMAT_NODE_ARRAY
-//   MPV_FORMAT_NODE_MAP (menu item)
-//      "type"           MPV_FORMAT_STRING
-//      "title"          MPV_FORMAT_STRING
-//      "cmd"            MPV_FORMAT_STRING
-//      "shortcut"       MPV_FORMAT_STRING
-//      "state"          MPV_FORMAT_NODE_ARRAY[MPV_FORMAT_STRING]
-//      "submenu"        MPV_FORMAT_NODE_ARRAY[menu item]
-static void build_menu(void *talloc_ctx, HMENU hmenu, mpv_node *node) {
-    if (node->format != MPV_FORMAT_NODE_ARRAY || node->u.list->num == 0) return;
-
-    for (int i = 0; i < node->u.list->num; i++) {
-        mpv_node *item = &node->u.list->values[i];
-        if (item->format != MPV_FORMAT_NODE_MAP) continue;
-
-        mpv_node_list *list = item->u.list;
-
-        char *type = "";
-        char *title = NULL;
-        char *cmd = NULL;
-        char *shortcut = NULL;
-        int fState = 0;
-        HMENU submenu = NULL;
-
-        for (int j = 0; j < list->num; j++) {
-            char *key = list->keys[j];
-            mpv_node *value = &list->values[j];
-
-            switch (value->format) {
-                case MPV_FORMAT_STRING:
-                    if (strcmp(key, "title") == 0) {
-                        title = value->u.string;
-                    } else if (strcmp(key, "cmd") == 0) {
-                        cmd = value->u.string;
-                    } else if (strcmp(key, "type") == 0) {
-                        type = value->u.string;
-                    } else if (strcmp(key, "shortcut") == 0) {
-                        shortcut = value->u.string;
-                    }
-                    break;
-                case MPV_FORMAT_NODE_ARRAY:
-                    if (strcmp(key, "state") == 0) {
-                        fState = build_state(value);
-                    } else if (strcmp(key, "submenu") == 0) {
-                        submenu = CreatePopupMenu();
-                        build_menu(talloc_ctx, submenu, value);
-                    }
-                    break;
-                default:
-                    break;
-            }
-        }
-        if (fState == -1) continue;
-
-        if (strcmp(type, "separator") == 0) {
-            append_menu(hmenu, MIIM_FTYPE, MFT_SEPARATOR, 0, NULL, NULL, NULL);
-        } else {
-            if (title == NULL || title[0] == '\0') continue;
-
-            UINT fMask = MIIM_STRING | MIIM_STATE;
-            bool grayed = false;
-            if (strcmp(type, "submenu") == 0) {
-                if (submenu == NULL) submenu = CreatePopupMenu();
-                fMask |= MIIM_SUBMENU;
-                grayed = GetMenuItemCount(submenu) == 0;
-            } else {
-                fMask |= MIIM_DATA;
-                grayed = cmd == NULL || cmd[0] == '\0' || cmd[0] == '#' ||
-                         strcmp(cmd, "ignore") == 0;
-            }
-            int id = append_menu(hmenu, fMask, 0, (UINT)fState,
-                                 build_title(talloc_ctx, title, shortcut),
-                                 submenu, talloc_strdup(talloc_ctx, cmd));
-            if (grayed) EnableMenuItem(hmenu, id, MF_BYCOMMAND | MF_GRAYED);
-        }
-    }
+// the json is parsed in place, so it's modified, and the node strings point
+// into it. they only live until the model is built.
+void update_menu_json(plugin_ctx *ctx, char *json) {
+    void *tmp = talloc_new(NULL);
+    mpv_node node = {0};
+
+    if (parse_json(tmp, &node, json)) update_menu(ctx, &node);
+    talloc_free(tmp);
 }
 
-// update HMENU if menu node changed
-void update_menu(plugin_ctx *ctx, mpv_node *node) {
-    while (GetMenuItemCount(ctx->hmenu) > 0)
-        DeleteMenu(ctx->hmenu, 0, MF_BYPOSITION);
-    talloc_free_children(ctx->hmenu_ctx);
-    build_menu(ctx->hmenu_ctx, ctx->hmenu, node);
+// apply json patch ops to the last published menu model, and publish it,
+// return false if the patch can't be applied
+bool patch_menu(plugin_ctx *ctx, char *json) {
+    void *tmp = talloc_new(NULL);
+    mpv_node ops = {0};
+    menu_model *model = NULL;
+
+    if (parse_json(tmp, &ops, json)) {
+        epoch_enter(ctx->epoch, MENU_READER_PLUGIN);
+        model = patch_apply(NULL, ctx->latest, &ops);
+        epoch_leave(ctx->epoch, MENU_READER_PLUGIN);
+    }
+    talloc_free(tmp);
+
+    if (model) publish_menu(ctx, model);
+    return model != NULL;
 }
 
-// show menu at position if it is in window
-void show_menu(plugin_ctx *ctx, POINT *pt) {
-    RECT rc;
-    GetClientRect(ctx->hwnd, &rc);
-    ScreenToClient(ctx->hwnd, pt);
-    if (!PtInRect(&rc, *pt)) return;
-
-    ClientToScreen(ctx->hwnd, pt);
-    mp_command_async("script-message menu-open");
-    TrackPopupMenuEx(ctx->hmenu, TPM_LEFTALIGN | TPM_LEFTBUTTON, pt->x, pt->y,
-                     ctx->hwnd, NULL);
-    mp_command_async("script-message menu-close");
+// mark menu as shown, the menu model is not applied until it's closed, and
+// clicks on items that are added after this are rejected by close_menu()
+void open_menu(plugin_ctx *ctx) {
+    ctx->menu_gen = idmap_gen(ctx->idmap);
+    ctx->menu_open = true;
+    mp_command_async("script-message menu-open", false);
 }
 
-// run mpv command stored in menu item data
-void handle_menu(plugin_ctx *ctx, UINT id) {
-    MENUITEMINFOW mii = {0};
-    mii.cbSize = sizeof(mii);
-    mii.fMask = MIIM_DATA;
-    if (!GetMenuItemInfoW(ctx->hmenu, id, FALSE, &mii)) return;
+// get mpv command of clicked menu item, NULL if it has none, or the item is
+// added after the menu is shown
+static const char *find_command(plugin_ctx *ctx, unsigned int id) {
+    menu_model *m = atomic_load(&ctx->model);
+    int i = idmap_get(ctx->idmap, id, ctx->menu_gen);
+    if (i <= 0 || i >= m->num_items || m->id[i] != id || !m->cmd[i])
+        return NULL;
+    return model_str(m, m->cmd[i]);
+}
 
-    if (mii.dwItemData) mp_command_async((const char *)mii.dwItemData);
+// mark menu as closed, run the command of the clicked item, and apply the
+// menu model published while it's shown. id is the clicked item, or 0.
+//
+// the click is resolved against the shown model, before the published one
+// is applied, which may free the id, or move it to another item.
+void close_menu(plugin_ctx *ctx, const struct diff_ops *ops, unsigned int id) {
+    mp_command_async("script-message menu-close", false);
+    const char *cmd = id ? find_command(ctx, id) : NULL;
+    if (cmd) mp_command_async(cmd, true);
+
+    ctx->menu_open = false;
+    apply_menu(ctx, ops);
 }
@@ -4,12 +4,29 @@
 #ifndef MPV_PLUGIN_MENU_H
 #define MPV_PLUGIN_MENU_H
 
+#include "diff.h"
 #include "plugin.h"
 
 #define MENU_DATA_PROP "user-data/menu/items"
+#define MENU_JSON_PROP "user-data/menu/json"
+#define MENU_STATS_PROP "user-data/menu/stats"
+#define MENU_SEQ_PROP "user-data/menu/seq"
+
+// menu identifier range, the identifier is the low-word of win32 WM_COMMAND
+// wParam, an unsigned 16-bit integer, and starts after WM_USER + 100
+#define MENU_ID_BASE 0x0464
+#define MENU_ID_MAX 0xFFFF
+
+// epoch slots of menu model readers outside the UI thread
+#define MENU_READER_SLOTS 1
+#define MENU_READER_PLUGIN 0  // plugin thread
 
 void update_menu(plugin_ctx *ctx, mpv_node *node);
-void show_menu(plugin_ctx *ctx, POINT *pt);
-void handle_menu(plugin_ctx *ctx, UINT id);
+void update_menu_json(plugin_ctx *ctx, char *json);
+bool patch_menu(plugin_ctx *ctx, char *json);
+void apply_menu(plugin_ctx *ctx, const struct diff_ops *ops);
+void free_menu_ids(plugin_ctx *ctx, menu_model *m, int item);
+void open_menu(plugin_ctx *ctx);
+void close_menu(plugin_ctx *ctx, const struct diff_ops *ops, unsigned int id);
 
 #endif
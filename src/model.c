@@ -0,0 +1,469 @@
+// Copyright (c) 2023-2024 tsl0922. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+#include <string.h>
+#include "mpv_talloc.h"
+#include "keys.h"
+#include "model.h"
+
+// menu item fields parsed from mpv node
+struct item_info {
+    int type;
+    int state;
+    const char *title;
+    const char *shortcut;
+    const char *cmd;
+    mpv_node *submenu;
+};
+
+// submenu items replaced by model_splice()
+struct splice {
+    int parent;       // submenu item index in source model
+    int pos;          // first replaced item position
+    int remove;       // number of replaced items
+    mpv_node *items;  // new items
+    int num_items;    // number of new items
+};
+
+// model builder state
+struct builder {
+    menu_model *m;
+    int next;    // next free item index
+    size_t pos;  // next free arena offset
+
+    menu_model *src;          // source model, when splicing
+    int32_t *from;            // source item index, -1 if built from node
+    const struct splice *sp;  // replaced submenu items of source model
+};
+
+// parse state flags from mpv node
+int model_parse_state(mpv_node *node) {
+    int flags = 0;
+    if (node == NULL || node->format != MPV_FORMAT_NODE_ARRAY) return flags;
+
+    for (int i = 0; i < node->u.list->num; i++) {
+        mpv_node *item = &node->u.list->values[i];
+        if (item->format != MPV_FORMAT_STRING) continue;
+
+        switch (node_key(item->u.string)) {
+            case KEY_HIDDEN:
+                flags |= MENU_HIDDEN;
+                break;
+            case KEY_CHECKED:
+                flags |= MENU_CHECKED;
+                break;
+            case KEY_DISABLED:
+                flags |= MENU_DISABLED;
+                break;
+            default:
+                break;
+        }
+    }
+    return flags;
+}
+
+// compute item flags from state flags and item fields
+static int item_flags(int state, int type, const char *label,
+                      const char *cmd) {
+    if (type == MENU_SEPARATOR) return state & MENU_HIDDEN;
+
+    int flags = state;
+    if (label[0] == '\0') flags |= MENU_HIDDEN;
+    if (type == MENU_ITEM && (cmd[0] == '\0' || cmd[0] == '#' ||
+                              strcmp(cmd, "ignore") == 0))
+        flags |= MENU_DISABLED;
+    return flags;
+}
+
+// parse menu item from mpv node
+//
+// node structure:
+//
+// MPV_FORMAT_NODE_MAP (menu item)
+//    "type"           MPV_FORMAT_STRING
+//    "title"          MPV_FORMAT_STRING
+//    "cmd"            MPV_FORMAT_STRING
+//    "shortcut"       MPV_FORMAT_STRING
+//    "state"          MPV_FORMAT_NODE_ARRAY[MPV_FORMAT_STRING]
+//    "submenu"        MPV_FORMAT_NODE_ARRAY[menu item]
+//
+// every node becomes an item, so that items can be addressed by their
+// index in the node list. invalid items are hidden.
+static void parse_item(mpv_node *node, struct item_info *info) {
+    *info = (struct item_info){.type = MENU_ITEM, .state = MENU_HIDDEN};
+    if (node->format != MPV_FORMAT_NODE_MAP) return;
+
+    mpv_node_list *list = node->u.list;
+    enum node_key type = KEY_UNKNOWN;
+    info->state = 0;
+
+    for (int i = 0; i < list->num; i++) {
+        mpv_node *value = &list->values[i];
+        enum node_key key = node_key(list->keys[i]);
+
+        switch (value->format) {
+            case MPV_FORMAT_STRING:
+                if (key == KEY_TITLE) {
+                    info->title = value->u.string;
+                } else if (key == KEY_CMD) {
+                    info->cmd = value->u.string;
+                } else if (key == KEY_TYPE) {
+                    type = node_key(value->u.string);
+                } else if (key == KEY_SHORTCUT) {
+                    info->shortcut = value->u.string;
+                }
+                break;
+            case MPV_FORMAT_NODE_ARRAY:
+                if (key == KEY_STATE) {
+                    info->state = model_parse_state(value);
+                } else if (key == KEY_SUBMENU) {
+                    info->submenu = value;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    if (type == KEY_SEPARATOR) {
+        *info = (struct item_info){.type = MENU_SEPARATOR,
+                                   .state = info->state};
+        return;
+    }
+    if (info->title && info->title[0] == '\0') info->title = NULL;
+    if (info->title == NULL) info->shortcut = NULL;
+    if (info->shortcut && info->shortcut[0] == '\0') info->shortcut = NULL;
+
+    if (type == KEY_SUBMENU) {
+        info->type = MENU_SUBMENU;
+        info->cmd = NULL;
+    } else {
+        info->submenu = NULL;
+    }
+}
+
+// count items and string bytes of menu node list
+static void count_items(mpv_node *values, int num, int *items,
+                        size_t *bytes) {
+    for (int i = 0; i < num; i++) {
+        struct item_info info;
+        parse_item(&values[i], &info);
+
+        *items += 1;
+        if (info.title) *bytes += strlen(info.title) + 1;
+        if (info.shortcut) *bytes += strlen(info.shortcut) + 1;
+        if (info.cmd) *bytes += strlen(info.cmd) + 1;
+        if (info.submenu) {
+            mpv_node_list *list = info.submenu->u.list;
+            count_items(list->values, list->num, items, bytes);
+        }
+    }
+}
+
+// allocate model with items and arena size
+//
+// the model is a single allocation, with the arena at the end.
+static menu_model *model_alloc(void *talloc_ctx, int items, size_t bytes) {
+    size_t n = items;
+    size_t size = sizeof(menu_model) + n * sizeof(uint64_t) +
+                  n * sizeof(void *) +
+                  n * (3 * sizeof(int32_t) + 2 * sizeof(uint32_t)) +
+                  n * sizeof(unsigned int) + n * 3 * sizeof(uint8_t) +
+                  n * sizeof(bool) + bytes;
+
+    menu_model *m = talloc_zero_size(talloc_ctx, size);
+    char *p = (char *)(m + 1);
+    m->num_items = items;
+    m->hash = (uint64_t *)p, p += n * sizeof(uint64_t);
+    m->handle = (void **)p, p += n * sizeof(void *);
+    m->parent = (int32_t *)p, p += n * sizeof(int32_t);
+    m->first = (int32_t *)p, p += n * sizeof(int32_t);
+    m->count = (int32_t *)p, p += n * sizeof(int32_t);
+    m->label = (uint32_t *)p, p += n * sizeof(uint32_t);
+    m->cmd = (uint32_t *)p, p += n * sizeof(uint32_t);
+    m->id = (unsigned int *)p, p += n * sizeof(unsigned int);
+    m->type = (uint8_t *)p, p += n * sizeof(uint8_t);
+    m->flags = (uint8_t *)p, p += n * sizeof(uint8_t);
+    m->state = (uint8_t *)p, p += n * sizeof(uint8_t);
+    m->loaded = (bool *)p, p += n * sizeof(bool);
+    m->strings = p;
+    m->num_bytes = 1;  // empty string at offset 0
+    m->max_bytes = bytes;
+
+    m->type[0] = MENU_SUBMENU;
+    m->parent[0] = -1;
+    m->loaded[0] = true;  // root menu is always loaded
+    return m;
+}
+
+// copy string to arena, joined with sep if s2 is set
+static uint32_t push_str(struct builder *b, const char *s, char sep,
+                         const char *s2) {
+    if (s == NULL || s[0] == '\0') return 0;
+
+    uint32_t offset = b->pos;
+    size_t len = strlen(s);
+    memcpy(b->m->strings + b->pos, s, len);
+    b->pos += len;
+    if (s2) {
+        size_t len2 = strlen(s2);
+        b->m->strings[b->pos++] = sep;
+        memcpy(b->m->strings + b->pos, s2, len2);
+        b->pos += len2;
+    }
+    b->m->strings[b->pos++] = '\0';
+    return offset;
+}
+
+// 64-bit FNV-1a
+#define HASH_INIT 0xcbf29ce484222325ULL
+#define HASH_PRIME 0x100000001b3ULL
+
+static uint64_t hash_bytes(uint64_t h, const void *data, size_t len) {
+    const unsigned char *p = data;
+    for (size_t i = 0; i < len; i++) h = (h ^ p[i]) * HASH_PRIME;
+    return h;
+}
+
+// hash item fields and the hashes of its submenu items, the submenu items
+// must be hashed first
+static uint64_t hash_item(menu_model *m, int i) {
+    const char *label = model_str(m, m->label[i]);
+    const char *cmd = model_str(m, m->cmd[i]);
+    uint8_t fields[2] = {m->type[i], m->flags[i]};
+
+    uint64_t h = hash_bytes(HASH_INIT, fields, sizeof(fields));
+    h = hash_bytes(h, label, strlen(label) + 1);
+    h = hash_bytes(h, cmd, strlen(cmd) + 1);
+    for (int j = m->first[i]; j < m->first[i] + m->count[i]; j++)
+        h = hash_bytes(h, &m->hash[j], sizeof(uint64_t));
+    return h;
+}
+
+// set empty flag of submenu that has no visible items
+static void update_empty(menu_model *m, int i) {
+    m->flags[i] &= ~MENU_EMPTY;
+    if (m->type[i] != MENU_SUBMENU) return;
+
+    for (int j = m->first[i]; j < m->first[i] + m->count[i]; j++)
+        if (!(m->flags[j] & MENU_HIDDEN)) return;
+    m->flags[i] |= MENU_EMPTY;
+}
+
+// append item parsed from mpv node to parent
+static void add_node(struct builder *b, int parent, mpv_node *node) {
+    menu_model *m = b->m;
+    struct item_info info;
+    parse_item(node, &info);
+
+    int idx = b->next++;
+    m->type[idx] = info.type;
+    m->parent[idx] = parent;
+    m->label[idx] = push_str(b, info.title, '\t', info.shortcut);
+    m->cmd[idx] = push_str(b, info.cmd, '\0', NULL);
+    m->state[idx] = info.state;
+    m->flags[idx] = item_flags(info.state, info.type,
+                               model_str(m, m->label[idx]),
+                               model_str(m, m->cmd[idx]));
+    m->handle[idx] = info.submenu;
+    if (b->from) b->from[idx] = -1;
+    m->count[parent]++;
+}
+
+// append copy of source model item to parent
+static void add_copy(struct builder *b, int parent, int s) {
+    menu_model *m = b->m, *src = b->src;
+    int idx = b->next++;
+    m->type[idx] = src->type[s];
+    m->flags[idx] = src->flags[s];
+    m->state[idx] = src->state[s];
+    m->parent[idx] = parent;
+    m->label[idx] = push_str(b, model_str(src, src->label[s]), '\0', NULL);
+    m->cmd[idx] = push_str(b, model_str(src, src->cmd[s]), '\0', NULL);
+    b->from[idx] = s;
+    m->count[parent]++;
+}
+
+static void fill_items(struct builder *b, int parent, mpv_node *node);
+static void copy_items(struct builder *b, int parent, int s);
+
+// fill the submenus of parent items, and hash the items
+//
+// the items are added before recursing into submenus, so that they are
+// stored contiguously. handle is used to keep the submenu node in between,
+// and is reset after use.
+static void fill_submenus(struct builder *b, int parent) {
+    menu_model *m = b->m;
+    int first = m->first[parent];
+    for (int i = first; i < first + m->count[parent]; i++) {
+        if (m->type[i] != MENU_SUBMENU) continue;
+
+        if (b->from && b->from[i] >= 0) {
+            copy_items(b, i, b->from[i]);
+        } else {
+            mpv_node *submenu = m->handle[i];
+            m->handle[i] = NULL;
+            fill_items(b, i, submenu);
+        }
+    }
+
+    for (int i = first; i < first + m->count[parent]; i++) {
+        update_empty(m, i);
+        m->hash[i] = hash_item(m, i);
+    }
+}
+
+// fill submenu items of parent from mpv node
+static void fill_items(struct builder *b, int parent, mpv_node *node) {
+    b->m->first[parent] = b->next;
+    b->m->count[parent] = 0;
+    if (node == NULL || node->format != MPV_FORMAT_NODE_ARRAY) return;
+
+    for (int i = 0; i < node->u.list->num; i++)
+        add_node(b, parent, &node->u.list->values[i]);
+    fill_submenus(b, parent);
+}
+
+// fill submenu items of parent from source model item s, the spliced
+// submenu gets the new items in place of the replaced ones
+static void copy_items(struct builder *b, int parent, int s) {
+    const struct splice *sp = b->sp;
+    int first = b->src->first[s], count = b->src->count[s];
+    b->m->first[parent] = b->next;
+    b->m->count[parent] = 0;
+
+    if (s != sp->parent) {
+        for (int i = 0; i < count; i++) add_copy(b, parent, first + i);
+    } else {
+        for (int i = 0; i < sp->pos; i++) add_copy(b, parent, first + i);
+        for (int i = 0; i < sp->num_items; i++)
+            add_node(b, parent, &sp->items[i]);
+        for (int i = sp->pos + sp->remove; i < count; i++)
+            add_copy(b, parent, first + i);
+    }
+    fill_submenus(b, parent);
+}
+
+// build menu model from mpv node
+//
+// the size of the model is counted first, so it can be allocated at once.
+// items are hashed bottom-up while filling, so a subtree hash is available
+// once its submenu is filled.
+menu_model *model_build(void *talloc_ctx, mpv_node *node) {
+    int items = 1;     // root item
+    size_t bytes = 1;  // empty string at offset 0
+    if (node && node->format == MPV_FORMAT_NODE_ARRAY)
+        count_items(node->u.list->values, node->u.list->num, &items, &bytes);
+
+    menu_model *m = model_alloc(talloc_ctx, items, bytes);
+    struct builder b = {.m = m, .next = 1, .pos = 1};
+    fill_items(&b, 0, node);
+    m->num_bytes = b.pos;
+    m->hash[0] = hash_item(m, 0);
+
+    return m;
+}
+
+// copy menu model, with extra arena space for model_set_title()
+//
+// the strings are compacted, so that the labels replaced by
+// model_set_title() and the unused arena space of m are dropped. native
+// state is not copied, it's carried over by menu_diff().
+menu_model *model_copy(void *talloc_ctx, menu_model *m, size_t extra) {
+    size_t n = m->num_items;
+    menu_model *c = model_alloc(talloc_ctx, n, m->num_bytes + extra);
+    struct builder b = {.m = c, .pos = 1};
+    for (int i = 1; i < n; i++) {
+        c->label[i] = push_str(&b, model_str(m, m->label[i]), '\0', NULL);
+        c->cmd[i] = push_str(&b, model_str(m, m->cmd[i]), '\0', NULL);
+    }
+    c->num_bytes = b.pos;
+    memcpy(c->hash, m->hash, n * sizeof(uint64_t));
+    memcpy(c->parent, m->parent, n * sizeof(int32_t));
+    memcpy(c->first, m->first, n * sizeof(int32_t));
+    memcpy(c->count, m->count, n * sizeof(int32_t));
+    memcpy(c->type, m->type, n * sizeof(uint8_t));
+    memcpy(c->flags, m->flags, n * sizeof(uint8_t));
+    memcpy(c->state, m->state, n * sizeof(uint8_t));
+    return c;
+}
+
+// number of items in subtree of item, including itself
+static int subtree_size(menu_model *m, int i) {
+    int n = 1;
+    for (int j = m->first[i]; j < m->first[i] + m->count[i]; j++)
+        n += subtree_size(m, j);
+    return n;
+}
+
+// build a new model from m, with the submenu items of parent in range
+// [pos, pos + remove) replaced by items, return NULL if the range is invalid
+//
+// the unused arena space of m is kept for the model_set_title() calls of
+// the same patch, the strings are compacted like model_copy().
+menu_model *model_splice(void *talloc_ctx, menu_model *m, int parent, int pos,
+                         int remove, mpv_node *items, int num_items) {
+    if (parent < 0 || parent >= m->num_items ||
+        m->type[parent] != MENU_SUBMENU || pos < 0 || remove < 0 ||
+        pos + remove > m->count[parent])
+        return NULL;
+
+    int count = m->num_items;
+    size_t bytes = m->max_bytes;
+    for (int i = 0; i < remove; i++)
+        count -= subtree_size(m, m->first[parent] + pos + i);
+    count_items(items, num_items, &count, &bytes);
+
+    struct splice sp = {parent, pos, remove, items, num_items};
+    menu_model *c = model_alloc(talloc_ctx, count, bytes);
+    struct builder b = {.m = c, .next = 1, .pos = 1, .src = m, .sp = &sp};
+    b.from = talloc_array(NULL, int32_t, count);
+    copy_items(&b, 0, 0);
+    c->num_bytes = b.pos;
+    c->hash[0] = hash_item(c, 0);
+    talloc_free(b.from);
+
+    return c;
+}
+
+// rehash item and its ancestors, after the item is changed
+static void rehash(menu_model *m, int i) {
+    for (; i >= 0; i = m->parent[i]) m->hash[i] = hash_item(m, i);
+}
+
+// recompute flags of item from its state and fields, after the item is
+// changed
+static void update_flags(menu_model *m, int i) {
+    m->flags[i] = item_flags(m->state[i], m->type[i],
+                             model_str(m, m->label[i]),
+                             model_str(m, m->cmd[i])) |
+                  (m->flags[i] & MENU_EMPTY);
+    update_empty(m, m->parent[i]);
+    rehash(m, i);
+}
+
+// set state flags of item, the model must not be applied yet
+void model_set_state(menu_model *m, int i, int state) {
+    m->state[i] = state;
+    update_flags(m, i);
+}
+
+// set title and shortcut of item, the model must not be applied yet
+//
+// return false if the item is a separator, the title is empty, or there's
+// not enough arena space left.
+bool model_set_title(menu_model *m, int i, const char *title,
+                     const char *shortcut) {
+    if (m->type[i] == MENU_SEPARATOR || title == NULL || title[0] == '\0')
+        return false;
+    if (shortcut && shortcut[0] == '\0') shortcut = NULL;
+
+    size_t len = strlen(title) + (shortcut ? strlen(shortcut) + 1 : 0) + 1;
+    if (m->num_bytes + len > m->max_bytes) return false;
+
+    struct builder b = {.m = m, .pos = m->num_bytes};
+    m->label[i] = push_str(&b, title, '\t', shortcut);
+    m->num_bytes = b.pos;
+    update_flags(m, i);  // an item without title is hidden
+    return true;
+}
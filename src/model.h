@@ -0,0 +1,80 @@
+// Copyright (c) 2023-2024 tsl0922. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+#ifndef MPV_PLUGIN_MODEL_H
+#define MPV_PLUGIN_MODEL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <mpv/client.h>
+
+// menu item type
+enum menu_type {
+    MENU_ITEM = 0,
+    MENU_SEPARATOR,
+    MENU_SUBMENU,
+};
+
+// menu item state flags
+enum menu_flag {
+    MENU_CHECKED = 1 << 0,
+    MENU_DISABLED = 1 << 1,
+    MENU_HIDDEN = 1 << 2,  // not shown, or invalid
+    MENU_EMPTY = 1 << 3,   // submenu without visible items
+};
+
+// platform neutral menu model, parsed from mpv node
+//
+// items are stored in struct-of-arrays layout, indexed by item index.
+// item 0 is the root submenu, children of a submenu are stored contiguously
+// from first[i] to first[i] + count[i] - 1. hidden items are kept, so that
+// the item position in a submenu is the same as in the menu node.
+//
+// strings are stored in a single arena, and referenced by offset. offset 0
+// is an empty string, used for unset values. the whole model, including
+// the arena, is a single allocation.
+//
+// hash is a content hash of the item and its whole subtree, items with the
+// same hash are treated as identical by menu_diff().
+//
+// handle, id and loaded are owned by the native backend, they are carried
+// over to the new model by menu_diff().
+typedef struct menu_model {
+    int num_items;     // item count, including root
+    uint64_t *hash;    // subtree content hash
+    uint8_t *type;     // menu item type
+    uint8_t *flags;    // menu item state flags
+    uint8_t *state;    // state flags set by menu data
+    int32_t *parent;   // parent item index, -1 for root
+    int32_t *first;    // first submenu item index
+    int32_t *count;    // submenu item count
+    uint32_t *label;   // "title\tshortcut" offset, 0 for separator
+    uint32_t *cmd;     // mpv command offset, 0 if not set
+    void **handle;     // native submenu handle
+    unsigned int *id;  // native menu item identifier
+    bool *loaded;      // submenu items are created in native menu
+    char *strings;     // string arena
+    size_t num_bytes;  // used arena size
+    size_t max_bytes;  // allocated arena size
+} menu_model;
+
+menu_model *model_build(void *talloc_ctx, mpv_node *node);
+menu_model *model_copy(void *talloc_ctx, menu_model *m, size_t extra);
+menu_model *model_splice(void *talloc_ctx, menu_model *m, int parent, int pos,
+                         int remove, mpv_node *items, int num_items);
+int model_parse_state(mpv_node *node);
+void model_set_state(menu_model *m, int i, int state);
+bool model_set_title(menu_model *m, int i, const char *title,
+                     const char *shortcut);
+
+// get string from arena by offset
+static inline const char *model_str(menu_model *m, uint32_t offset) {
+    return m->strings + offset;
+}
+
+// item is shown in native menu
+static inline bool model_visible(menu_model *m, int i) {
+    return !(m->flags[i] & MENU_HIDDEN);
+}
+
+#endif
@@ -15,22 +15,68 @@
  * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
 #include <assert.h>
 
 #include "osdep/threads.h"
+#include "osdep/timer.h"
 
 #include "dispatch.h"
 
-struct mp_dispatch_queue {
+#ifndef MP_DISPATCH_TRACE
+#define MP_DISPATCH_TRACE 0
+#endif
+
+// Initial number of buckets of the mergeable item index, as a power of 2.
+#define MP_DISPATCH_MERGE_BITS 6
+
+// Maximum number of interactive items run in a row while background items
+// are waiting.
+#define MP_DISPATCH_BURST 8
+
+struct mp_dispatch_list {
+    // Items owned by the queue, in enqueue order. Protected by lock.
     struct mp_dispatch_item *head, *tail;
+    // Items pushed by other threads without taking the lock, newest first.
+    // They're moved to head/tail by queue_drain().
+    _Atomic(struct mp_dispatch_item *) inbox;
+};
+
+struct mp_dispatch_queue {
+    // Queued items of each priority lane.
+    struct mp_dispatch_list lanes[MP_DISPATCH_LANES];
+    // Number of interactive items run in a row, see queue_next().
+    int burst;
+    // Delayed items, a binary min-heap ordered by deadline, then by seq, so
+    // items with the same deadline are run in enqueue order. They're moved
+    // to their lane when they're due by queue_timers(). Protected by lock.
+    struct mp_dispatch_item **timers;
+    int num_timers;
+    uint64_t timer_seq;
+    // Queued mergeable items, hashed by fn and fn_data, chained by
+    // merge_next. The buckets are doubled when there are more items than
+    // buckets, so the chains stay short. Protected by lock.
+    struct mp_dispatch_item **merge_index;
+    int merge_bits;
+    int num_merge;
+    // The target thread is waiting on cond, or about to. Threads pushing to
+    // the inbox take the lock to wake it up only if this is set.
+    atomic_bool idle;
+    // Freed asynchronous items for reuse, see item_alloc() and item_free().
+    _Atomic(struct mp_dispatch_item *) pool;
+    atomic_int pool_size;
+    mp_mutex pool_lock;
     mp_mutex lock;
     mp_cond cond;
     void (*wakeup_fn)(void *wakeup_ctx);
     void *wakeup_ctx;
     void (*onlock_fn)(void *onlock_ctx);
     void *onlock_ctx;
-    // Time at which mp_dispatch_queue_process() should return.
+    // Time at which mp_dispatch_queue_process() should return, an absolute
+    // mp_time_ns() value, so spurious wakeups don't restart the wait.
     int64_t wait;
     // Make mp_dispatch_queue_process() exit if it's idle.
     bool interrupted;
@@ -47,21 +93,57 @@ struct mp_dispatch_queue {
     // locked==true is due to a mp_dispatch_lock() call (for debugging).
     bool locked_explicit;
     mp_thread_id locked_explicit_thread_id;
+    // Number of queued items, including the inboxes, so the queue depth can be
+    // read without the lock.
+    atomic_int pending;
+#if MP_DISPATCH_TRACE
+    void (*trace_fn)(void *trace_ctx, int64_t latency, int depth);
+    void *trace_ctx;
+#endif
 };
 
 struct mp_dispatch_item {
     mp_dispatch_fn fn;
     void *fn_data;
+    enum mp_dispatch_lane lane;
+    int64_t deadline;  // mp_time_ns() value of delayed items
+    uint64_t seq;      // order of delayed items with the same deadline
+#if MP_DISPATCH_TRACE
+    int64_t traced;    // mp_time_ns() when the item was queued, or was due
+#endif
     bool asynchronous;
     bool mergeable;
+    bool autofree;
     bool completed;
     struct mp_dispatch_item *next;
+    struct mp_dispatch_item *merge_next;
+    // Storage of small mp_dispatch_enqueue_copy() data.
+    union {
+        max_align_t align;
+        char data[MP_DISPATCH_INLINE_SIZE];
+    } payload;
 };
 
+// Maximum number of freed items kept for reuse per queue.
+#define MP_DISPATCH_POOL_SIZE 64
+
 static void queue_dtor(void *p)
 {
     struct mp_dispatch_queue *queue = p;
-    assert(!queue->head);
+    for (int n = 0; n < MP_DISPATCH_LANES; n++) {
+        assert(!queue->lanes[n].head);
+        assert(!atomic_load(&queue->lanes[n].inbox));
+    }
+    // Delayed items are not due yet, so they're just dropped.
+    for (int n = 0; n < queue->num_timers; n++)
+        talloc_free(queue->timers[n]);
+    struct mp_dispatch_item *item = atomic_load(&queue->pool);
+    while (item) {
+        struct mp_dispatch_item *next = item->next;
+        talloc_free(item);
+        item = next;
+    }
+    mp_mutex_destroy(&queue->pool_lock);
     assert(!queue->in_process);
     assert(!queue->lock_requests);
     assert(!queue->locked);
@@ -85,6 +167,10 @@ struct mp_dispatch_queue *mp_dispatch_create(void *ta_parent)
     talloc_set_destructor(queue, queue_dtor);
     mp_mutex_init(&queue->lock);
     mp_cond_init(&queue->cond);
+    mp_mutex_init(&queue->pool_lock);
+    queue->merge_bits = MP_DISPATCH_MERGE_BITS;
+    queue->merge_index = talloc_zero_array(queue, struct mp_dispatch_item *,
+                                           1 << queue->merge_bits);
     return queue;
 }
 
@@ -121,34 +207,328 @@ void mp_dispatch_set_onlock_fn(struct mp_dispatch_queue *queue,
     queue->onlock_ctx = onlock_ctx;
 }
 
-static void mp_dispatch_append(struct mp_dispatch_queue *queue,
-                               struct mp_dispatch_item *item)
+// Set a function that is called on the target thread before each item is run,
+// with the time since the item was enqueued (or was due, for delayed items) in
+// nanoseconds, and the number of items still queued. This is meant for
+// profiling, and is only available if built with MP_DISPATCH_TRACE, otherwise
+// it does nothing. Like wakeup_fn, this setter does no internal
+// synchronization.
+void mp_dispatch_set_trace_fn(struct mp_dispatch_queue *queue,
+                              void (*trace_fn)(void *trace_ctx,
+                                               int64_t latency, int depth),
+                              void *trace_ctx)
+{
+#if MP_DISPATCH_TRACE
+    queue->trace_fn = trace_fn;
+    queue->trace_ctx = trace_ctx;
+#else
+    (void)queue;
+    (void)trace_fn;
+    (void)trace_ctx;
+#endif
+}
+
+// Record the time an item is queued, or is due.
+static void trace_stamp(struct mp_dispatch_item *item)
+{
+#if MP_DISPATCH_TRACE
+    item->traced = mp_time_ns();
+#else
+    (void)item;
+#endif
+}
+
+// Count items added to (positive num) or removed from the queue, and return
+// the new number of queued items.
+static int count_queued(struct mp_dispatch_queue *queue, int num)
+{
+    return atomic_fetch_add_explicit(&queue->pending, num,
+                                     memory_order_relaxed) + num;
+}
+
+// Report an item that is about to be run, on the target thread. depth is the
+// number of items still queued.
+static void trace_run(struct mp_dispatch_queue *queue,
+                      struct mp_dispatch_item *item, int depth)
+{
+#if MP_DISPATCH_TRACE
+    if (queue->trace_fn)
+        queue->trace_fn(queue->trace_ctx, mp_time_ns() - item->traced, depth);
+#else
+    (void)queue;
+    (void)item;
+    (void)depth;
+#endif
+}
+
+// Get an asynchronous item from the pool, or allocate one if it's empty.
+// The pool is a stack, which is pushed to by any thread, but popped only
+// with pool_lock held. With a single popper, the top item can't be popped
+// and pushed again while it's read, so there's no ABA problem. If another
+// thread holds the lock, allocating is cheaper than waiting for it.
+static struct mp_dispatch_item *item_alloc(struct mp_dispatch_queue *queue,
+                                           mp_dispatch_fn fn, void *fn_data)
+{
+    struct mp_dispatch_item *item = NULL;
+    if (atomic_load_explicit(&queue->pool, memory_order_relaxed) &&
+        mp_mutex_trylock(&queue->pool_lock) == 0)
+    {
+        item = atomic_load(&queue->pool);
+        while (item && !atomic_compare_exchange_weak(&queue->pool, &item,
+                                                     item->next))
+            ;
+        mp_mutex_unlock(&queue->pool_lock);
+    }
+    if (item) {
+        atomic_fetch_sub_explicit(&queue->pool_size, 1, memory_order_relaxed);
+    } else {
+        item = talloc_ptrtype(NULL, item);
+    }
+
+    item->fn = fn;
+    item->fn_data = fn_data;
+    item->lane = MP_DISPATCH_BACKGROUND;
+    item->asynchronous = true;
+    item->mergeable = false;
+    item->autofree = false;
+    item->completed = false;
+    item->next = NULL;
+    item->merge_next = NULL;
+    trace_stamp(item);
+    return item;
+}
+
+// Free an asynchronous item, or return it to the pool. The pool size is
+// only approximately limited, it's updated separately from the pool.
+static void item_free(struct mp_dispatch_queue *queue,
+                      struct mp_dispatch_item *item)
+{
+    if (item->autofree)
+        talloc_free(item->fn_data);
+    if (atomic_load_explicit(&queue->pool_size, memory_order_relaxed) >=
+        MP_DISPATCH_POOL_SIZE)
+    {
+        talloc_free(item);
+        return;
+    }
+
+    atomic_fetch_add_explicit(&queue->pool_size, 1, memory_order_relaxed);
+    struct mp_dispatch_item *head =
+        atomic_load_explicit(&queue->pool, memory_order_relaxed);
+    do {
+        item->next = head;
+    } while (!atomic_compare_exchange_weak(&queue->pool, &head, item));
+}
+
+// Return the merge_index bucket of fn and fn_data.
+static struct mp_dispatch_item **merge_bucket(struct mp_dispatch_queue *queue,
+                                              mp_dispatch_fn fn, void *fn_data)
+{
+    const uint64_t k = UINT64_C(0x9E3779B97F4A7C15);
+    uint64_t h = ((uint64_t)(uintptr_t)fn ^ (uint64_t)(uintptr_t)fn_data * k) * k;
+    return &queue->merge_index[h >> (64 - queue->merge_bits)];
+}
+
+// Add a mergeable item to merge_index, after doubling the buckets if they're
+// all used up.
+static void merge_insert(struct mp_dispatch_queue *queue,
+                         struct mp_dispatch_item *item)
+{
+    if (queue->num_merge >= (1 << queue->merge_bits)) {
+        struct mp_dispatch_item **old = queue->merge_index;
+        int size = 1 << queue->merge_bits;
+        queue->merge_bits++;
+        queue->merge_index = talloc_zero_array(queue, struct mp_dispatch_item *,
+                                               size * 2);
+        for (int n = 0; n < size; n++) {
+            while (old[n]) {
+                struct mp_dispatch_item *cur = old[n];
+                old[n] = cur->merge_next;
+                struct mp_dispatch_item **bucket =
+                    merge_bucket(queue, cur->fn, cur->fn_data);
+                cur->merge_next = *bucket;
+                *bucket = cur;
+            }
+        }
+        talloc_free(old);
+    }
+
+    struct mp_dispatch_item **bucket =
+        merge_bucket(queue, item->fn, item->fn_data);
+    item->merge_next = *bucket;
+    *bucket = item;
+    queue->num_merge++;
+}
+
+// Remove a mergeable item from merge_index, when it's removed from the queue.
+static void merge_remove(struct mp_dispatch_queue *queue,
+                         struct mp_dispatch_item *item)
+{
+    struct mp_dispatch_item **pcur = merge_bucket(queue, item->fn, item->fn_data);
+    while (*pcur != item)
+        pcur = &(*pcur)->merge_next;
+    *pcur = item->merge_next;
+    queue->num_merge--;
+}
+
+// Append a list of items to the end of a lane, first to last are linked.
+static void list_append(struct mp_dispatch_list *list,
+                        struct mp_dispatch_item *first,
+                        struct mp_dispatch_item *last)
+{
+    if (list->tail) {
+        list->tail->next = first;
+    } else {
+        list->head = first;
+    }
+    list->tail = last;
+}
+
+// Move the items pushed to the inboxes to the end of their lanes, the inbox
+// is a stack, so it's reversed to restore the enqueue order. Must be called
+// with the lock held, before the lanes are used, so a lane is always older
+// than its inbox.
+static void queue_drain(struct mp_dispatch_queue *queue)
+{
+    for (int n = 0; n < MP_DISPATCH_LANES; n++) {
+        struct mp_dispatch_list *list = &queue->lanes[n];
+        if (!atomic_load_explicit(&list->inbox, memory_order_relaxed))
+            continue;
+        struct mp_dispatch_item *item = atomic_exchange(&list->inbox, NULL);
+        struct mp_dispatch_item *first = NULL, *last = item;
+        while (item) {
+            struct mp_dispatch_item *next = item->next;
+            item->next = first;
+            first = item;
+            item = next;
+        }
+        list_append(list, first, last);
+
+        // No wakeup callback -> assume mp_dispatch_queue_process() needs to be
+        // interrupted instead.
+        if (!queue->wakeup_fn)
+            queue->interrupted = true;
+    }
+}
+
+// Return true if any inbox has items.
+static bool queue_inbox_pending(struct mp_dispatch_queue *queue)
+{
+    for (int n = 0; n < MP_DISPATCH_LANES; n++) {
+        if (atomic_load(&queue->lanes[n].inbox))
+            return true;
+    }
+    return false;
+}
+
+static bool timer_before(struct mp_dispatch_item *a, struct mp_dispatch_item *b)
+{
+    return a->deadline < b->deadline ||
+           (a->deadline == b->deadline && a->seq < b->seq);
+}
+
+static void timer_swap(struct mp_dispatch_queue *queue, int a, int b)
+{
+    struct mp_dispatch_item *tmp = queue->timers[a];
+    queue->timers[a] = queue->timers[b];
+    queue->timers[b] = tmp;
+}
+
+static void timer_sift_up(struct mp_dispatch_queue *queue, int n)
+{
+    while (n > 0) {
+        int parent = (n - 1) / 2;
+        if (!timer_before(queue->timers[n], queue->timers[parent]))
+            break;
+        timer_swap(queue, n, parent);
+        n = parent;
+    }
+}
+
+static void timer_sift_down(struct mp_dispatch_queue *queue, int n)
+{
+    while (1) {
+        int min = n;
+        for (int c = 2 * n + 1; c <= 2 * n + 2 && c < queue->num_timers; c++) {
+            if (timer_before(queue->timers[c], queue->timers[min]))
+                min = c;
+        }
+        if (min == n)
+            break;
+        timer_swap(queue, n, min);
+        n = min;
+    }
+}
+
+// Move the delayed items which are due to the end of their lane. Must be
+// called with the lock held.
+static void queue_timers(struct mp_dispatch_queue *queue)
+{
+    if (!queue->num_timers)
+        return;
+    int64_t now = mp_time_ns();
+    while (queue->num_timers && queue->timers[0]->deadline <= now) {
+        struct mp_dispatch_item *item = queue->timers[0];
+        queue->timers[0] = queue->timers[--queue->num_timers];
+        timer_sift_down(queue, 0);
+
+        item->next = NULL;
+        trace_stamp(item);
+        count_queued(queue, 1);
+        list_append(&queue->lanes[item->lane], item, item);
+        // Due items are treated like newly enqueued items.
+        if (!queue->wakeup_fn)
+            queue->interrupted = true;
+    }
+}
+
+// Pick the lane of the next item to run, or NULL if the queue is empty.
+// Interactive items are run first, but after MP_DISPATCH_BURST of them in a
+// row while a background item is waiting, the background item is run, so
+// background items still make progress under interactive load. Only the
+// interactive items run while the background lane is non-empty are counted.
+static struct mp_dispatch_list *queue_next(struct mp_dispatch_queue *queue)
+{
+    struct mp_dispatch_list *fg = &queue->lanes[MP_DISPATCH_INTERACTIVE];
+    struct mp_dispatch_list *bg = &queue->lanes[MP_DISPATCH_BACKGROUND];
+    if (!bg->head) {
+        queue->burst = 0;
+        return fg->head ? fg : NULL;
+    }
+    if (fg->head && queue->burst < MP_DISPATCH_BURST) {
+        queue->burst++;
+        return fg;
+    }
+    queue->burst = 0;
+    return bg;
+}
+
+// Append an item under the lock. This is the slow path, used for items which
+// need to look at the queued items.
+static void mp_dispatch_append_locked(struct mp_dispatch_queue *queue,
+                                      struct mp_dispatch_item *item)
 {
     mp_mutex_lock(&queue->lock);
+    queue_drain(queue);
     if (item->mergeable) {
-        for (struct mp_dispatch_item *cur = queue->head; cur; cur = cur->next) {
-            if (cur->mergeable && cur->fn == item->fn &&
-                cur->fn_data == item->fn_data)
-            {
-                talloc_free(item);
+        struct mp_dispatch_item *cur =
+            *merge_bucket(queue, item->fn, item->fn_data);
+        for (; cur; cur = cur->merge_next) {
+            if (cur->fn == item->fn && cur->fn_data == item->fn_data) {
+                item_free(queue, item);
                 mp_mutex_unlock(&queue->lock);
                 return;
             }
         }
+        merge_insert(queue, item);
     }
 
-    if (queue->tail) {
-        queue->tail->next = item;
-    } else {
-        queue->head = item;
-    }
-    queue->tail = item;
+    count_queued(queue, 1);
+    list_append(&queue->lanes[item->lane], item, item);
 
     // Wake up the main thread; note that other threads might wait on this
     // condition for reasons, so broadcast the condition.
     mp_cond_broadcast(&queue->cond);
-    // No wakeup callback -> assume mp_dispatch_queue_process() needs to be
-    // interrupted instead.
     if (!queue->wakeup_fn)
         queue->interrupted = true;
     mp_mutex_unlock(&queue->lock);
@@ -157,6 +537,45 @@ static void mp_dispatch_append(struct mp_dispatch_queue *queue,
         queue->wakeup_fn(queue->wakeup_ctx);
 }
 
+// Push items to the inbox of a lane without taking the lock, and wake up the
+// target thread. The items are linked newest first, from first to last, like
+// the inbox. The lock is only taken to wake up the target thread if it's
+// idle. It sets idle before it checks the inbox, so either it sees the items,
+// or this sees idle and waits for it to release the lock in mp_cond_wait(),
+// so the wakeup is never lost.
+static void mp_dispatch_push(struct mp_dispatch_queue *queue,
+                             enum mp_dispatch_lane lane,
+                             struct mp_dispatch_item *first,
+                             struct mp_dispatch_item *last, int num)
+{
+    count_queued(queue, num);
+    _Atomic(struct mp_dispatch_item *) *inbox = &queue->lanes[lane].inbox;
+    struct mp_dispatch_item *head =
+        atomic_load_explicit(inbox, memory_order_relaxed);
+    do {
+        last->next = head;
+    } while (!atomic_compare_exchange_weak(inbox, &head, first));
+
+    if (atomic_load(&queue->idle)) {
+        mp_mutex_lock(&queue->lock);
+        mp_cond_broadcast(&queue->cond);
+        mp_mutex_unlock(&queue->lock);
+    }
+
+    if (queue->wakeup_fn)
+        queue->wakeup_fn(queue->wakeup_ctx);
+}
+
+static void mp_dispatch_append(struct mp_dispatch_queue *queue,
+                               struct mp_dispatch_item *item)
+{
+    if (item->mergeable) {
+        mp_dispatch_append_locked(queue, item);
+    } else {
+        mp_dispatch_push(queue, item->lane, item, item, 1);
+    }
+}
+
 // Enqueue a callback to run it on the target thread asynchronously. The target
 // thread will run fn(fn_data) as soon as it enter mp_dispatch_queue_process.
 // Note that mp_dispatch_enqueue() will usually return long before that happens.
@@ -166,12 +585,7 @@ static void mp_dispatch_append(struct mp_dispatch_queue *queue,
 void mp_dispatch_enqueue(struct mp_dispatch_queue *queue,
                          mp_dispatch_fn fn, void *fn_data)
 {
-    struct mp_dispatch_item *item = talloc_ptrtype(NULL, item);
-    *item = (struct mp_dispatch_item){
-        .fn = fn,
-        .fn_data = fn_data,
-        .asynchronous = true,
-    };
+    struct mp_dispatch_item *item = item_alloc(queue, fn, fn_data);
     mp_dispatch_append(queue, item);
 }
 
@@ -182,26 +596,104 @@ void mp_dispatch_enqueue(struct mp_dispatch_queue *queue,
 void mp_dispatch_enqueue_autofree(struct mp_dispatch_queue *queue,
                                   mp_dispatch_fn fn, void *fn_data)
 {
-    struct mp_dispatch_item *item = talloc_ptrtype(NULL, item);
-    *item = (struct mp_dispatch_item){
-        .fn = fn,
-        .fn_data = talloc_steal(item, fn_data),
-        .asynchronous = true,
-    };
+    struct mp_dispatch_item *item = item_alloc(queue, fn, fn_data);
+    item->autofree = true;
     mp_dispatch_append(queue, item);
 }
 
+// Like mp_dispatch_enqueue(), but fn_data is a copy of the size bytes at data,
+// which is valid until the fn callback returns. Copies of up to
+// MP_DISPATCH_INLINE_SIZE bytes are stored in the dispatch item, so together
+// with the item pool, no memory is allocated for them in steady state.
+// The item is queued in the given lane, the other functions queue their items
+// in the background lane.
+void mp_dispatch_enqueue_copy(struct mp_dispatch_queue *queue,
+                              enum mp_dispatch_lane lane, mp_dispatch_fn fn,
+                              const void *data, size_t size)
+{
+    struct mp_dispatch_item *item = item_alloc(queue, fn, NULL);
+    item->lane = lane;
+    if (size <= sizeof(item->payload.data)) {
+        item->fn_data = item->payload.data;
+    } else {
+        item->fn_data = talloc_size(NULL, size);
+        item->autofree = true;
+    }
+    memcpy(item->fn_data, data, size);
+    mp_dispatch_append(queue, item);
+}
+
+// Like calling mp_dispatch_enqueue() for each of the calls, in array order,
+// but the items are queued in the given lane with a single push, and the
+// target thread is woken up once. The callbacks run in array order, and no
+// other item is run between them, unless it's from the other lane.
+void mp_dispatch_enqueue_batch(struct mp_dispatch_queue *queue,
+                               enum mp_dispatch_lane lane,
+                               const struct mp_dispatch_call *calls,
+                               int num_calls)
+{
+    if (num_calls <= 0)
+        return;
+    struct mp_dispatch_item *first = NULL, *last = NULL;
+    for (int n = 0; n < num_calls; n++) {
+        struct mp_dispatch_item *item =
+            item_alloc(queue, calls[n].fn, calls[n].fn_data);
+        item->lane = lane;
+        item->next = first;
+        first = item;
+        if (!last)
+            last = item;
+    }
+    mp_dispatch_push(queue, lane, first, last, num_calls);
+}
+
+// Like mp_dispatch_enqueue(), but fn(fn_data) is run once the deadline, a
+// mp_time_ns() value, has passed. Items with the same deadline are run in
+// enqueue order. The delayed item can be canceled with mp_dispatch_cancel_fn()
+// until it's run. Delayed items which are still pending when the queue is
+// destroyed are dropped.
+// The deadline also limits the time mp_dispatch_queue_process() waits, as if
+// mp_dispatch_adjust_timeout() was called with it. Event loops which wait in
+// external APIs instead can get it with mp_dispatch_next_deadline(), the
+// wakeup_fn is called when it becomes earlier.
+void mp_dispatch_enqueue_at(struct mp_dispatch_queue *queue, int64_t deadline,
+                            mp_dispatch_fn fn, void *fn_data)
+{
+    struct mp_dispatch_item *item = item_alloc(queue, fn, fn_data);
+    // 0 means "no deadline" for mp_dispatch_next_deadline(), and it's passed
+    // anyway, mp_time_ns() is never 0.
+    item->deadline = deadline > 0 ? deadline : 1;
+
+    mp_mutex_lock(&queue->lock);
+    item->seq = queue->timer_seq++;
+    MP_TARRAY_APPEND(queue, queue->timers, queue->num_timers, item);
+    timer_sift_up(queue, queue->num_timers - 1);
+    // The target thread waits until the earliest deadline, so wake it up if
+    // that is this item now.
+    bool earliest = queue->timers[0] == item;
+    if (earliest)
+        mp_cond_broadcast(&queue->cond);
+    mp_mutex_unlock(&queue->lock);
+
+    if (earliest && queue->wakeup_fn)
+        queue->wakeup_fn(queue->wakeup_ctx);
+}
+
+// Like mp_dispatch_enqueue_at(), but fn(fn_data) is run after the given delay
+// in seconds.
+void mp_dispatch_enqueue_after(struct mp_dispatch_queue *queue, double delay,
+                               mp_dispatch_fn fn, void *fn_data)
+{
+    mp_dispatch_enqueue_at(queue, mp_time_ns_add(mp_time_ns(), delay),
+                           fn, fn_data);
+}
+
 // Like mp_dispatch_enqueue(), but
 void mp_dispatch_enqueue_notify(struct mp_dispatch_queue *queue,
                                 mp_dispatch_fn fn, void *fn_data)
 {
-    struct mp_dispatch_item *item = talloc_ptrtype(NULL, item);
-    *item = (struct mp_dispatch_item){
-        .fn = fn,
-        .fn_data = fn_data,
-        .mergeable = true,
-        .asynchronous = true,
-    };
+    struct mp_dispatch_item *item = item_alloc(queue, fn, fn_data);
+    item->mergeable = true;
     mp_dispatch_append(queue, item);
 }
 
@@ -209,6 +701,7 @@ void mp_dispatch_enqueue_notify(struct mp_dispatch_queue *queue,
 // can be canceled:
 //  - mp_dispatch_enqueue()
 //  - mp_dispatch_enqueue_notify()
+//  - mp_dispatch_enqueue_at() and mp_dispatch_enqueue_after()
 // Items which were enqueued, and which are currently executing, can not be
 // canceled anymore. This function is mostly for being called from the same
 // context as mp_dispatch_queue_process(), where the "currently executing" case
@@ -217,18 +710,40 @@ void mp_dispatch_cancel_fn(struct mp_dispatch_queue *queue,
                            mp_dispatch_fn fn, void *fn_data)
 {
     mp_mutex_lock(&queue->lock);
-    struct mp_dispatch_item **pcur = &queue->head;
-    queue->tail = NULL;
-    while (*pcur) {
-        struct mp_dispatch_item *cur = *pcur;
+    queue_drain(queue);
+    for (int n = 0; n < MP_DISPATCH_LANES; n++) {
+        struct mp_dispatch_list *list = &queue->lanes[n];
+        struct mp_dispatch_item **pcur = &list->head;
+        list->tail = NULL;
+        while (*pcur) {
+            struct mp_dispatch_item *cur = *pcur;
+            if (cur->fn == fn && cur->fn_data == fn_data) {
+                *pcur = cur->next;
+                if (cur->mergeable)
+                    merge_remove(queue, cur);
+                count_queued(queue, -1);
+                item_free(queue, cur);
+            } else {
+                list->tail = cur;
+                pcur = &cur->next;
+            }
+        }
+    }
+    // Filter the delayed items, and restore the heap order.
+    int num = 0;
+    for (int n = 0; n < queue->num_timers; n++) {
+        struct mp_dispatch_item *cur = queue->timers[n];
         if (cur->fn == fn && cur->fn_data == fn_data) {
-            *pcur = cur->next;
-            talloc_free(cur);
+            item_free(queue, cur);
         } else {
-            queue->tail = cur;
-            pcur = &cur->next;
+            queue->timers[num++] = cur;
         }
     }
+    if (num < queue->num_timers) {
+        queue->num_timers = num;
+        for (int n = num / 2 - 1; n >= 0; n--)
+            timer_sift_down(queue, n);
+    }
     mp_mutex_unlock(&queue->lock);
 }
 
@@ -239,10 +754,13 @@ void mp_dispatch_cancel_fn(struct mp_dispatch_queue *queue,
 void mp_dispatch_run(struct mp_dispatch_queue *queue,
                      mp_dispatch_fn fn, void *fn_data)
 {
+    // The caller is blocked until it's done, so it's interactive.
     struct mp_dispatch_item item = {
         .fn = fn,
         .fn_data = fn_data,
+        .lane = MP_DISPATCH_INTERACTIVE,
     };
+    trace_stamp(&item);
     mp_dispatch_append(queue, &item);
 
     mp_mutex_lock(&queue->lock);
@@ -270,12 +788,7 @@ void mp_dispatch_run(struct mp_dispatch_queue *queue,
 void mp_dispatch_queue_process(struct mp_dispatch_queue *queue, double timeout)
 {
     mp_mutex_lock(&queue->lock);
-    if (timeout > 0) {
-        double t = MPCLAMP(timeout * 1e9, -0x1p63, 0x1p63);
-        queue->wait = t == 0x1p63 ? INT64_MAX : (int64_t)t;
-    } else {
-        queue->wait = 0;
-    }
+    queue->wait = timeout > 0 ? mp_time_ns_add(mp_time_ns(), timeout) : 0;
     assert(!queue->in_process); // recursion not allowed
     queue->in_process = true;
     queue->in_process_thread_id = mp_thread_current_id();
@@ -283,15 +796,20 @@ void mp_dispatch_queue_process(struct mp_dispatch_queue *queue, double timeout)
     if (queue->lock_requests)
         mp_cond_broadcast(&queue->cond);
     while (1) {
+        queue_drain(queue);
+        queue_timers(queue);
+        struct mp_dispatch_list *list;
         if (queue->lock_requests) {
             // Block due to something having called mp_dispatch_lock().
             mp_cond_wait(&queue->cond, &queue->lock);
-        } else if (queue->head) {
-            struct mp_dispatch_item *item = queue->head;
-            queue->head = item->next;
-            if (!queue->head)
-                queue->tail = NULL;
+        } else if ((list = queue_next(queue))) {
+            struct mp_dispatch_item *item = list->head;
+            list->head = item->next;
+            if (!list->head)
+                list->tail = NULL;
             item->next = NULL;
+            if (item->mergeable)
+                merge_remove(queue, item);
             // Unlock, because we want to allow other threads to queue items
             // while the dispatch item is processed.
             // At the same time, we must prevent other threads from returning
@@ -300,6 +818,7 @@ void mp_dispatch_queue_process(struct mp_dispatch_queue *queue, double timeout)
             queue->locked = true;
             mp_mutex_unlock(&queue->lock);
 
+            trace_run(queue, item, count_queued(queue, -1));
             item->fn(item->fn_data);
 
             mp_mutex_lock(&queue->lock);
@@ -308,13 +827,24 @@ void mp_dispatch_queue_process(struct mp_dispatch_queue *queue, double timeout)
             // Wakeup mp_dispatch_run(), also mp_dispatch_lock().
             mp_cond_broadcast(&queue->cond);
             if (item->asynchronous) {
-                talloc_free(item);
+                item_free(queue, item);
             } else {
                 item->completed = true;
             }
         } else if (queue->wait > 0 && !queue->interrupted) {
-            if (mp_cond_timedwait_until(&queue->cond, &queue->lock, queue->wait))
+            // Wake up for the earliest delayed item, but only stop waiting
+            // if the timeout itself has passed.
+            int64_t until = queue->wait;
+            if (queue->num_timers && queue->timers[0]->deadline < until)
+                until = queue->timers[0]->deadline;
+            // Check the inbox again after setting idle, see
+            // mp_dispatch_push().
+            atomic_store(&queue->idle, true);
+            if (!queue_inbox_pending(queue) &&
+                mp_cond_timedwait_until(&queue->cond, &queue->lock, until) &&
+                until == queue->wait)
                 queue->wait = 0;
+            atomic_store(&queue->idle, false);
         } else {
             break;
         }
@@ -325,6 +855,25 @@ void mp_dispatch_queue_process(struct mp_dispatch_queue *queue, double timeout)
     mp_mutex_unlock(&queue->lock);
 }
 
+// Return the number of queued items. Delayed items are only counted once
+// mp_dispatch_queue_process() found them due. The count is kept in an atomic
+// counter, so this doesn't take the lock, and is cheap enough to be called on
+// every wakeup. The result may be outdated as soon as it's returned.
+int mp_dispatch_queue_depth(struct mp_dispatch_queue *queue)
+{
+    return atomic_load_explicit(&queue->pending, memory_order_relaxed);
+}
+
+// Return the deadline of the earliest delayed item as mp_time_ns() value, or 0
+// if there is none. See mp_dispatch_enqueue_at().
+int64_t mp_dispatch_next_deadline(struct mp_dispatch_queue *queue)
+{
+    mp_mutex_lock(&queue->lock);
+    int64_t deadline = queue->num_timers ? queue->timers[0]->deadline : 0;
+    mp_mutex_unlock(&queue->lock);
+    return deadline;
+}
+
 // If the queue is inside of mp_dispatch_queue_process(), make it return as
 // soon as all work items have been run, without waiting for the timeout. This
 // does not make it return early if it's blocked by a mp_dispatch_lock().
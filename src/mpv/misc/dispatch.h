@@ -1,9 +1,28 @@
 #ifndef MP_DISPATCH_H_
 #define MP_DISPATCH_H_
 
+#include <stddef.h>
 #include <stdint.h>
 
+// Size of mp_dispatch_enqueue_copy() data stored in the dispatch item.
+#define MP_DISPATCH_INLINE_SIZE 96
+
 typedef void (*mp_dispatch_fn)(void *data);
+
+// Priority lanes of dispatch items. Interactive items are run before
+// background items, but can't starve them.
+enum mp_dispatch_lane {
+    MP_DISPATCH_INTERACTIVE,
+    MP_DISPATCH_BACKGROUND,
+    MP_DISPATCH_LANES,  // number of lanes
+};
+
+// A callback of mp_dispatch_enqueue_batch().
+struct mp_dispatch_call {
+    mp_dispatch_fn fn;
+    void *fn_data;
+};
+
 struct mp_dispatch_queue;
 typedef struct mp_dispatch_queue mp_dispatch_queue;
 
@@ -14,10 +33,25 @@ void mp_dispatch_set_wakeup_fn(struct mp_dispatch_queue *queue,
 void mp_dispatch_set_onlock_fn(struct mp_dispatch_queue *queue,
                                void (*onlock_fn)(void *onlock_ctx),
                                void *onlock_ctx);
+void mp_dispatch_set_trace_fn(struct mp_dispatch_queue *queue,
+                              void (*trace_fn)(void *trace_ctx,
+                                               int64_t latency, int depth),
+                              void *trace_ctx);
 void mp_dispatch_enqueue(struct mp_dispatch_queue *queue,
                          mp_dispatch_fn fn, void *fn_data);
 void mp_dispatch_enqueue_autofree(struct mp_dispatch_queue *queue,
                                   mp_dispatch_fn fn, void *fn_data);
+void mp_dispatch_enqueue_copy(struct mp_dispatch_queue *queue,
+                              enum mp_dispatch_lane lane, mp_dispatch_fn fn,
+                              const void *data, size_t size);
+void mp_dispatch_enqueue_batch(struct mp_dispatch_queue *queue,
+                               enum mp_dispatch_lane lane,
+                               const struct mp_dispatch_call *calls,
+                               int num_calls);
+void mp_dispatch_enqueue_at(struct mp_dispatch_queue *queue, int64_t deadline,
+                            mp_dispatch_fn fn, void *fn_data);
+void mp_dispatch_enqueue_after(struct mp_dispatch_queue *queue, double delay,
+                               mp_dispatch_fn fn, void *fn_data);
 void mp_dispatch_enqueue_notify(struct mp_dispatch_queue *queue,
                                 mp_dispatch_fn fn, void *fn_data);
 void mp_dispatch_cancel_fn(struct mp_dispatch_queue *queue,
@@ -26,6 +60,8 @@ void mp_dispatch_run(struct mp_dispatch_queue *queue,
                      mp_dispatch_fn fn, void *fn_data);
 void mp_dispatch_queue_process(struct mp_dispatch_queue *queue, double timeout);
 void mp_dispatch_interrupt(struct mp_dispatch_queue *queue);
+int mp_dispatch_queue_depth(struct mp_dispatch_queue *queue);
+int64_t mp_dispatch_next_deadline(struct mp_dispatch_queue *queue);
 void mp_dispatch_adjust_timeout(struct mp_dispatch_queue *queue, int64_t until);
 void mp_dispatch_lock(struct mp_dispatch_queue *queue);
 void mp_dispatch_unlock(struct mp_dispatch_queue *queue);
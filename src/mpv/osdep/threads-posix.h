@@ -0,0 +1,168 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mpv_talloc.h"
+#include "timer.h"
+
+typedef pthread_cond_t  mp_cond;
+typedef pthread_mutex_t mp_mutex;
+typedef pthread_mutex_t mp_static_mutex;
+typedef pthread_once_t  mp_once;
+typedef pthread_t       mp_thread_id;
+typedef pthread_t       mp_thread;
+
+#define MP_STATIC_COND_INITIALIZER PTHREAD_COND_INITIALIZER
+#define MP_STATIC_MUTEX_INITIALIZER PTHREAD_MUTEX_INITIALIZER
+#define MP_STATIC_ONCE_INITIALIZER PTHREAD_ONCE_INIT
+
+static inline int mp_mutex_init_type_internal(mp_mutex *mutex, enum mp_mutex_type mtype)
+{
+    int mutex_type;
+    switch (mtype) {
+    case MP_MUTEX_RECURSIVE:
+        mutex_type = PTHREAD_MUTEX_RECURSIVE;
+        break;
+    case MP_MUTEX_NORMAL:
+    default:
+#ifndef NDEBUG
+        mutex_type = PTHREAD_MUTEX_ERRORCHECK;
+#else
+        mutex_type = PTHREAD_MUTEX_DEFAULT;
+#endif
+        break;
+    }
+
+    pthread_mutexattr_t attr;
+    int ret = pthread_mutexattr_init(&attr);
+    if (ret != 0)
+        return ret;
+
+    pthread_mutexattr_settype(&attr, mutex_type);
+    ret = pthread_mutex_init(mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+    assert(!ret);
+    return ret;
+}
+
+#define mp_mutex_destroy pthread_mutex_destroy
+#define mp_mutex_lock    pthread_mutex_lock
+#define mp_mutex_trylock pthread_mutex_trylock
+#define mp_mutex_unlock  pthread_mutex_unlock
+
+// Condition variables wait on the monotonic clock of mp_time_ns(), so timed
+// waits are not affected by changes of the wall clock. macOS has no
+// pthread_condattr_setclock(), the relative wait is used there instead.
+static inline int mp_cond_init(mp_cond *cond)
+{
+    assert(cond);
+
+    pthread_condattr_t attr;
+    int ret = pthread_condattr_init(&attr);
+    if (ret)
+        return ret;
+
+#ifndef __APPLE__
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+#endif
+    ret = pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+    return ret;
+}
+
+#define mp_cond_destroy   pthread_cond_destroy
+#define mp_cond_broadcast pthread_cond_broadcast
+#define mp_cond_signal    pthread_cond_signal
+#define mp_cond_wait      pthread_cond_wait
+
+// until is an absolute mp_time_ns() value
+static inline int mp_cond_timedwait_until(mp_cond *cond, mp_mutex *mutex, int64_t until)
+{
+    if (until == INT64_MAX)
+        return pthread_cond_wait(cond, mutex);
+
+#ifdef __APPLE__
+    int64_t timeout = MPCLAMP(until - mp_time_ns(), 0, INT64_MAX);
+    struct timespec ts = {
+        .tv_sec = timeout / MP_TIME_S_TO_NS(1),
+        .tv_nsec = timeout % MP_TIME_S_TO_NS(1),
+    };
+    return pthread_cond_timedwait_relative_np(cond, mutex, &ts);
+#else
+    // mp_time_ns() is the monotonic clock, offset by 1
+    until -= 1;
+    struct timespec ts = {
+        .tv_sec = until / MP_TIME_S_TO_NS(1),
+        .tv_nsec = until % MP_TIME_S_TO_NS(1),
+    };
+    return pthread_cond_timedwait(cond, mutex, &ts);
+#endif
+}
+
+static inline int mp_cond_timedwait(mp_cond *cond, mp_mutex *mutex, int64_t timeout)
+{
+    return mp_cond_timedwait_until(cond, mutex,
+                                   mp_time_ns_add(mp_time_ns(), MP_TIME_NS_TO_S(timeout)));
+}
+
+#define mp_exec_once pthread_once
+
+#define MP_THREAD_VOID void *
+#define MP_THREAD_RETURN() return NULL
+
+#define mp_thread_create(t, f, a) pthread_create(t, NULL, f, a)
+#define mp_thread_join(t)         pthread_join(t, NULL)
+#define mp_thread_join_id(t)      pthread_join(t, NULL)
+#define mp_thread_detach          pthread_detach
+#define mp_thread_current_id      pthread_self
+#define mp_thread_id_equal(a, b)  pthread_equal(a, b)
+#define mp_thread_get_id(thread)  (thread)
+
+static inline void mp_thread_set_name(const char *name)
+{
+#if defined(__GLIBC__)
+    if (pthread_setname_np(pthread_self(), name) == ERANGE) {
+        char tname[16] = {0}; // kernel limit, including the terminator
+        strncpy(tname, name, sizeof(tname) - 1);
+        pthread_setname_np(pthread_self(), tname);
+    }
+#elif defined(__APPLE__)
+    pthread_setname_np(name);
+#else
+    (void) name;
+#endif
+}
+
+static inline int64_t mp_thread_cpu_time_ns(mp_thread_id thread)
+{
+#if defined(_POSIX_THREAD_CPUTIME) && _POSIX_THREAD_CPUTIME > 0
+    clockid_t id;
+    struct timespec ts;
+    if (pthread_getcpuclockid(thread, &id) == 0 && clock_gettime(id, &ts) == 0)
+        return MP_TIME_S_TO_NS(ts.tv_sec) + ts.tv_nsec;
+#endif
+    (void) thread;
+    return 0;
+}
@@ -23,9 +23,7 @@
 #include <windows.h>
 
 #include "mpv_talloc.h"
-
-#define MPCLAMP(a, min, max) (((a) < (min)) ? (min) : (((a) > (max)) ? (max) : (a)))
-#define MP_TIME_MS_TO_NS(ms) ((ms) * INT64_C(1000000))
+#include "timer.h"
 
 typedef struct {
     char use_cs;
@@ -136,9 +134,12 @@ static inline int mp_cond_wait(mp_cond *cond, mp_mutex *mutex)
     return mp_cond_timedwait(cond, mutex, MP_TIME_MS_TO_NS(INFINITE));
 }
 
+// until is an absolute mp_time_ns() value
 static inline int mp_cond_timedwait_until(mp_cond *cond, mp_mutex *mutex, int64_t until)
 {
-    return mp_cond_timedwait(cond, mutex, until);
+    if (until == INT64_MAX)
+        return mp_cond_wait(cond, mutex);
+    return mp_cond_timedwait(cond, mutex, until - mp_time_ns());
 }
 
 static inline int mp_exec_once(mp_once *once, void (*init_routine)(void))
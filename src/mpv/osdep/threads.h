@@ -12,6 +12,12 @@ enum mp_mutex_type {
 #define mp_mutex_init_type(mutex, mtype) \
     mp_mutex_init_type_internal(mutex, mtype)
 
+#if HAVE_WIN32_THREADS
 #include "threads-win32.h"
+#elif HAVE_POSIX_THREADS
+#include "threads-posix.h"
+#else
+#error "no threads implementation, define HAVE_WIN32_THREADS or HAVE_POSIX_THREADS"
+#endif
 
 #endif
@@ -0,0 +1,66 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#define MPCLAMP(a, min, max) (((a) < (min)) ? (min) : (((a) > (max)) ? (max) : (a)))
+
+#define MP_TIME_S_TO_NS(s) ((s) * INT64_C(1000000000))
+#define MP_TIME_MS_TO_NS(ms) ((ms) * INT64_C(1000000))
+#define MP_TIME_NS_TO_S(ns) ((ns) / (double)1000000000)
+
+// Return the current time of a monotonic clock in nanoseconds. The absolute
+// value is unspecified, but it's always strictly positive, so 0 can be used
+// as a "no time" value.
+static inline int64_t mp_time_ns(void)
+{
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER counter;
+    if (!freq.QuadPart)
+        QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&counter);
+    // split the conversion, so the multiplication can't overflow
+    int64_t sec = counter.QuadPart / freq.QuadPart;
+    int64_t rem = counter.QuadPart % freq.QuadPart;
+    return MP_TIME_S_TO_NS(sec) + MP_TIME_S_TO_NS(rem) / freq.QuadPart + 1;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return MP_TIME_S_TO_NS(ts.tv_sec) + ts.tv_nsec + 1;
+#endif
+}
+
+// Add a time in seconds to a mp_time_ns() value, saturating at the limits.
+// INFINITY results in INT64_MAX, which means "wait forever".
+static inline int64_t mp_time_ns_add(int64_t time_ns, double timeout_sec)
+{
+    double t = MPCLAMP(timeout_sec * 1e9, -0x1p63, 0x1p63);
+    int64_t ti = t == 0x1p63 ? INT64_MAX : (int64_t)t;
+    if (ti > INT64_MAX - time_ns)
+        return INT64_MAX;
+    if (ti <= -time_ns)
+        return 1;
+    return time_ns + ti;
+}
@@ -0,0 +1,186 @@
+// Copyright (c) 2023-2024 tsl0922. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+#include <limits.h>
+#include <string.h>
+#include "mpv_talloc.h"
+#include "keys.h"
+#include "patch.h"
+
+// patch op fields parsed from mpv node
+struct patch_op {
+    enum node_key op;
+    mpv_node *path;
+    mpv_node *state;
+    const char *title;
+    const char *shortcut;
+    mpv_node *submenu;
+    mpv_node *item;
+};
+
+static void parse_op(mpv_node *node, struct patch_op *op) {
+    *op = (struct patch_op){0};
+    if (node->format != MPV_FORMAT_NODE_MAP) return;
+
+    mpv_node_list *list = node->u.list;
+    for (int i = 0; i < list->num; i++) {
+        mpv_node *value = &list->values[i];
+        switch (node_key(list->keys[i])) {
+            case KEY_OP:
+                if (value->format == MPV_FORMAT_STRING)
+                    op->op = node_key(value->u.string);
+                break;
+            case KEY_PATH:
+                if (value->format == MPV_FORMAT_NODE_ARRAY) op->path = value;
+                break;
+            case KEY_STATE:
+                op->state = value;
+                break;
+            case KEY_TITLE:
+                if (value->format == MPV_FORMAT_STRING)
+                    op->title = value->u.string;
+                break;
+            case KEY_SHORTCUT:
+                if (value->format == MPV_FORMAT_STRING)
+                    op->shortcut = value->u.string;
+                break;
+            case KEY_SUBMENU:
+                if (value->format == MPV_FORMAT_NODE_ARRAY) op->submenu = value;
+                break;
+            case KEY_ITEM:
+                op->item = value;
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+// get 1-based path index as 0-based position, -1 if invalid
+//
+// the index is range checked before the int conversion, a JSON number may
+// be parsed as double, which must be integral.
+static int path_pos(mpv_node *node) {
+    if (node->format == MPV_FORMAT_INT64) {
+        int64_t v = node->u.int64;
+        return v >= 1 && v <= INT_MAX ? (int)v - 1 : -1;
+    }
+    if (node->format == MPV_FORMAT_DOUBLE) {
+        double v = node->u.double_;
+        return v >= 1 && v <= INT_MAX && v == (int)v ? (int)v - 1 : -1;
+    }
+    return -1;
+}
+
+// find item by path, and its parent and position in parent, return the
+// item index, or -1 if not found
+//
+// if append is set, the last position may be one past the end, which
+// returns 0 with parent and pos set.
+static int find_item(menu_model *m, mpv_node *path, bool append, int *parent,
+                     int *pos) {
+    if (path == NULL || path->u.list->num == 0) return -1;
+
+    int item = 0;
+    for (int i = 0; i < path->u.list->num; i++) {
+        if (m->type[item] != MENU_SUBMENU) return -1;
+
+        int p = path_pos(&path->u.list->values[i]);
+        bool last = i == path->u.list->num - 1;
+        if (p < 0 || p > m->count[item] ||
+            (p == m->count[item] && !(append && last)))
+            return -1;
+
+        *parent = item;
+        *pos = p;
+        item = p < m->count[item] ? m->first[item] + p : 0;
+    }
+    return item;
+}
+
+// arena space needed by set-title ops
+static size_t title_bytes(mpv_node *ops) {
+    size_t bytes = 0;
+    for (int i = 0; i < ops->u.list->num; i++) {
+        struct patch_op op;
+        parse_op(&ops->u.list->values[i], &op);
+        if (op.op != KEY_SET_TITLE || op.title == NULL) continue;
+
+        bytes += strlen(op.title) + 1;
+        if (op.shortcut) bytes += strlen(op.shortcut) + 1;
+    }
+    return bytes;
+}
+
+// apply patch ops to a copy of menu model, return the patched model, or
+// NULL if an op is invalid
+//
+// ops structure:
+//
+// MPV_FORMAT_NODE_ARRAY
+//    MPV_FORMAT_NODE_MAP (patch op)
+//       "op"          MPV_FORMAT_STRING
+//       "path"        MPV_FORMAT_NODE_ARRAY[MPV_FORMAT_INT64]
+//       "state"       MPV_FORMAT_NODE_ARRAY[MPV_FORMAT_STRING] (set-state)
+//       "title"       MPV_FORMAT_STRING                  (set-title)
+//       "shortcut"    MPV_FORMAT_STRING                  (set-title)
+//       "submenu"     MPV_FORMAT_NODE_ARRAY[menu item]   (replace-submenu)
+//       "item"        MPV_FORMAT_NODE_MAP (menu item)    (insert)
+//
+// path is the 1-based position of the item in each submenu, starting from
+// the top level menu, hidden items included. ops are applied in order, so
+// the path of an op refers to the menu after the previous ops. insert puts
+// the item at path, which may be one past the last item to append.
+//
+// set-state and set-title change the copied model in place, other ops
+// rebuild it around the changed submenu. only the changed items and their
+// ancestors are rehashed, menu_diff() skips the rest.
+menu_model *patch_apply(void *talloc_ctx, menu_model *m, mpv_node *ops) {
+    if (ops->format != MPV_FORMAT_NODE_ARRAY) return NULL;
+
+    menu_model *c = model_copy(talloc_ctx, m, title_bytes(ops));
+    for (int i = 0; i < ops->u.list->num; i++) {
+        struct patch_op op;
+        parse_op(&ops->u.list->values[i], &op);
+
+        int parent = 0, pos = 0;
+        bool append = op.op == KEY_INSERT;
+        int item = find_item(c, op.path, append, &parent, &pos);
+        if (item < 0) goto error;
+
+        menu_model *next = NULL;
+        switch (op.op) {
+            case KEY_SET_STATE:
+                model_set_state(c, item, model_parse_state(op.state));
+                continue;
+            case KEY_SET_TITLE:
+                if (!model_set_title(c, item, op.title, op.shortcut))
+                    goto error;
+                continue;
+            case KEY_REPLACE_SUBMENU:
+                if (op.submenu == NULL) goto error;
+                next = model_splice(talloc_ctx, c, item, 0, c->count[item],
+                                    op.submenu->u.list->values,
+                                    op.submenu->u.list->num);
+                break;
+            case KEY_INSERT:
+                if (op.item == NULL) goto error;
+                next = model_splice(talloc_ctx, c, parent, pos, 0, op.item, 1);
+                break;
+            case KEY_REMOVE:
+                next = model_splice(talloc_ctx, c, parent, pos, 1, NULL, 0);
+                break;
+            default:
+                goto error;
+        }
+        if (next == NULL) goto error;
+
+        talloc_free(c);
+        c = next;
+    }
+    return c;
+
+error:
+    talloc_free(c);
+    return NULL;
+}
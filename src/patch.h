@@ -0,0 +1,12 @@
+// Copyright (c) 2023-2024 tsl0922. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+#ifndef MPV_PLUGIN_PATCH_H
+#define MPV_PLUGIN_PATCH_H
+
+#include <mpv/client.h>
+#include "model.h"
+
+menu_model *patch_apply(void *talloc_ctx, menu_model *m, mpv_node *ops);
+
+#endif
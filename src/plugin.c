@@ -1,62 +1,61 @@
 // Copyright (c) 2023-2024 tsl0922. All rights reserved.
 // SPDX-License-Identifier: GPL-2.0-only
 
-#include <windows.h>
-#include <windowsx.h>
-#include <objbase.h>
-#include <shlwapi.h>
+#include <stdalign.h>
+#include <stdlib.h>
+#include <string.h>
 #include <mpv/client.h>
 #include "mpv_talloc.h"
+#include "osdep/timer.h"
+#include "backend.h"
 #include "clipboard.h"
+#include "command.h"
 #include "dialog.h"
 #include "menu.h"
 #include "plugin.h"
+#include "router.h"
+#include "stats.h"
+#include "worker.h"
 
 // global plugin context
 plugin_ctx *ctx = NULL;
 
-// custom window messages
-#define WM_SHOWMENU (WM_USER + 1)
-
-// handle window messages
-LRESULT CALLBACK WndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
-    POINT pt;
-
-    switch (uMsg) {
-        case WM_SHOWMENU:
-            if (GetCursorPos(&pt)) show_menu(ctx, &pt);
-            break;
-        case WM_COMMAND:
-            // low-word of wParam represents the menu identifier, is an unsigned 16-bit integer
-            handle_menu(ctx, LOWORD(wParam));
-            break;
-        default:
-            break;
-    }
-
-    return CallWindowProcW(ctx->wnd_proc, hWnd, uMsg, wParam, lParam);
+// attach backend to the mpv window
+static void register_window(int64_t wid) {
+    if (ctx->stats->window_ns == 0)
+        ctx->stats->window_ns = mpv_get_time_ns(ctx->mpv) - ctx->stats->startup;
+    backend_attach(ctx, wid);
 }
 
-// create HMENU and register window procedure
-static void plugin_register(int64_t wid) {
-    ctx->hwnd = (HWND)wid;
-    ctx->wnd_proc =
-        (WNDPROC)SetWindowLongPtrW(ctx->hwnd, GWLP_WNDPROC, (LONG_PTR)WndProc);
+// mark menu data property changed, a pending update of the other property
+// is replaced by it, and counted as skipped
+//
+// the initial notification of each property is delivered at startup, even
+// if it's not set, so it doesn't replace any update.
+static void mark_menu_dirty(const char *name, bool *notified) {
+    if (ctx->menu_dirty && *notified) ctx->stats->skipped_updates++;
+    *notified = true;
+    ctx->menu_dirty = name;
 }
 
 // handle property change event
 static void handle_property_change(mpv_event *event) {
+    static bool data_notified = false, json_notified = false;
     mpv_event_property *prop = event->data;
     switch (prop->format) {
         case MPV_FORMAT_INT64:
             if (strcmp(prop->name, "window-id") == 0) {
                 int64_t wid = *(int64_t *)prop->data;
-                if (wid > 0) plugin_register(wid);
+                if (wid > 0) register_window(wid);
             }
             break;
-        case MPV_FORMAT_NODE:
+        case MPV_FORMAT_NONE:
+            // menu data is read by flush_menu(), when all the pending
+            // events are handled, so a burst of changes is built once
             if (strcmp(prop->name, MENU_DATA_PROP) == 0) {
-                update_menu(ctx, prop->data);
+                mark_menu_dirty(MENU_DATA_PROP, &data_notified);
+            } else if (strcmp(prop->name, MENU_JSON_PROP) == 0) {
+                mark_menu_dirty(MENU_JSON_PROP, &json_notified);
             }
             break;
         default:
@@ -64,159 +63,508 @@ static void handle_property_change(mpv_event *event) {
     }
 }
 
+static void publish_stats_fn(void *data);
+
+// publish plugin stats to MENU_STATS_PROP
+//
+// MPV_FORMAT_NODE_MAP
+//    "skipped-updates"  MPV_FORMAT_INT64
+//    "menu-items"       MPV_FORMAT_INT64 (items of the latest menu)
+//    "menu-bytes"       MPV_FORMAT_INT64 (string bytes of the latest menu)
+//    "dispatch-queue"   MPV_FORMAT_INT64 (queued items of plugin thread)
+//    "worker-queue"     MPV_FORMAT_INT64 (queued or running requests)
+//    "rebuilds"         MPV_FORMAT_NODE_MAP (see stats_hist_node())
+//    "patches"          MPV_FORMAT_NODE_MAP (see stats_hist_node())
+//    "click-to-command" MPV_FORMAT_NODE_MAP (see stats_hist_node())
+//    "events"           MPV_FORMAT_NODE_MAP (see stats_events_node())
+//    "startup"          MPV_FORMAT_NODE_MAP (see stats_startup_node())
+//    "commands"         MPV_FORMAT_NODE_MAP (see router_metrics())
+//    "menu-commands"    MPV_FORMAT_NODE_MAP (see command_metrics())
+//    "dispatch"         MPV_FORMAT_NODE_MAP (see stats_dispatch_node(), only
+//                       with MP_DISPATCH_TRACE)
+static void publish_stats() {
+    plugin_stats *s = ctx->stats;
+    void *tmp = talloc_new(NULL);
+    mpv_node stats;
+    mpv_node_list *list = stats_map_node(tmp, &stats, 13);
+
+    epoch_enter(ctx->epoch, MENU_READER_PLUGIN);
+    int num_items = ctx->latest->num_items;
+    int64_t num_bytes = ctx->latest->num_bytes;
+    epoch_leave(ctx->epoch, MENU_READER_PLUGIN);
+
+    stats_add_int(list, "skipped-updates", s->skipped_updates);
+    stats_add_int(list, "menu-items", num_items);
+    stats_add_int(list, "menu-bytes", num_bytes);
+    stats_add_int(list, "dispatch-queue",
+                  mp_dispatch_queue_depth(ctx->dispatch));
+    stats_add_int(list, "worker-queue", worker_pending(ctx->worker));
+
+    list->keys[list->num] = "rebuilds";
+    stats_hist_node(&s->build, list, &list->values[list->num++], 0);
+    list->keys[list->num] = "patches";
+    stats_hist_node(&s->patch, list, &list->values[list->num++], 0);
+    list->keys[list->num] = "click-to-command";
+    stats_hist_node(&s->click, list, &list->values[list->num++], 0);
+    list->keys[list->num] = "events";
+    stats_events_node(s, list, &list->values[list->num++]);
+    list->keys[list->num] = "startup";
+    stats_startup_node(s, list, &list->values[list->num++]);
+    list->keys[list->num] = "commands";
+    router_metrics(ctx->router, list, &list->values[list->num++]);
+    list->keys[list->num] = "menu-commands";
+    command_metrics(ctx->commands, list, &list->values[list->num++]);
+    if (s->dispatch.count > 0) {
+        list->keys[list->num] = "dispatch";
+        stats_dispatch_node(s, list, &list->values[list->num++]);
+    }
+
+    mpv_set_property(ctx->mpv, MENU_STATS_PROP, MPV_FORMAT_NODE, &stats);
+    talloc_free(tmp);
+
+    // the scheduled publish is done by this one
+    if (s->dirty) mp_dispatch_cancel_fn(ctx->dispatch, publish_stats_fn, NULL);
+    s->dirty = false;
+    s->next_publish = mp_time_ns() + STATS_INTERVAL_NS;
+}
+
+static void publish_stats_fn(void *data) { publish_stats(); }
+
+// publish stats if they are changed, at most once per STATS_INTERVAL_NS, the
+// first change after a publish schedules the next one
+static void throttle_stats() {
+    plugin_stats *s = ctx->stats;
+    if (s->dirty) return;
+
+    s->dirty = true;
+    mp_dispatch_enqueue_at(ctx->dispatch, s->next_publish, publish_stats_fn,
+                           NULL);
+}
+
+// return the timeout of mpv_wait_event() to wake up for the next delayed
+// dispatch item, e.g. the throttled stats update
+static double wait_timeout() {
+    int64_t deadline = mp_dispatch_next_deadline(ctx->dispatch);
+    if (deadline == 0) return -1;
+
+    int64_t wait = deadline - mp_time_ns();
+    return wait > 0 ? wait / 1e9 : 0;
+}
+
+// update menu from menu data property, return false if it's not set
+static bool read_menu(const char *name) {
+    if (strcmp(name, MENU_JSON_PROP) == 0) {
+        char *json = mpv_get_property_string(ctx->mpv, name);
+        if (json == NULL) return false;
+
+        update_menu_json(ctx, json);
+        mpv_free(json);
+    } else {
+        mpv_node node = {0};
+        if (mpv_get_property(ctx->mpv, name, MPV_FORMAT_NODE, &node) < 0)
+            return false;
+
+        update_menu(ctx, &node);
+        mpv_free_node_contents(&node);
+    }
+    return true;
+}
+
+// read commit sequence number of menu data, -1 if it's not set
+static int64_t read_menu_seq() {
+    mpv_node node = {0};
+    if (mpv_get_property(ctx->mpv, MENU_SEQ_PROP, MPV_FORMAT_NODE, &node) < 0)
+        return -1;
+
+    int64_t seq = -1;
+    if (node.format == MPV_FORMAT_INT64) seq = node.u.int64;
+    if (node.format == MPV_FORMAT_DOUBLE) seq = (int64_t)node.u.double_;
+    mpv_free_node_contents(&node);
+    return seq;
+}
+
+// update menu with the latest value of the changed menu data property
+//
+// the initial values of both properties are delivered at startup, and only
+// one of them is set, so the other one is tried if the changed one is not
+// set.
+//
+// a client that sends patches sets the commit sequence number, which is
+// odd while the menu data is written. it's read before and after the menu
+// data, so the commit of the menu data is known if they are the same even
+// number. a commit that is read already is not read again, it may be
+// patched since.
+static void flush_menu() {
+    const char *name = ctx->menu_dirty;
+    ctx->menu_dirty = NULL;
+    int64_t start = mpv_get_time_ns(ctx->mpv);
+
+    int64_t seq = read_menu_seq();
+    if (seq >= 0 && seq == ctx->menu_seq) return;
+
+    const char *other =
+        strcmp(name, MENU_JSON_PROP) == 0 ? MENU_DATA_PROP : MENU_JSON_PROP;
+    if (!read_menu(name) && !read_menu(other)) return;
+    ctx->menu_seq = seq % 2 == 0 && seq == read_menu_seq() ? seq : -1;
+
+    plugin_stats *s = ctx->stats;
+    int64_t now = mpv_get_time_ns(ctx->mpv);
+    hist_add(&s->build, now - start);
+    if (s->first_build_ns == 0) s->first_build_ns = now - s->startup;
+}
+
+// client message: show
+static void cmd_show(void *data, int num_args, const char **args) {
+    backend_show(ctx);
+}
+
+// client message: stats
+static void cmd_stats(void *data, int num_args, const char **args) {
+    publish_stats();
+}
+
+// client message: patch <json> [<seq>]
+//
+// seq is the commit sequence number of the menu data the patch is based
+// on. the property change of a commit may be notified after the patches
+// based on it, so the menu data is read again if it's not that commit. a
+// patch of an older commit is dropped, the newer menu data includes it.
+static void cmd_patch(void *data, int num_args, const char **args) {
+    // patch ops refer to the latest menu data
+    if (ctx->menu_dirty) flush_menu();
+    if (num_args > 2) {
+        int64_t seq = strtoll(args[2], NULL, 10);
+        if (seq != ctx->menu_seq) {
+            ctx->menu_dirty = MENU_DATA_PROP;
+            flush_menu();
+        }
+        if (seq != ctx->menu_seq) return;
+    }
+
+    int64_t start = mpv_get_time_ns(ctx->mpv);
+    char *json = talloc_strdup(NULL, args[1]);
+    bool ok = patch_menu(ctx, json);
+    talloc_free(json);
+    hist_add(&ctx->stats->patch, mpv_get_time_ns(ctx->mpv) - start);
+
+    if (!ok) {
+        mpv_command(ctx->mpv,
+                    (const char *[]){"script-message", "menu-patch-failed",
+                                     NULL});
+    }
+}
+
+// dialog or clipboard request, run by the worker thread
+struct request {
+    char **(*run)(void *talloc_ctx, struct request *req);
+    const char *reply;  // reply message name, NULL if there's no reply
+    char *arg;          // client to reply to, or the clipboard text
+    char *id;           // request id of client, NULL if not given
+    char **result;      // NULL terminated result, NULL if cancelled
+};
+
+// wrap single result as a list
+static char **single_result(void *talloc_ctx, char *str) {
+    if (str == NULL) return NULL;
+    char **list = talloc_array(talloc_ctx, char *, 2);
+    list[0] = talloc_steal(list, str);
+    list[1] = NULL;
+    return list;
+}
+
+static char **run_clipboard_get(void *talloc_ctx, struct request *req) {
+    return single_result(talloc_ctx, get_clipboard(ctx, NULL));
+}
+
+static char **run_clipboard_set(void *talloc_ctx, struct request *req) {
+    set_clipboard(ctx, req->arg);
+    return NULL;
+}
+
+static char **run_dialog_open(void *talloc_ctx, struct request *req) {
+    return single_result(talloc_ctx, open_dialog(NULL, ctx));
+}
+
+static char **run_dialog_open_multi(void *talloc_ctx, struct request *req) {
+    return open_dialog_multi(talloc_ctx, ctx);
+}
+
+static char **run_dialog_open_folder(void *talloc_ctx, struct request *req) {
+    return single_result(talloc_ctx, open_folder(NULL, ctx));
+}
+
+static char **run_dialog_save(void *talloc_ctx, struct request *req) {
+    return single_result(talloc_ctx, save_dialog(NULL, ctx));
+}
+
+// run on worker thread
+static void request_run(void *data) {
+    struct request *req = data;
+    req->result = req->run(req, req);
+}
+
+// run on plugin thread, send result to client
+//
+// a cancelled request is replied only if the client gave a request id, so
+// it knows the request is done.
+static void request_reply(void *data) {
+    struct request *req = data;
+    if (req->reply == NULL || (req->result == NULL && req->id == NULL)) return;
+
+    int count = 0;
+    while (req->result && req->result[count]) count++;
+
+    const char **cmd = talloc_array(req, const char *, count + 5);
+    int n = 0;
+    cmd[n++] = "script-message-to";
+    cmd[n++] = req->arg;
+    cmd[n++] = req->reply;
+    if (req->id) cmd[n++] = req->id;
+    for (int i = 0; i < count; i++) cmd[n++] = req->result[i];
+    cmd[n] = NULL;
+
+    mpv_command(ctx->mpv, cmd);
+}
+
+// queue request to worker, args are copied as they are freed after the
+// client message is handled
+static void submit_request(int num_args, const char **args, const char *reply,
+                           char **(*run)(void *, struct request *)) {
+    struct request *req = talloc_zero(NULL, struct request);
+    req->run = run;
+    req->reply = reply;
+    req->arg = talloc_strdup(req, args[1]);
+    if (num_args > 2) req->id = talloc_strdup(req, args[2]);
+    worker_submit(ctx->worker, request_run, request_reply, req);
+}
+
+// client message: clipboard/get <src> [<id>]
+static void cmd_clipboard_get(void *data, int num_args, const char **args) {
+    submit_request(num_args, args, "clipboard-get-reply", run_clipboard_get);
+}
+
+// client message: clipboard/set <text>
+static void cmd_clipboard_set(void *data, int num_args, const char **args) {
+    submit_request(num_args, args, NULL, run_clipboard_set);
+}
+
+// client message: dialog/open <src> [<id>]
+static void cmd_dialog_open(void *data, int num_args, const char **args) {
+    submit_request(num_args, args, "dialog-open-reply", run_dialog_open);
+}
+
+// client message: dialog/open-multi <src> [<id>]
+static void cmd_dialog_open_multi(void *data, int num_args,
+                                  const char **args) {
+    submit_request(num_args, args, "dialog-open-multi-reply",
+                   run_dialog_open_multi);
+}
+
+// client message: dialog/open-folder <src> [<id>]
+static void cmd_dialog_open_folder(void *data, int num_args,
+                                   const char **args) {
+    submit_request(num_args, args, "dialog-open-folder-reply",
+                   run_dialog_open_folder);
+}
+
+// client message: dialog/save <src> [<id>]
+static void cmd_dialog_save(void *data, int num_args, const char **args) {
+    submit_request(num_args, args, "dialog-save-reply", run_dialog_save);
+}
+
+// register client message handlers
+static void register_commands(router *r) {
+    router_add(r, "show", 0, cmd_show);
+    router_add(r, "stats", 0, cmd_stats);
+    router_add(r, "patch", 1, cmd_patch);
+    router_add(r, "clipboard/get", 1, cmd_clipboard_get);
+    router_add(r, "clipboard/set", 1, cmd_clipboard_set);
+    router_add(r, "dialog/open", 1, cmd_dialog_open);
+    router_add(r, "dialog/open-multi", 1, cmd_dialog_open_multi);
+    router_add(r, "dialog/open-folder", 1, cmd_dialog_open_folder);
+    router_add(r, "dialog/save", 1, cmd_dialog_save);
+}
+
 // handle client message event
 static void handle_client_message(mpv_event *event) {
     mpv_event_client_message *msg = event->data;
-    if (msg->num_args < 1) return;
-
-    const char *cmd = msg->args[0];
-    if (strcmp(cmd, "show") == 0) {
-        PostMessageW(ctx->hwnd, WM_SHOWMENU, 0, 0);
-    } else if (msg->num_args > 1) {
-        if (strcmp(cmd, "clipboard/get") == 0) {
-            char *text = get_clipboard(ctx, NULL);
-            if (text == NULL) return;
-
-            mpv_command(ctx->mpv,
-                        (const char *[]){"script-message-to", msg->args[1],
-                                         "clipboard-get-reply", text, NULL});
-            talloc_free(text);
-        } else if (strcmp(cmd, "clipboard/set") == 0) {
-            set_clipboard(ctx, msg->args[1]);
-        } else if (strcmp(cmd, "dialog/open") == 0) {
-            char *path = open_dialog(NULL, ctx);
-            if (path == NULL) return;
-
-            mpv_command(ctx->mpv,
-                        (const char *[]){"script-message-to", msg->args[1],
-                                         "dialog-open-reply", path, NULL});
-            talloc_free(path);
-        } else if (strcmp(cmd, "dialog/open-multi") == 0) {
-            void *tmp = talloc_new(NULL);
-            char **paths = open_dialog_multi(tmp, ctx);
-            if (paths == NULL) {
-                talloc_free(tmp);
-                return;
-            }
+    router_dispatch(ctx->router, ctx, msg->num_args, msg->args);
+}
+
+// wake up plugin thread to process the dispatch queue
+static void wakeup_plugin(void *data) { mpv_wakeup((mpv_handle *)data); }
+
+// record dispatch queue trace, run on plugin thread before each item
+static void trace_dispatch(void *data, int64_t latency, int depth) {
+    plugin_stats *s = ctx->stats;
+    hist_add(&s->dispatch, latency);
+    if (depth > s->dispatch_depth) s->dispatch_depth = depth;
+}
 
-            int count = 0;
-            while (paths[count] != NULL) count++;
-
-            char **args = talloc_array(tmp, char *, count + 4);
-            args[0] = talloc_strdup(tmp, "script-message-to");
-            args[1] = talloc_strdup(tmp, msg->args[1]);
-            args[2] = talloc_strdup(tmp, "dialog-open-multi-reply");
-            for (int i = 0; i < count; i++) args[i + 3] = paths[i];
-            args[count + 3] = NULL;
-
-            mpv_command(ctx->mpv, (const char **)args);
-            talloc_free(tmp);
-        } else if (strcmp(cmd, "dialog/open-folder") == 0) {
-            char *path = open_folder(NULL, ctx);
-            if (path == NULL) return;
-
-            mpv_command(ctx->mpv, (const char *[]){
-                                      "script-message-to", msg->args[1],
-                                      "dialog-open-folder-reply", path, NULL});
-            talloc_free(path);
-        } else if (strcmp(cmd, "dialog/save") == 0) {
-            char *path = save_dialog(NULL, ctx);
-            if (path == NULL) return;
-
-            mpv_command(ctx->mpv,
-                        (const char *[]){"script-message-to", msg->args[1],
-                                         "dialog-save-reply", path, NULL});
-            talloc_free(path);
+// read integer option from script-opts, the key is prefixed with client
+// name, e.g. --script-opts=menu-max_inflight=4
+static int64_t read_int_option(mpv_handle *mpv, const char *name,
+                               int64_t def) {
+    mpv_node node = {0};
+    if (mpv_get_property(mpv, "script-opts", MPV_FORMAT_NODE, &node) < 0)
+        return def;
+
+    int64_t ret = def;
+    char *key = talloc_asprintf(NULL, "%s-%s", mpv_client_name(mpv), name);
+    if (node.format == MPV_FORMAT_NODE_MAP) {
+        mpv_node_list *list = node.u.list;
+        for (int i = 0; i < list->num; i++) {
+            if (strcmp(list->keys[i], key) != 0 ||
+                list->values[i].format != MPV_FORMAT_STRING)
+                continue;
+            char *end;
+            int64_t value = strtoll(list->values[i].u.string, &end, 10);
+            if (*end == '\0') ret = value;
         }
     }
+
+    talloc_free(key);
+    mpv_free_node_contents(&node);
+    return ret;
 }
 
 // create and init plugin context
-static void create_plugin_ctx(mpv_handle *mpv) {
+//
+// the presented menu is created by the backend, when it's first used
+static void create_plugin_ctx(mpv_handle *mpv, int64_t startup) {
     ctx = talloc_zero(NULL, plugin_ctx);
-    ctx->hmenu = CreatePopupMenu();
-    ctx->hmenu_ctx = talloc_new(ctx);
+    ctx->stats = talloc_zero(ctx, plugin_stats);
+    ctx->stats->startup = startup;
+    // menu models are passed between threads, so they are not allocated
+    // under ctx
+    ctx->latest = model_build(NULL, NULL);
+    ctx->menu_seq = -1;
+    atomic_init(&ctx->model, ctx->latest);
+    atomic_init(&ctx->pending, NULL);
+    ctx->epoch = epoch_create(ctx, MENU_READER_SLOTS);
+    ctx->idmap = idmap_create(ctx, MENU_ID_BASE, MENU_ID_MAX);
     ctx->mpv = mpv;
 
     ctx->dispatch = mp_dispatch_create(ctx);
+    mp_dispatch_set_wakeup_fn(ctx->dispatch, wakeup_plugin, mpv);
+    mp_dispatch_set_trace_fn(ctx->dispatch, trace_dispatch, NULL);
+    ctx->worker = worker_create(ctx, ctx->dispatch, backend_thread_init,
+                                backend_thread_uninit);
+    ctx->router = router_create(ctx, mpv);
+    ctx->commands = command_queue_create(
+        ctx, mpv,
+        read_int_option(mpv, "max_inflight", COMMAND_MAX_INFLIGHT));
+    register_commands(ctx->router);
+    backend_init(ctx);
 }
 
 // destroy plugin context and free memory
 static void destroy_plugin_ctx() {
-    if (ctx->hmenu) DestroyMenu(ctx->hmenu);
-    if (ctx->hwnd && ctx->wnd_proc)
-        SetWindowLongPtrW(ctx->hwnd, GWLP_WNDPROC, (LONG_PTR)ctx->wnd_proc);
+    // wait for the running request, then send the queued replies
+    talloc_free(ctx->worker);
+    mp_dispatch_queue_process(ctx->dispatch, 0);
+
+    backend_uninit(ctx);
+    talloc_free(atomic_exchange(&ctx->pending, NULL));
+    talloc_free(atomic_exchange(&ctx->model, NULL));
     talloc_free(ctx);
 }
 
 // entry point of plugin
 MPV_EXPORT int mpv_open_cplugin(mpv_handle *handle) {
-    CoInitializeEx(NULL, COINIT_APARTMENTTHREADED);
-
-    create_plugin_ctx(handle);
-
-    mpv_node node = {0};
-    if (mpv_get_property(handle, MENU_DATA_PROP, MPV_FORMAT_NODE, &node) >= 0) {
-        update_menu(ctx, &node);
-        mpv_free_node_contents(&node);
-    }
+    int64_t startup = mpv_get_time_ns(handle);
+    create_plugin_ctx(handle, startup);
+    int64_t init = mpv_get_time_ns(handle);
+    ctx->stats->init_ns = init - startup;
 
+    // the initial value of observed properties is delivered as a change, so
+    // the menu is built once, by flush_menu()
     mpv_observe_property(handle, 0, "window-id", MPV_FORMAT_INT64);
-    mpv_observe_property(handle, 0, MENU_DATA_PROP, MPV_FORMAT_NODE);
+    mpv_observe_property(handle, 0, MENU_DATA_PROP, MPV_FORMAT_NONE);
+    mpv_observe_property(handle, 0, MENU_JSON_PROP, MPV_FORMAT_NONE);
 
     mpv_command(handle, (const char *[]){"script-message", "menu-init",
                                          mpv_client_name(handle), NULL});
+    ctx->stats->setup_ns = mpv_get_time_ns(handle) - init;
 
     while (handle) {
-        mpv_event *event = mpv_wait_event(handle, -1);
+        // don't block if menu data changed, so it's updated once the queued
+        // events are drained, and wake up for the delayed dispatch items
+        mpv_event *event =
+            mpv_wait_event(handle, ctx->menu_dirty ? 0 : wait_timeout());
         if (event->event_id == MPV_EVENT_SHUTDOWN) break;
 
+        // a wakeup that only runs delayed items doesn't change the stats,
+        // or the stats update would reschedule itself forever
+        bool changed = event->event_id != MPV_EVENT_NONE || ctx->menu_dirty ||
+                       mp_dispatch_queue_depth(ctx->dispatch) > 0;
+
+        int64_t start = mpv_get_time_ns(handle);
         mp_dispatch_queue_process(ctx->dispatch, 0);
 
         switch (event->event_id) {
+            case MPV_EVENT_NONE:
+                if (ctx->menu_dirty) flush_menu();
+                break;
             case MPV_EVENT_PROPERTY_CHANGE:
                 handle_property_change(event);
                 break;
             case MPV_EVENT_CLIENT_MESSAGE:
                 handle_client_message(event);
                 break;
+            case MPV_EVENT_COMMAND_REPLY:
+                command_reply(ctx->commands, event);
+                break;
             default:
                 break;
         }
+
+        if (event->event_id < STATS_MAX_EVENTS) {
+            hist_add(&ctx->stats->events[event->event_id],
+                     mpv_get_time_ns(handle) - start);
+        }
+        if (changed) throttle_stats();
     }
 
     mpv_unobserve_property(handle, 0);
     destroy_plugin_ctx();
 
-    CoUninitialize();
-
     return 0;
 }
 
-// convert utf8 string to wchar_t
-wchar_t *mp_from_utf8(void *talloc_ctx, const char *s) {
-    int count = MultiByteToWideChar(CP_UTF8, 0, s, -1, NULL, 0);
-    if (count <= 0) abort();
-    wchar_t *ret = talloc_array(talloc_ctx, wchar_t, count);
-    MultiByteToWideChar(CP_UTF8, 0, s, -1, ret, count);
-    return ret;
-}
-
-// convert wchar_t string to utf8
-char *mp_to_utf8(void *talloc_ctx, const wchar_t *s) {
-    int count = WideCharToMultiByte(CP_UTF8, 0, s, -1, NULL, 0, NULL, NULL);
-    if (count <= 0) abort();
-    char *ret = talloc_array(talloc_ctx, char, count);
-    WideCharToMultiByte(CP_UTF8, 0, s, -1, ret, count, NULL, NULL);
-    return ret;
-}
+struct async_cmd {
+    int64_t start;  // time of request, for command latency
+    bool clicked;   // command of a clicked menu item
+    char args[];    // command string
+};
 
+// the click latency is the time the command waits for the plugin thread
 static void async_cmd_fn(void *data) {
-    mpv_command_string(ctx->mpv, (const char *)data);
+    struct async_cmd *cmd = data;
+    if (cmd->clicked)
+        hist_add(&ctx->stats->click, mpv_get_time_ns(ctx->mpv) - cmd->start);
+    command_submit(ctx->commands, cmd->args, cmd->start);
 }
 
-// run command in none-ui thread
-void mp_command_async(const char *args) {
-    mp_dispatch_enqueue(ctx->dispatch, async_cmd_fn, (void *)args);
-    mpv_wakeup(ctx->mpv);
+// run command in none-ui thread, args is copied as the menu may be updated
+// before the command runs. clicked is set if the command is from a menu
+// item.
+//
+// the request is copied into the dispatch item, which is stored inline and
+// pooled if it's small enough, so most commands don't allocate memory. it's
+// queued in the interactive lane, ahead of the worker replies.
+void mp_command_async(const char *args, bool clicked) {
+    alignas(struct async_cmd) char buf[MP_DISPATCH_INLINE_SIZE];
+    size_t len = strlen(args) + 1;
+    size_t size = sizeof(struct async_cmd) + len;
+
+    struct async_cmd *cmd =
+        size <= sizeof(buf) ? (void *)buf : talloc_size(NULL, size);
+    cmd->start = mpv_get_time_ns(ctx->mpv);
+    cmd->clicked = clicked;
+    memcpy(cmd->args, args, len);
+    mp_dispatch_enqueue_copy(ctx->dispatch, MP_DISPATCH_INTERACTIVE,
+                             async_cmd_fn, cmd, size);
+
+    if ((void *)cmd != buf) talloc_free(cmd);
 }
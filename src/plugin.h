@@ -4,23 +4,34 @@
 #ifndef MPV_PLUGIN_H
 #define MPV_PLUGIN_H
 
+#include <stdatomic.h>
 #include <stdbool.h>
-#include <windows.h>
 #include <mpv/client.h>
 #include "misc/dispatch.h"
+#include "epoch.h"
+#include "idmap.h"
+#include "model.h"
 
 typedef struct {
-    mpv_handle *mpv;              // mpv client handle
-    mp_dispatch_queue *dispatch;  // dispatch queue
+    mpv_handle *mpv;                 // mpv client handle
+    mp_dispatch_queue *dispatch;     // dispatch queue
+    struct router *router;           // client message router
+    struct worker *worker;           // runs dialog and clipboard requests
+    struct command_queue *commands;  // runs menu commands asynchronously
+    struct backend *backend;         // presentation backend state
 
-    HWND hwnd;         // window handle
-    HMENU hmenu;       // native menu handle
-    void *hmenu_ctx;   // menu talloc context
-    WNDPROC wnd_proc;  // previous window procedure
+    _Atomic(menu_model *) model;    // menu model of presented menu
+    _Atomic(menu_model *) pending;  // menu model waiting to be applied
+    menu_model *latest;             // last published model, plugin thread
+    epoch *epoch;                   // reclaims replaced menu models
+    idmap *idmap;                   // menu identifier allocator
+    uint32_t menu_gen;              // id generation when menu is shown
+    bool menu_open;                 // menu is being shown
+    const char *menu_dirty;         // changed menu data property, if any
+    int64_t menu_seq;               // commit of the latest menu data, or -1
+    struct plugin_stats *stats;     // runtime statistics
 } plugin_ctx;
 
-wchar_t *mp_from_utf8(void *talloc_ctx, const char *s);
-char *mp_to_utf8(void *talloc_ctx, const wchar_t *s);
-void mp_command_async(const char *args);
+void mp_command_async(const char *args, bool clicked);
 
 #endif
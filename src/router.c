@@ -0,0 +1,117 @@
+// Copyright (c) 2023-2024 tsl0922. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+#include <string.h>
+#include "mpv_talloc.h"
+#include "hist.h"
+#include "router.h"
+#include "stats.h"
+
+struct route {
+    char *name;         // command name
+    int min_args;       // required arguments, not including the name
+    route_fn fn;        // command handler
+    uint64_t rejected;  // calls with too few arguments
+    histogram latency;  // handler latency in nanoseconds
+};
+
+struct router {
+    mpv_handle *mpv;
+
+    struct route *routes;  // registered commands, in registration order
+    int num_routes;
+    int32_t *table;        // open addressing table of route index, -1 if empty
+    int table_size;        // power of 2, at most half full
+};
+
+// 32-bit FNV-1a
+static uint32_t hash_str(const char *s) {
+    uint32_t h = 0x811c9dc5;
+    while (*s) h = (h ^ (unsigned char)*s++) * 0x01000193;
+    return h;
+}
+
+// find table slot of name, it's either empty or holds the command
+static int find_slot(router *r, const char *name) {
+    int mask = r->table_size - 1;
+    int slot = hash_str(name) & mask;
+    while (r->table[slot] >= 0 &&
+           strcmp(r->routes[r->table[slot]].name, name) != 0)
+        slot = (slot + 1) & mask;
+    return slot;
+}
+
+static void rehash(router *r, int size) {
+    talloc_free(r->table);
+    r->table = talloc_array(r, int32_t, size);
+    r->table_size = size;
+    for (int i = 0; i < size; i++) r->table[i] = -1;
+    for (int i = 0; i < r->num_routes; i++)
+        r->table[find_slot(r, r->routes[i].name)] = i;
+}
+
+router *router_create(void *talloc_ctx, mpv_handle *mpv) {
+    router *r = talloc_zero(talloc_ctx, router);
+    r->mpv = mpv;
+    rehash(r, 16);
+    return r;
+}
+
+// register command handler, replaces the existing one with the same name
+void router_add(router *r, const char *name, int min_args, route_fn fn) {
+    int slot = find_slot(r, name);
+    if (r->table[slot] >= 0) {
+        struct route *route = &r->routes[r->table[slot]];
+        route->min_args = min_args;
+        route->fn = fn;
+        return;
+    }
+
+    struct route route = {
+        .name = talloc_strdup(r, name),
+        .min_args = min_args,
+        .fn = fn,
+    };
+    MP_TARRAY_APPEND(r, r->routes, r->num_routes, route);
+    r->table[slot] = r->num_routes - 1;
+    if (r->num_routes * 2 > r->table_size) rehash(r, r->table_size * 2);
+}
+
+// run handler of client message, return false if the command is unknown,
+// or the message has too few arguments
+bool router_dispatch(router *r, void *ctx, int num_args, const char **args) {
+    if (num_args < 1) return false;
+
+    int idx = r->table[find_slot(r, args[0])];
+    if (idx < 0) return false;
+
+    struct route *route = &r->routes[idx];
+    if (num_args - 1 < route->min_args) {
+        route->rejected++;
+        return false;
+    }
+
+    int64_t start = mpv_get_time_ns(r->mpv);
+    route->fn(ctx, num_args, args);
+    hist_add(&route->latency, mpv_get_time_ns(r->mpv) - start);
+    return true;
+}
+
+// build metrics node of commands that are called at least once
+//
+// MPV_FORMAT_NODE_MAP (command name)
+//    MPV_FORMAT_NODE_MAP (handler latency, see stats_hist_node())
+//       "rejected"  MPV_FORMAT_INT64
+void router_metrics(router *r, void *talloc_ctx, mpv_node *dst) {
+    mpv_node_list *list = stats_map_node(talloc_ctx, dst, r->num_routes);
+
+    for (int i = 0; i < r->num_routes; i++) {
+        struct route *route = &r->routes[i];
+        if (route->latency.count == 0 && route->rejected == 0) continue;
+
+        mpv_node_list *m = stats_hist_node(&route->latency, list,
+                                           &list->values[list->num], 1);
+        stats_add_int(m, "rejected", route->rejected);
+        list->keys[list->num++] = route->name;
+    }
+}
@@ -0,0 +1,24 @@
+// Copyright (c) 2023-2024 tsl0922. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+#ifndef MPV_PLUGIN_ROUTER_H
+#define MPV_PLUGIN_ROUTER_H
+
+#include <stdbool.h>
+#include <mpv/client.h>
+
+// handler of a client message, args[0] is the command name
+typedef void (*route_fn)(void *ctx, int num_args, const char **args);
+
+// client message router, commands are looked up in a hash table
+//
+// each command has a call count, a rejected count (too few arguments) and
+// a latency histogram, measured with mpv_get_time_ns().
+typedef struct router router;
+
+router *router_create(void *talloc_ctx, mpv_handle *mpv);
+void router_add(router *r, const char *name, int min_args, route_fn fn);
+bool router_dispatch(router *r, void *ctx, int num_args, const char **args);
+void router_metrics(router *r, void *talloc_ctx, mpv_node *dst);
+
+#endif
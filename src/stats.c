@@ -0,0 +1,93 @@
+// Copyright (c) 2023-2024 tsl0922. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+#include "mpv_talloc.h"
+#include "stats.h"
+
+// create map node with room for size fields
+mpv_node_list *stats_map_node(void *talloc_ctx, mpv_node *dst, int size) {
+    mpv_node_list *list = talloc_zero(talloc_ctx, mpv_node_list);
+    list->keys = talloc_array(list, char *, size);
+    list->values = talloc_array(list, mpv_node, size);
+
+    dst->format = MPV_FORMAT_NODE_MAP;
+    dst->u.list = list;
+    return list;
+}
+
+// add integer field to map node, the map must have room for it
+void stats_add_int(mpv_node_list *list, const char *key, int64_t value) {
+    list->keys[list->num] = (char *)key;
+    list->values[list->num++] =
+        (mpv_node){.format = MPV_FORMAT_INT64, .u.int64 = value};
+}
+
+// build histogram summary node, and return its map, which has room for
+// extra fields of the caller
+//
+// MPV_FORMAT_NODE_MAP
+//    "count"    MPV_FORMAT_INT64
+//    "mean-ns"  MPV_FORMAT_INT64
+//    "p50-ns"   MPV_FORMAT_INT64
+//    "p99-ns"   MPV_FORMAT_INT64
+//    "p999-ns"  MPV_FORMAT_INT64
+//    "max-ns"   MPV_FORMAT_INT64
+mpv_node_list *stats_hist_node(const histogram *h, void *talloc_ctx,
+                               mpv_node *dst, int extra) {
+    mpv_node_list *list = stats_map_node(talloc_ctx, dst, 6 + extra);
+
+    stats_add_int(list, "count", h->count);
+    stats_add_int(list, "mean-ns",
+                  h->count ? h->total / (int64_t)h->count : 0);
+    stats_add_int(list, "p50-ns", hist_percentile(h, 50));
+    stats_add_int(list, "p99-ns", hist_percentile(h, 99));
+    stats_add_int(list, "p999-ns", hist_percentile(h, 99.9));
+    stats_add_int(list, "max-ns", h->max);
+    return list;
+}
+
+// build event handling time node, of events that are handled at least once
+//
+// MPV_FORMAT_NODE_MAP (event name, see mpv_event_name())
+//    MPV_FORMAT_NODE_MAP (see stats_hist_node())
+void stats_events_node(const plugin_stats *s, void *talloc_ctx,
+                       mpv_node *dst) {
+    mpv_node_list *list = stats_map_node(talloc_ctx, dst, STATS_MAX_EVENTS);
+
+    for (int i = 0; i < STATS_MAX_EVENTS; i++) {
+        const char *name = mpv_event_name(i);
+        if (s->events[i].count == 0 || name == NULL) continue;
+
+        list->keys[list->num] = (char *)name;
+        stats_hist_node(&s->events[i], list, &list->values[list->num++], 0);
+    }
+}
+
+// build startup timing node
+//
+// MPV_FORMAT_NODE_MAP
+//    "init-ns"         MPV_FORMAT_INT64
+//    "setup-ns"        MPV_FORMAT_INT64
+//    "first-build-ns"  MPV_FORMAT_INT64
+//    "window-ns"       MPV_FORMAT_INT64
+//    "native-menu-ns"  MPV_FORMAT_INT64
+void stats_startup_node(plugin_stats *s, void *talloc_ctx, mpv_node *dst) {
+    mpv_node_list *list = stats_map_node(talloc_ctx, dst, 5);
+
+    stats_add_int(list, "init-ns", s->init_ns);
+    stats_add_int(list, "setup-ns", s->setup_ns);
+    stats_add_int(list, "first-build-ns", s->first_build_ns);
+    stats_add_int(list, "window-ns", s->window_ns);
+    stats_add_int(list, "native-menu-ns", atomic_load(&s->native_menu_ns));
+}
+
+// build dispatch queue trace node, the latency is from enqueue to run, only
+// traced if built with MP_DISPATCH_TRACE, see mp_dispatch_set_trace_fn()
+//
+// MPV_FORMAT_NODE_MAP (see stats_hist_node())
+//    "max-depth"  MPV_FORMAT_INT64 (most items queued behind a running one)
+void stats_dispatch_node(const plugin_stats *s, void *talloc_ctx,
+                         mpv_node *dst) {
+    mpv_node_list *list = stats_hist_node(&s->dispatch, talloc_ctx, dst, 1);
+    stats_add_int(list, "max-depth", s->dispatch_depth);
+}
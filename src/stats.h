@@ -0,0 +1,46 @@
+// Copyright (c) 2023-2024 tsl0922. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+#ifndef MPV_PLUGIN_STATS_H
+#define MPV_PLUGIN_STATS_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <mpv/client.h>
+#include "hist.h"
+
+#define STATS_INTERVAL_NS 1000000000LL  // min interval of stats updates
+#define STATS_MAX_EVENTS 32             // event ids with handling time
+
+// runtime statistics, updated and published by the plugin thread, except
+// native_menu_ns, which is set by the UI thread
+typedef struct plugin_stats {
+    int64_t skipped_updates;             // menu updates coalesced
+    histogram build;                     // full menu rebuild time
+    histogram patch;                     // menu patch time
+    histogram click;                     // menu click to command dispatch
+    histogram events[STATS_MAX_EVENTS];  // event handling time, by id
+    histogram dispatch;                  // dispatch enqueue to run latency
+    int dispatch_depth;                  // most dispatch items queued
+    bool dirty;                          // changed, a publish is scheduled
+    int64_t next_publish;                // earliest next publish, mp_time_ns
+
+    // startup timing, times since startup are 0 until they happen
+    int64_t startup;                 // time when plugin is loaded
+    int64_t init_ns;                 // plugin context creation
+    int64_t setup_ns;                // property observation and menu-init
+    int64_t first_build_ns;          // time since startup to first build
+    int64_t window_ns;               // time since startup to window-id
+    _Atomic int64_t native_menu_ns;  // time since startup to native menu
+} plugin_stats;
+
+mpv_node_list *stats_map_node(void *talloc_ctx, mpv_node *dst, int size);
+void stats_add_int(mpv_node_list *list, const char *key, int64_t value);
+mpv_node_list *stats_hist_node(const histogram *h, void *talloc_ctx,
+                               mpv_node *dst, int extra);
+void stats_events_node(const plugin_stats *s, void *talloc_ctx, mpv_node *dst);
+void stats_startup_node(plugin_stats *s, void *talloc_ctx, mpv_node *dst);
+void stats_dispatch_node(const plugin_stats *s, void *talloc_ctx,
+                         mpv_node *dst);
+
+#endif
@@ -0,0 +1,168 @@
+// Copyright (c) 2023-2024 tsl0922. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+// utf8 <-> utf16 conversion with a vectorized ascii fast path
+//
+// invalid sequences are replaced with U+FFFD, like MultiByteToWideChar()
+// and WideCharToMultiByte() do. the output is not terminated, the number
+// of units written is returned, so the caller can size the buffer with
+// UTF16_MAX_LEN() / UTF8_MAX_LEN() and convert in a single pass.
+
+#include "utf.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define HAVE_SSE2 1
+#endif
+
+#define REPLACEMENT_CHAR 0xFFFD
+
+// widen ascii prefix of src, return number of bytes converted
+static size_t ascii_to_utf16(uint16_t *dst, const char *src, size_t len) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+        if (_mm256_movemask_epi8(v)) break;
+        __m256i lo = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(v));
+        __m256i hi = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(v, 1));
+        _mm256_storeu_si256((__m256i *)(dst + i), lo);
+        _mm256_storeu_si256((__m256i *)(dst + i + 16), hi);
+    }
+#elif defined(HAVE_SSE2)
+    __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        if (_mm_movemask_epi8(v)) break;
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_unpacklo_epi8(v, zero));
+        _mm_storeu_si128((__m128i *)(dst + i + 8), _mm_unpackhi_epi8(v, zero));
+    }
+#endif
+    while (i < len && (unsigned char)src[i] < 0x80) {
+        dst[i] = (unsigned char)src[i];
+        i++;
+    }
+    return i;
+}
+
+// narrow ascii prefix of src, return number of units converted
+static size_t ascii_to_utf8(char *dst, const uint16_t *src, size_t len) {
+    size_t i = 0;
+#if defined(__AVX2__) || defined(HAVE_SSE2)
+    __m128i mask = _mm_set1_epi16((short)0xFF80);
+    __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= len; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + i + 8));
+        __m128i high = _mm_and_si128(_mm_or_si128(a, b), mask);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(high, zero)) != 0xFFFF) break;
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(a, b));
+    }
+#endif
+    while (i < len && src[i] < 0x80) {
+        dst[i] = (char)src[i];
+        i++;
+    }
+    return i;
+}
+
+// decode one utf8 sequence at s, store the code point in *cp, return the
+// number of bytes consumed
+//
+// the second byte range depends on the lead byte, which rules out overlong
+// forms, surrogates and code points above U+10FFFF (Unicode table 3-7). an
+// invalid sequence is replaced up to the first byte that can't continue
+// it, so each maximal subpart becomes one U+FFFD.
+static size_t decode_utf8(const unsigned char *s, size_t len, uint32_t *cp) {
+    unsigned char c = s[0];
+    unsigned char lo = 0x80, hi = 0xBF;
+    size_t n;
+
+    if (c < 0x80) {
+        *cp = c;
+        return 1;
+    } else if (c >= 0xC2 && c <= 0xDF) {
+        n = 2, *cp = c & 0x1F;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+        n = 3, *cp = c & 0x0F;
+        if (c == 0xE0) lo = 0xA0;
+        if (c == 0xED) hi = 0x9F;
+    } else if (c >= 0xF0 && c <= 0xF4) {
+        n = 4, *cp = c & 0x07;
+        if (c == 0xF0) lo = 0x90;
+        if (c == 0xF4) hi = 0x8F;
+    } else {
+        *cp = REPLACEMENT_CHAR;
+        return 1;
+    }
+
+    for (size_t i = 1; i < n; i++) {
+        if (i >= len || s[i] < lo || s[i] > hi) {
+            *cp = REPLACEMENT_CHAR;
+            return i;
+        }
+        *cp = (*cp << 6) | (s[i] & 0x3F);
+        lo = 0x80, hi = 0xBF;
+    }
+    return n;
+}
+
+// convert len bytes of utf8 to utf16, dst must have room for
+// UTF16_MAX_LEN(len) units, return the number of units written
+size_t utf8_to_utf16(uint16_t *dst, const char *src, size_t len) {
+    const unsigned char *s = (const unsigned char *)src;
+    size_t i = 0, j = 0;
+
+    while (i < len) {
+        size_t n = ascii_to_utf16(dst + j, src + i, len - i);
+        i += n, j += n;
+        if (i >= len) break;
+
+        uint32_t cp;
+        i += decode_utf8(s + i, len - i, &cp);
+        if (cp >= 0x10000) {
+            cp -= 0x10000;
+            dst[j++] = 0xD800 | (cp >> 10);
+            dst[j++] = 0xDC00 | (cp & 0x3FF);
+        } else {
+            dst[j++] = cp;
+        }
+    }
+    return j;
+}
+
+// convert len units of utf16 to utf8, dst must have room for
+// UTF8_MAX_LEN(len) bytes, return the number of bytes written
+size_t utf16_to_utf8(char *dst, const uint16_t *src, size_t len) {
+    unsigned char *d = (unsigned char *)dst;
+    size_t i = 0, j = 0;
+
+    while (i < len) {
+        size_t n = ascii_to_utf8(dst + j, src + i, len - i);
+        i += n, j += n;
+        if (i >= len) break;
+
+        uint32_t cp = src[i++];
+        if (cp >= 0xD800 && cp <= 0xDBFF && i < len && src[i] >= 0xDC00 &&
+            src[i] <= 0xDFFF) {
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (src[i++] - 0xDC00);
+        } else if (cp >= 0xD800 && cp <= 0xDFFF) {
+            cp = REPLACEMENT_CHAR;
+        }
+
+        if (cp < 0x800) {
+            d[j++] = 0xC0 | (cp >> 6);
+        } else if (cp < 0x10000) {
+            d[j++] = 0xE0 | (cp >> 12);
+            d[j++] = 0x80 | ((cp >> 6) & 0x3F);
+        } else {
+            d[j++] = 0xF0 | (cp >> 18);
+            d[j++] = 0x80 | ((cp >> 12) & 0x3F);
+            d[j++] = 0x80 | ((cp >> 6) & 0x3F);
+        }
+        d[j++] = 0x80 | (cp & 0x3F);
+    }
+    return j;
+}
@@ -0,0 +1,18 @@
+// Copyright (c) 2023-2024 tsl0922. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+#ifndef MPV_PLUGIN_UTF_H
+#define MPV_PLUGIN_UTF_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// max utf16 units needed for len bytes of utf8
+#define UTF16_MAX_LEN(len) (len)
+// max utf8 bytes needed for len units of utf16
+#define UTF8_MAX_LEN(len) ((len) * 3)
+
+size_t utf8_to_utf16(uint16_t *dst, const char *src, size_t len);
+size_t utf16_to_utf8(char *dst, const uint16_t *src, size_t len);
+
+#endif
@@ -0,0 +1,258 @@
+// Copyright (c) 2023-2024 tsl0922. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+#include <windows.h>
+#include <objbase.h>
+#include "mpv_talloc.h"
+#include "backend.h"
+#include "menu.h"
+#include "stats.h"
+#include "utf.h"
+#include "win32.h"
+
+// custom window messages
+#define WM_SHOWMENU (WM_USER + 1)
+#define WM_UPDATEMENU (WM_USER + 2)
+
+// plugin context of the window procedure
+static plugin_ctx *wnd_ctx = NULL;
+
+// insert menu item to HMENU at position
+static bool insert_menu(HMENU hmenu, int pos, UINT id, UINT fMask, UINT fType,
+                        UINT fState, wchar_t *title, HMENU submenu) {
+    MENUITEMINFOW mii = {0};
+
+    mii.cbSize = sizeof(mii);
+    mii.fMask = MIIM_ID | fMask;
+    mii.wID = id;
+
+    if (fMask & MIIM_FTYPE) mii.fType = fType;
+    if (fMask & MIIM_STATE) mii.fState = fState;
+    if (fMask & MIIM_STRING) {
+        mii.dwTypeData = title;
+        mii.cch = wcslen(title);
+    }
+    if (fMask & MIIM_SUBMENU) mii.hSubMenu = submenu;
+
+    return InsertMenuItemW(hmenu, pos, TRUE, &mii);
+}
+
+// build fState for menu item creation
+static UINT build_state(int flags) {
+    UINT fState = 0;
+    if (flags & MENU_CHECKED) fState |= MFS_CHECKED;
+    if (flags & (MENU_DISABLED | MENU_EMPTY)) fState |= MFS_DISABLED;
+    return fState;
+}
+
+// convert menu label to wide string, the buffer is shared by all items
+// and is valid until the next call
+static wchar_t *build_title(plugin_ctx *ctx, menu_model *m, int item) {
+    struct backend *b = ctx->backend;
+    const char *label = model_str(m, m->label[item]);
+    size_t len = strlen(label);
+    MP_TARRAY_GROW(b, b->title_buf, UTF16_MAX_LEN(len));
+    b->title_buf[utf8_to_utf16((uint16_t *)b->title_buf, label, len)] = 0;
+    return b->title_buf;
+}
+
+// diff_ops.insert: create native menu item
+static void diff_insert(void *data, menu_model *m, int parent, int pos,
+                        int item) {
+    plugin_ctx *ctx = data;
+    HMENU hmenu = m->handle[parent];
+    UINT id = idmap_alloc(ctx->idmap, item);
+    bool ok;
+
+    if (m->type[item] == MENU_SEPARATOR) {
+        ok = insert_menu(hmenu, pos, id, MIIM_FTYPE, MFT_SEPARATOR, 0, NULL,
+                         NULL);
+    } else {
+        UINT fMask = MIIM_STRING | MIIM_STATE;
+        if (m->type[item] == MENU_SUBMENU) {
+            // keep the item id in submenu, used by load_menu() to find it
+            MENUINFO mi = {0};
+            mi.cbSize = sizeof(mi);
+            mi.fMask = MIM_MENUDATA;
+            mi.dwMenuData = id;
+
+            m->handle[item] = CreatePopupMenu();
+            SetMenuInfo(m->handle[item], &mi);
+            fMask |= MIIM_SUBMENU;
+        }
+        ok = insert_menu(hmenu, pos, id, fMask, 0, build_state(m->flags[item]),
+                         build_title(ctx, m, item), m->handle[item]);
+    }
+
+    if (!ok) {
+        idmap_free(ctx->idmap, id);
+        id = 0;
+    }
+    m->id[item] = id;
+}
+
+// diff_ops.remove: delete native menu item, this destroys the submenu too
+static void diff_remove(void *data, menu_model *m, int parent, int pos,
+                        int item) {
+    free_menu_ids(data, m, item);
+    DeleteMenu(m->handle[parent], pos, MF_BYPOSITION);
+}
+
+// diff_ops.update: update title or state of native menu item
+static void diff_update(void *data, menu_model *m, int parent, int pos,
+                        int item, int changes) {
+    MENUITEMINFOW mii = {0};
+
+    mii.cbSize = sizeof(mii);
+    if (changes & DIFF_TITLE) {
+        wchar_t *title = build_title(data, m, item);
+        mii.fMask |= MIIM_STRING;
+        mii.dwTypeData = title;
+        mii.cch = wcslen(title);
+    }
+    if (changes & DIFF_FLAGS) {
+        mii.fMask |= MIIM_STATE;
+        mii.fState = build_state(m->flags[item]);
+    }
+    SetMenuItemInfoW(m->handle[parent], pos, TRUE, &mii);
+}
+
+static const struct diff_ops menu_diff_ops = {
+    .insert = diff_insert,
+    .remove = diff_remove,
+    .update = diff_update,
+};
+
+// create native menu on first use, so it's not created before the window,
+// and attach it to the root of current model
+static void create_menu(plugin_ctx *ctx) {
+    struct backend *b = ctx->backend;
+    if (b->hmenu) return;
+
+    b->hmenu = CreatePopupMenu();
+    atomic_load(&ctx->model)->handle[0] = b->hmenu;
+    atomic_store(&ctx->stats->native_menu_ns,
+                 mpv_get_time_ns(ctx->mpv) - ctx->stats->startup);
+}
+
+// apply the published menu model to HMENU
+static void update_menu_native(plugin_ctx *ctx) {
+    if (ctx->menu_open) return;
+    create_menu(ctx);
+    apply_menu(ctx, &menu_diff_ops);
+}
+
+// create submenu items when the submenu is about to open
+static void load_menu(plugin_ctx *ctx, HMENU hmenu) {
+    MENUINFO mi = {0};
+    mi.cbSize = sizeof(mi);
+    mi.fMask = MIM_MENUDATA;
+    if (!GetMenuInfo(hmenu, &mi) || mi.dwMenuData == 0) return;
+
+    menu_model *m = atomic_load(&ctx->model);
+    int i = idmap_get(ctx->idmap, mi.dwMenuData, idmap_gen(ctx->idmap));
+    if (i <= 0 || i >= m->num_items || m->handle[i] != hmenu) return;
+
+    menu_load(m, i, &menu_diff_ops, ctx);
+}
+
+// show menu at position if it is in window
+static void show_menu(plugin_ctx *ctx, POINT *pt) {
+    struct backend *b = ctx->backend;
+    RECT rc;
+    GetClientRect(b->hwnd, &rc);
+    ScreenToClient(b->hwnd, pt);
+    if (!PtInRect(&rc, *pt)) return;
+
+    // the update message may be still queued, the menu is created here if
+    // it's the first show
+    update_menu_native(ctx);
+
+    // the clicked item is returned instead of posting WM_COMMAND, so it's
+    // handled before the menu model published while it's shown is applied
+    ClientToScreen(b->hwnd, pt);
+    open_menu(ctx);
+    UINT id = TrackPopupMenuEx(b->hmenu,
+                               TPM_LEFTALIGN | TPM_LEFTBUTTON | TPM_RETURNCMD,
+                               pt->x, pt->y, b->hwnd, NULL);
+    close_menu(ctx, &menu_diff_ops, id);
+}
+
+// handle window messages
+static LRESULT CALLBACK WndProc(HWND hWnd, UINT uMsg, WPARAM wParam,
+                                LPARAM lParam) {
+    plugin_ctx *ctx = wnd_ctx;
+    POINT pt;
+
+    switch (uMsg) {
+        case WM_SHOWMENU:
+            if (GetCursorPos(&pt)) show_menu(ctx, &pt);
+            break;
+        case WM_UPDATEMENU:
+            update_menu_native(ctx);
+            break;
+        case WM_INITMENUPOPUP:
+            load_menu(ctx, (HMENU)wParam);
+            break;
+        default:
+            break;
+    }
+
+    return CallWindowProcW(ctx->backend->wnd_proc, hWnd, uMsg, wParam, lParam);
+}
+
+void backend_init(plugin_ctx *ctx) {
+    wnd_ctx = ctx;
+    ctx->backend = talloc_zero(ctx, struct backend);
+}
+
+void backend_uninit(plugin_ctx *ctx) {
+    struct backend *b = ctx->backend;
+    if (b->hmenu) DestroyMenu(b->hmenu);
+    if (b->hwnd && b->wnd_proc)
+        SetWindowLongPtrW(b->hwnd, GWLP_WNDPROC, (LONG_PTR)b->wnd_proc);
+}
+
+// register window procedure, the native menu is created by it
+void backend_attach(plugin_ctx *ctx, int64_t wid) {
+    struct backend *b = ctx->backend;
+    b->hwnd = (HWND)wid;
+    b->wnd_proc =
+        (WNDPROC)SetWindowLongPtrW(b->hwnd, GWLP_WNDPROC, (LONG_PTR)WndProc);
+
+    // create native menu, and apply the menu model published before the
+    // window is created
+    PostMessageW(b->hwnd, WM_UPDATEMENU, 0, 0);
+}
+
+void backend_update(plugin_ctx *ctx) {
+    if (ctx->backend->hwnd)
+        PostMessageW(ctx->backend->hwnd, WM_UPDATEMENU, 0, 0);
+}
+
+void backend_show(plugin_ctx *ctx) {
+    PostMessageW(ctx->backend->hwnd, WM_SHOWMENU, 0, 0);
+}
+
+// dialogs are COM objects, initialized on the thread showing them
+void backend_thread_init(void) {
+    CoInitializeEx(NULL, COINIT_APARTMENTTHREADED);
+}
+
+void backend_thread_uninit(void) { CoUninitialize(); }
+
+// convert utf8 string to wchar_t
+wchar_t *mp_from_utf8(void *talloc_ctx, const char *s) {
+    size_t len = strlen(s);
+    wchar_t *ret = talloc_array(talloc_ctx, wchar_t, UTF16_MAX_LEN(len) + 1);
+    ret[utf8_to_utf16((uint16_t *)ret, s, len)] = L'\0';
+    return ret;
+}
+
+// convert wchar_t string to utf8
+char *mp_to_utf8(void *talloc_ctx, const wchar_t *s) {
+    size_t len = wcslen(s);
+    char *ret = talloc_array(talloc_ctx, char, UTF8_MAX_LEN(len) + 1);
+    ret[utf16_to_utf8(ret, (const uint16_t *)s, len)] = '\0';
+    return ret;
+}
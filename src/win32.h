@@ -0,0 +1,21 @@
+// Copyright (c) 2023-2024 tsl0922. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+#ifndef MPV_PLUGIN_WIN32_H
+#define MPV_PLUGIN_WIN32_H
+
+#include <windows.h>
+#include "plugin.h"
+
+// win32 backend state
+struct backend {
+    HWND hwnd;           // window handle
+    HMENU hmenu;         // native menu handle
+    WNDPROC wnd_proc;    // previous window procedure
+    wchar_t *title_buf;  // menu title conversion buffer
+};
+
+wchar_t *mp_from_utf8(void *talloc_ctx, const char *s);
+char *mp_to_utf8(void *talloc_ctx, const wchar_t *s);
+
+#endif
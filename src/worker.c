@@ -0,0 +1,117 @@
+// Copyright (c) 2023-2024 tsl0922. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+#include <math.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include "osdep/threads.h"
+#include "mpv_talloc.h"
+#include "worker.h"
+
+struct worker {
+    mp_dispatch_queue *queue;        // requests, processed by the thread
+    mp_dispatch_queue *reply_queue;  // replies, processed by the caller
+    void (*thread_init)(void);       // called on the thread before requests
+    void (*thread_uninit)(void);     // called on the thread before exit
+
+    mp_thread thread;
+    bool running;             // thread is started
+    atomic_bool terminate;    // thread should exit, queued requests are dropped
+    atomic_int pending;       // requests queued or running
+};
+
+struct request {
+    worker *w;
+    worker_fn run;
+    worker_fn reply;
+    void *data;  // talloc child of the request
+};
+
+static MP_THREAD_VOID worker_thread(void *arg) {
+    worker *w = arg;
+    mp_thread_set_name("menu/worker");
+
+    if (w->thread_init) w->thread_init();
+    while (!atomic_load(&w->terminate))
+        mp_dispatch_queue_process(w->queue, INFINITY);
+    if (w->thread_uninit) w->thread_uninit();
+
+    MP_THREAD_RETURN();
+}
+
+// run on reply queue, the worker may be freed already
+static void reply_fn(void *arg) {
+    struct request *req = arg;
+    if (req->reply) req->reply(req->data);
+    talloc_free(req);
+}
+
+// run on worker thread
+static void run_fn(void *arg) {
+    struct request *req = arg;
+    worker *w = req->w;
+
+    if (atomic_load(&w->terminate)) {
+        talloc_free(req);
+    } else {
+        req->run(req->data);
+        mp_dispatch_enqueue(w->reply_queue, reply_fn, req);
+    }
+    atomic_fetch_sub(&w->pending, 1);
+}
+
+// wakes up the worker thread, so it sees the terminate flag
+static void wakeup_fn(void *arg) {}
+
+static void worker_destroy(void *ptr) {
+    worker *w = ptr;
+    if (!w->running) return;
+
+    atomic_store(&w->terminate, true);
+    mp_dispatch_enqueue(w->queue, wakeup_fn, NULL);
+    mp_thread_join(w->thread);
+
+    // the thread may exit with requests queued, run_fn() frees them
+    mp_dispatch_queue_process(w->queue, 0);
+}
+
+// create worker, replies are enqueued to reply_queue
+worker *worker_create(void *talloc_ctx, mp_dispatch_queue *reply_queue,
+                      void (*thread_init)(void), void (*thread_uninit)(void)) {
+    worker *w = talloc_zero(talloc_ctx, worker);
+    w->queue = mp_dispatch_create(w);
+    w->reply_queue = reply_queue;
+    w->thread_init = thread_init;
+    w->thread_uninit = thread_uninit;
+    atomic_init(&w->terminate, false);
+    atomic_init(&w->pending, 0);
+    talloc_set_destructor(w, worker_destroy);
+    return w;
+}
+
+// run request on worker thread, then its reply on reply queue
+//
+// data must be a talloc allocation, it's owned by the worker and freed after
+// the reply. reply may be NULL.
+void worker_submit(worker *w, worker_fn run, worker_fn reply, void *data) {
+    if (!w->running) {
+        if (mp_thread_create(&w->thread, worker_thread, w) != 0) {
+            // run inline, it's better to block than to lose the request
+            run(data);
+            if (reply) reply(data);
+            talloc_free(data);
+            return;
+        }
+        w->running = true;
+    }
+
+    struct request *req = talloc_ptrtype(NULL, req);
+    *req = (struct request){.w = w, .run = run, .reply = reply};
+    req->data = talloc_steal(req, data);
+
+    atomic_fetch_add(&w->pending, 1);
+    mp_dispatch_enqueue(w->queue, run_fn, req);
+}
+
+// number of requests queued or running
+int worker_pending(worker *w) { return atomic_load(&w->pending); }
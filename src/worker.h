@@ -0,0 +1,28 @@
+// Copyright (c) 2023-2024 tsl0922. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+#ifndef MPV_PLUGIN_WORKER_H
+#define MPV_PLUGIN_WORKER_H
+
+#include "misc/dispatch.h"
+
+// worker thread of blocking requests, such as modal dialogs
+//
+// requests run in submission order on the worker thread, and their replies
+// run on the reply queue, so the thread processing the reply queue is never
+// blocked by a request. the thread is started by the first request.
+//
+// worker_submit() and freeing the worker must be called by one thread,
+// freeing the worker waits for the running request, the queued ones are
+// dropped without reply.
+typedef struct worker worker;
+
+// request or reply callback, data is the submitted request data
+typedef void (*worker_fn)(void *data);
+
+worker *worker_create(void *talloc_ctx, mp_dispatch_queue *reply_queue,
+                      void (*thread_init)(void), void (*thread_uninit)(void));
+void worker_submit(worker *w, worker_fn run, worker_fn reply, void *data);
+int worker_pending(worker *w);
+
+#endif
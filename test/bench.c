@@ -0,0 +1,711 @@
+// Copyright (c) 2023-2024 tsl0922. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+// dispatch queue benchmarks, run against src/mpv/misc/dispatch.c
+//
+// usage: bench-dispatch [-q] [name...]
+//
+// -q runs a quick pass with few items, as a smoke test. names select the
+// benchmarks to run, all are run by default. producer benchmarks run with
+// 1, 2, 4... up to N producer threads, N is the CPU count, at most 16, the
+// result lines are labeled with the producer count.
+//
+// latency percentiles are exact, every sample is kept. the
+// bench-dispatch-trace build also reports the latency and queue depth
+// recorded by the queue itself.
+
+#include <sched.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include "mpv_talloc.h"
+#include "misc/dispatch.h"
+#include "osdep/threads.h"
+#include "osdep/timer.h"
+#include "bench.h"
+
+#define MAX_PRODUCERS 16
+
+static int num_items;      // items of each benchmark run
+static int max_producers;  // producer threads of the largest run
+
+static void samples_merge(struct samples *dst, struct samples *src) {
+    for (int i = 0; i < src->num; i++) samples_add(dst, src->values[i]);
+    TA_FREEP(&src->values);
+    src->num = 0;
+}
+
+// target thread, runs the queue until it's stopped
+struct target {
+    mp_dispatch_queue *queue;
+    mp_thread thread;
+    atomic_bool stop;
+#if MP_DISPATCH_TRACE
+    struct samples trace;  // enqueue to run latency, recorded by the queue
+    int max_depth;         // most items queued
+#endif
+};
+
+#if MP_DISPATCH_TRACE
+static void trace_item(void *ctx, int64_t latency, int depth) {
+    struct target *t = ctx;
+    samples_add(&t->trace, latency);
+    if (depth > t->max_depth) t->max_depth = depth;
+}
+#endif
+
+// the timeout is long, so a missed wakeup shows up as a latency spike
+static MP_THREAD_VOID target_thread(void *arg) {
+    struct target *t = arg;
+    mp_thread_set_name("bench/target");
+    while (!atomic_load(&t->stop)) mp_dispatch_queue_process(t->queue, 1.0);
+    MP_THREAD_RETURN();
+}
+
+static void target_start(struct target *t) {
+    *t = (struct target){.queue = mp_dispatch_create(NULL)};
+    atomic_init(&t->stop, false);
+#if MP_DISPATCH_TRACE
+    mp_dispatch_set_trace_fn(t->queue, trace_item, t);
+#endif
+    check(mp_thread_create(&t->thread, target_thread, t) == 0);
+}
+
+struct signal {
+    mp_mutex lock;
+    mp_cond cond;
+    bool done;
+};
+
+static void signal_fn(void *data) {
+    struct signal *s = *(struct signal **)data;
+    mp_mutex_lock(&s->lock);
+    s->done = true;
+    mp_cond_broadcast(&s->cond);
+    mp_mutex_unlock(&s->lock);
+}
+
+// wait until the items queued in lane so far are run
+static void drain(mp_dispatch_queue *queue, enum mp_dispatch_lane lane) {
+    struct signal s = {0}, *p = &s;
+    mp_mutex_init(&s.lock);
+    mp_cond_init(&s.cond);
+    mp_dispatch_enqueue_copy(queue, lane, signal_fn, &p, sizeof(p));
+    mp_mutex_lock(&s.lock);
+    while (!s.done) mp_cond_wait(&s.cond, &s.lock);
+    mp_mutex_unlock(&s.lock);
+    mp_cond_destroy(&s.cond);
+    mp_mutex_destroy(&s.lock);
+}
+
+static void nop_fn(void *data) {}
+
+static void report(const char *name, int producers, int64_t count,
+                   int64_t elapsed, struct samples *s) {
+    char label[32], rate[32];
+    snprintf(label, sizeof(label), "%s/%d", name, producers);
+    snprintf(rate, sizeof(rate), "%.0f/s", count * 1e9 / elapsed);
+    print_line(label, rate, s);
+}
+
+// report the samples recorded by the queue, if any
+#if MP_DISPATCH_TRACE
+static void report_trace(struct target *t) {
+    if (t->trace.num == 0) return;
+    char depth[32];
+    snprintf(depth, sizeof(depth), "depth %d", t->max_depth);
+    print_line("  trace", depth, &t->trace);
+}
+#else
+static void report_trace(struct target *t) {}
+#endif
+
+// stop the target thread, run the items left, and report the samples
+// recorded by the queue
+static void target_stop(struct target *t) {
+    atomic_store(&t->stop, true);
+    mp_dispatch_interrupt(t->queue);
+    mp_thread_join(t->thread);
+    mp_dispatch_queue_process(t->queue, 0);
+    talloc_free(t->queue);
+    report_trace(t);
+#if MP_DISPATCH_TRACE
+    talloc_free(t->trace.values);
+#endif
+}
+
+// producer threads of a benchmark run, started together
+struct producers {
+    struct target *target;
+    int items;  // items of each producer
+    atomic_int ready;
+    atomic_bool go;
+    struct producer {
+        struct producers *all;
+        mp_thread thread;
+        struct samples latency;  // measured by the producer, if any
+    } threads[MAX_PRODUCERS];
+};
+
+// wait until every producer is started, so they run concurrently
+static void producer_wait(struct producers *p) {
+    atomic_fetch_add(&p->ready, 1);
+    while (!atomic_load(&p->go)) {
+    }
+}
+
+// run num producers of fn, and return the elapsed time from the start of
+// the first one to the end of the last one
+static int64_t run_producers(struct producers *p, int num,
+                             MP_THREAD_VOID (*fn)(void *arg)) {
+    p->items = num_items / num;
+    atomic_init(&p->ready, 0);
+    atomic_init(&p->go, false);
+    for (int i = 0; i < num; i++) {
+        p->threads[i] = (struct producer){.all = p};
+        check(mp_thread_create(&p->threads[i].thread, fn, &p->threads[i]) ==
+              0);
+    }
+    while (atomic_load(&p->ready) < num) {
+    }
+
+    int64_t start = mp_time_ns();
+    atomic_store(&p->go, true);
+    for (int i = 0; i < num; i++) mp_thread_join(p->threads[i].thread);
+    return mp_time_ns() - start;
+}
+
+// throughput: producers enqueue stamped items, the target thread records
+// the enqueue to run latency
+
+struct stamp {
+    struct samples *latency;  // written by the target thread only
+    int64_t queued;
+};
+
+static void stamp_fn(void *data) {
+    struct stamp *s = data;
+    samples_add(s->latency, mp_time_ns() - s->queued);
+}
+
+static struct samples stamp_latency;
+
+static MP_THREAD_VOID throughput_producer(void *arg) {
+    struct producer *self = arg;
+    struct producers *p = self->all;
+    producer_wait(p);
+    for (int i = 0; i < p->items; i++) {
+        struct stamp s = {&stamp_latency, mp_time_ns()};
+        mp_dispatch_enqueue_copy(p->target->queue, MP_DISPATCH_BACKGROUND,
+                                 stamp_fn, &s, sizeof(s));
+    }
+    MP_THREAD_RETURN();
+}
+
+static void bench_throughput(void) {
+    for (int n = 1; n <= max_producers; n *= 2) {
+        struct target t;
+        struct producers p = {.target = &t};
+        target_start(&t);
+
+        int64_t elapsed = run_producers(&p, n, throughput_producer);
+        int64_t start = mp_time_ns();
+        drain(t.queue, MP_DISPATCH_BACKGROUND);
+        elapsed += mp_time_ns() - start;
+
+        report("enqueue", n, stamp_latency.num, elapsed, &stamp_latency);
+        TA_FREEP(&stamp_latency.values);
+        stamp_latency.num = 0;
+        target_stop(&t);
+    }
+}
+
+// run producers that record their own latency, and report the merged
+// samples
+static void bench_producers(const char *name, MP_THREAD_VOID (*fn)(void *arg)) {
+    for (int n = 1; n <= max_producers; n *= 2) {
+        struct target t;
+        struct producers p = {.target = &t};
+        target_start(&t);
+
+        int64_t elapsed = run_producers(&p, n, fn);
+        struct samples latency = {0};
+        for (int i = 0; i < n; i++)
+            samples_merge(&latency, &p.threads[i].latency);
+
+        report(name, n, latency.num, elapsed, &latency);
+        talloc_free(latency.values);
+        target_stop(&t);
+    }
+}
+
+// inbox: producers enqueue while the target thread is busy running items,
+// and record the time of each enqueue. the items are pushed to the inbox
+// without the queue lock, which is only taken to wake up an idle target.
+// producers wait while INBOX_QUEUED items are queued, so the target stays
+// busy without an unbounded backlog.
+
+#define INBOX_QUEUED 1024
+
+static atomic_int inbox_queued;
+
+static void busy_fn(void *data) {
+    int64_t until = mp_time_ns() + 100;
+    while (mp_time_ns() < until) {
+    }
+    atomic_fetch_sub(&inbox_queued, 1);
+}
+
+static MP_THREAD_VOID inbox_producer(void *arg) {
+    struct producer *self = arg;
+    struct producers *p = self->all;
+    producer_wait(p);
+    for (int i = 0; i < p->items; i++) {
+        while (atomic_load(&inbox_queued) >= INBOX_QUEUED) {
+        }
+        atomic_fetch_add(&inbox_queued, 1);
+        int64_t start = mp_time_ns();
+        mp_dispatch_enqueue(p->target->queue, busy_fn, NULL);
+        samples_add(&self->latency, mp_time_ns() - start);
+    }
+    MP_THREAD_RETURN();
+}
+
+static void bench_inbox(void) { bench_producers("inbox", inbox_producer); }
+
+// alloc: memory allocations of each enqueue in steady state, counted by
+// the wrapped malloc functions. rounds of ALLOC_ROUND items are queued and
+// then run by the same thread, so the item pool is never locked by another
+// thread, and the items are back in the pool before the next round. the
+// first rounds fill the pool, they're not counted.
+
+#define ALLOC_ROUND 32
+#define ALLOC_WARMUP 2
+
+#if HAVE_MALLOC_WRAP
+static atomic_llong num_allocs;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t num, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size) {
+    atomic_fetch_add_explicit(&num_allocs, 1, memory_order_relaxed);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t num, size_t size) {
+    atomic_fetch_add_explicit(&num_allocs, 1, memory_order_relaxed);
+    return __real_calloc(num, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    atomic_fetch_add_explicit(&num_allocs, 1, memory_order_relaxed);
+    return __real_realloc(ptr, size);
+}
+
+static void bench_alloc(void) {
+    static const char *names[] = {"alloc/plain", "alloc/copy", "alloc/notify"};
+    for (int kind = 0; kind < 3; kind++) {
+        mp_dispatch_queue *queue = mp_dispatch_create(NULL);
+        char keys[ALLOC_ROUND];  // fn_data of the notify items
+        char payload[MP_DISPATCH_INLINE_SIZE] = {0};
+        int rounds = num_items / ALLOC_ROUND;
+        long long allocs = 0;
+        int64_t start = 0;
+
+        for (int r = 0; r < ALLOC_WARMUP + rounds; r++) {
+            if (r == ALLOC_WARMUP) {
+                allocs = atomic_load(&num_allocs);
+                start = mp_time_ns();
+            }
+            for (int i = 0; i < ALLOC_ROUND; i++) {
+                if (kind == 0) {
+                    mp_dispatch_enqueue(queue, nop_fn, NULL);
+                } else if (kind == 1) {
+                    mp_dispatch_enqueue_copy(queue, MP_DISPATCH_BACKGROUND,
+                                             nop_fn, payload, sizeof(payload));
+                } else {
+                    mp_dispatch_enqueue_notify(queue, nop_fn, keys + i);
+                }
+            }
+            mp_dispatch_queue_process(queue, 0);
+        }
+        int64_t elapsed = mp_time_ns() - start;
+        allocs = atomic_load(&num_allocs) - allocs;
+        talloc_free(queue);
+
+        int64_t count = (int64_t)rounds * ALLOC_ROUND;
+        char rate[32];
+        snprintf(rate, sizeof(rate), "%.0f/s", count * 1e9 / elapsed);
+        printf("%-18s %16s  %.3f allocs/item\n", names[kind], rate,
+               (double)allocs / count);
+        check_int(allocs, 0);
+    }
+}
+#else
+static void bench_alloc(void) {
+    printf("%-18s %16s\n", "alloc", "no malloc wrap");
+}
+#endif
+
+// merge: mp_dispatch_enqueue_notify() with 1000 to 16000 pending items,
+// the target thread is locked, so nothing is run. every call duplicates a
+// random pending item, which is found in the merge index and dropped. the
+// line is labeled with the pending item count.
+
+static int merge_runs;  // target thread only
+
+static void merge_fn(void *data) { merge_runs++; }
+
+static void bench_merge(void) {
+    for (int pending = 1000; pending <= 16000; pending *= 4) {
+        struct target t;
+        target_start(&t);
+        char *keys = talloc_size(NULL, pending);  // fn_data of the items
+        struct samples latency = {0};
+        uint64_t seed = 1;
+        merge_runs = 0;
+
+        mp_dispatch_lock(t.queue);
+        for (int i = 0; i < pending; i++)
+            mp_dispatch_enqueue_notify(t.queue, merge_fn, keys + i);
+        int64_t elapsed = 0;
+        for (int i = 0; i < num_items / 10; i++) {
+            char *key = keys + test_rand_n(&seed, pending);
+            int64_t start = mp_time_ns();
+            mp_dispatch_enqueue_notify(t.queue, merge_fn, key);
+            int64_t end = mp_time_ns();
+            samples_add(&latency, end - start);
+            elapsed += end - start;
+        }
+        mp_dispatch_unlock(t.queue);
+        drain(t.queue, MP_DISPATCH_BACKGROUND);
+        check_int(merge_runs, pending);
+
+        report("merge", pending, latency.num, elapsed, &latency);
+        talloc_free(latency.values);
+        talloc_free(keys);
+        target_stop(&t);
+    }
+}
+
+// lanes: a producer keeps LANE_LOAD background items queued, each running
+// for 1us, while probe items are enqueued one at a time, and their enqueue
+// to run latency is recorded. interactive probes only wait for the running
+// item, background probes wait behind the whole backlog. the line is
+// labeled with the lane of the probes, the rate is the background items
+// run meanwhile, which must make progress either way.
+
+#define LANE_LOAD 1000
+
+static atomic_int lane_queued;
+static atomic_bool lane_stop;
+static atomic_llong lane_runs;
+
+static void load_fn(void *data) {
+    int64_t until = mp_time_ns() + 1000;
+    while (mp_time_ns() < until) {
+    }
+    atomic_fetch_sub(&lane_queued, 1);
+    atomic_fetch_add(&lane_runs, 1);
+}
+
+static MP_THREAD_VOID load_producer(void *arg) {
+    mp_dispatch_queue *queue = arg;
+    while (!atomic_load(&lane_stop)) {
+        if (atomic_load(&lane_queued) >= LANE_LOAD) {
+            sched_yield();
+            continue;
+        }
+        atomic_fetch_add(&lane_queued, 1);
+        mp_dispatch_enqueue(queue, load_fn, NULL);
+    }
+    MP_THREAD_RETURN();
+}
+
+static void bench_lanes(void) {
+    static const char *names[] = {"lanes/interactive", "lanes/background"};
+    for (int lane = 0; lane < MP_DISPATCH_LANES; lane++) {
+        struct target t;
+        target_start(&t);
+        atomic_init(&lane_queued, 0);
+        atomic_init(&lane_stop, false);
+        mp_thread load;
+        check(mp_thread_create(&load, load_producer, t.queue) == 0);
+        while (atomic_load(&lane_queued) < LANE_LOAD) sched_yield();
+
+        // the probes are run one at a time, the signal item after each one
+        // is run right after it
+        struct samples latency = {0};
+        drain(t.queue, MP_DISPATCH_INTERACTIVE);
+        int64_t runs = atomic_load(&lane_runs), start = mp_time_ns();
+        for (int i = 0; i < num_items / 1000; i++) {
+            struct stamp s = {&latency, mp_time_ns()};
+            mp_dispatch_enqueue_copy(t.queue, lane, stamp_fn, &s, sizeof(s));
+            drain(t.queue, lane);
+        }
+        int64_t elapsed = mp_time_ns() - start;
+        runs = atomic_load(&lane_runs) - runs;
+        check(runs > 0);
+
+        atomic_store(&lane_stop, true);
+        mp_thread_join(load);
+        char rate[32];
+        snprintf(rate, sizeof(rate), "bg %.0f/s", runs * 1e9 / elapsed);
+        print_line(names[lane], rate, &latency);
+        talloc_free(latency.values);
+        target_stop(&t);
+    }
+}
+
+// batch: one producer submits groups of 1 to 64 callbacks, with one
+// mp_dispatch_enqueue_batch() call, or with one mp_dispatch_enqueue() call
+// per callback. the line is labeled with the group size, the latency is
+// the time to submit a group, and the rate counts the callbacks run. the
+// callbacks check that they're run in submit order.
+
+static intptr_t batch_next;  // target thread only
+
+static void batch_fn(void *data) {
+    check_int((intptr_t)data, batch_next);
+    batch_next++;
+}
+
+static void bench_batch(void) {
+    for (int size = 1; size <= 64; size *= 8) {
+        for (int batched = 0; batched < 2; batched++) {
+            struct target t;
+            target_start(&t);
+            struct mp_dispatch_call calls[64];
+            struct samples latency = {0};
+            intptr_t seq = 0;
+            batch_next = 0;
+
+            int64_t start = mp_time_ns();
+            for (int i = 0; i < num_items / size; i++) {
+                for (int k = 0; k < size; k++)
+                    calls[k] =
+                        (struct mp_dispatch_call){batch_fn, (void *)seq++};
+                int64_t submit = mp_time_ns();
+                if (batched) {
+                    mp_dispatch_enqueue_batch(t.queue, MP_DISPATCH_BACKGROUND,
+                                              calls, size);
+                } else {
+                    for (int k = 0; k < size; k++)
+                        mp_dispatch_enqueue(t.queue, calls[k].fn,
+                                            calls[k].fn_data);
+                }
+                samples_add(&latency, mp_time_ns() - submit);
+            }
+            drain(t.queue, MP_DISPATCH_BACKGROUND);
+            int64_t elapsed = mp_time_ns() - start;
+            check_int(batch_next, seq);
+
+            report(batched ? "batch" : "single", size, seq, elapsed,
+                   &latency);
+            talloc_free(latency.values);
+            target_stop(&t);
+        }
+    }
+}
+
+// timers: delayed items must run in deadline order, then in enqueue order,
+// never before their deadline and at most TIMER_LATE_MAX after it, which is
+// generous, but much less than the target thread timeout, so a missed
+// wakeup fails. cancelled items must not run. the latency is how late the
+// items ran. then mp_dispatch_enqueue_at() and mp_dispatch_cancel_fn() are
+// timed with many pending items, the target thread is locked, so none of
+// them runs, and the line is labeled with the pending item count.
+
+#define TIMER_COUNT 200
+#define TIMER_LATE_MAX 250000000  // 250ms
+#define TIMER_CANCELS 100
+
+struct timer {
+    int64_t deadline;  // the earliest time it may run
+    int seq;           // enqueue order
+    bool cancel;
+    int64_t ran;  // run time, 0 if it hasn't run
+};
+
+static struct timer *timer_runs[TIMER_COUNT];  // in run order
+static atomic_int timer_num_runs;
+
+static void timer_fn(void *data) {
+    struct timer *t = data;
+    t->ran = mp_time_ns();
+    timer_runs[atomic_load(&timer_num_runs)] = t;
+    atomic_fetch_add(&timer_num_runs, 1);
+}
+
+static void check_timers(void) {
+    struct target t;
+    target_start(&t);
+    struct timer timers[TIMER_COUNT] = {0};
+    uint64_t seed = 3;
+    int expected = 0;
+    atomic_init(&timer_num_runs, 0);
+
+    // deadlines are random, and many of them are equal. the last one is
+    // queued with mp_dispatch_enqueue_after(), its deadline is a lower
+    // bound, so it's not part of the order check.
+    mp_dispatch_lock(t.queue);
+    int64_t base = mp_time_ns() + 10000000;
+    for (int i = 0; i < TIMER_COUNT; i++) {
+        struct timer *timer = &timers[i];
+        timer->seq = i;
+        timer->cancel = test_rand_n(&seed, 4) == 0;
+        expected += !timer->cancel;
+        if (i == TIMER_COUNT - 1) {
+            timer->deadline = mp_time_ns() + 20000000;
+            mp_dispatch_enqueue_after(t.queue, 0.02, timer_fn, timer);
+        } else {
+            timer->deadline = base + test_rand_n(&seed, 20) * 1000000;
+            mp_dispatch_enqueue_at(t.queue, timer->deadline, timer_fn, timer);
+        }
+    }
+    for (int i = 0; i < TIMER_COUNT; i++) {
+        if (timers[i].cancel)
+            mp_dispatch_cancel_fn(t.queue, timer_fn, &timers[i]);
+    }
+    mp_dispatch_unlock(t.queue);
+
+    int64_t timeout = mp_time_ns() + 5000000000;
+    while (atomic_load(&timer_num_runs) < expected && mp_time_ns() < timeout)
+        usleep(1000);
+    target_stop(&t);
+    check_int(atomic_load(&timer_num_runs), expected);
+
+    struct samples latency = {0};
+    struct timer *prev = NULL;
+    for (int i = 0; i < expected; i++) {
+        struct timer *timer = timer_runs[i];
+        check(!timer->cancel);
+        check(timer->ran >= timer->deadline);
+        check(timer->ran - timer->deadline <= TIMER_LATE_MAX);
+        samples_add(&latency, timer->ran - timer->deadline);
+        if (timer->seq == TIMER_COUNT - 1) continue;
+        if (prev && prev->deadline == timer->deadline) {
+            check(prev->seq < timer->seq);
+        } else if (prev) {
+            check(prev->deadline < timer->deadline);
+        }
+        prev = timer;
+    }
+    for (int i = 0; i < TIMER_COUNT; i++)
+        check(timers[i].cancel == !timers[i].ran);
+
+    char count[32];
+    snprintf(count, sizeof(count), "%d ran", expected);
+    print_line("timers/late", count, &latency);
+    talloc_free(latency.values);
+}
+
+static void bench_timers(void) {
+    check_timers();
+
+    // far in the future, in random order
+    int pending = num_items / 10;
+    struct target t;
+    target_start(&t);
+    char *keys = talloc_size(NULL, pending);  // fn_data of the items
+    struct samples at = {0}, cancel = {0};
+    uint64_t seed = 5;
+    int64_t at_elapsed = 0, cancel_elapsed = 0;
+
+    mp_dispatch_lock(t.queue);
+    int64_t base = mp_time_ns() + 3600 * INT64_C(1000000000);
+    for (int i = 0; i < pending; i++) {
+        int64_t deadline = base + test_rand_n(&seed, 1000000) * 1000;
+        int64_t start = mp_time_ns();
+        mp_dispatch_enqueue_at(t.queue, deadline, nop_fn, keys + i);
+        int64_t end = mp_time_ns();
+        samples_add(&at, end - start);
+        at_elapsed += end - start;
+    }
+    for (int i = 0; i < TIMER_CANCELS; i++) {
+        int64_t start = mp_time_ns();
+        mp_dispatch_cancel_fn(t.queue, nop_fn, keys + i);
+        int64_t end = mp_time_ns();
+        samples_add(&cancel, end - start);
+        cancel_elapsed += end - start;
+    }
+    mp_dispatch_unlock(t.queue);
+
+    report("timers/at", pending, at.num, at_elapsed, &at);
+    report("timers/cancel", pending, cancel.num, cancel_elapsed, &cancel);
+    talloc_free(at.values);
+    talloc_free(cancel.values);
+    target_stop(&t);
+    talloc_free(keys);
+}
+
+// mp_dispatch_run(): producers run an empty callback synchronously, and
+// record the round trip time
+
+static MP_THREAD_VOID run_producer(void *arg) {
+    struct producer *self = arg;
+    struct producers *p = self->all;
+    int n = p->items / 10;  // a round trip is about 10 enqueues
+    producer_wait(p);
+    for (int i = 0; i < n; i++) {
+        int64_t start = mp_time_ns();
+        mp_dispatch_run(p->target->queue, nop_fn, NULL);
+        samples_add(&self->latency, mp_time_ns() - start);
+    }
+    MP_THREAD_RETURN();
+}
+
+// mp_dispatch_lock(): producers lock the target thread, and record the
+// time it takes to get the lock. the flag is set while the lock is held, so
+// it checks the mutual exclusion.
+
+static atomic_bool lock_held;
+
+static MP_THREAD_VOID lock_producer(void *arg) {
+    struct producer *self = arg;
+    struct producers *p = self->all;
+    int n = p->items / 10;
+    producer_wait(p);
+    for (int i = 0; i < n; i++) {
+        int64_t start = mp_time_ns();
+        mp_dispatch_lock(p->target->queue);
+        samples_add(&self->latency, mp_time_ns() - start);
+        check(!atomic_exchange(&lock_held, true));
+        atomic_store(&lock_held, false);
+        mp_dispatch_unlock(p->target->queue);
+    }
+    MP_THREAD_RETURN();
+}
+
+static void bench_run(void) { bench_producers("run", run_producer); }
+
+static void bench_lock(void) { bench_producers("lock", lock_producer); }
+
+static const struct bench {
+    const char *name;
+    void (*fn)(void);
+} benches[] = {
+    {"enqueue", bench_throughput},
+    {"run", bench_run},
+    {"lock", bench_lock},
+    {"inbox", bench_inbox},
+    {"alloc", bench_alloc},
+    {"merge", bench_merge},
+    {"lanes", bench_lanes},
+    {"batch", bench_batch},
+    {"timers", bench_timers},
+};
+
+int main(int argc, char **argv) {
+    bool quick = argc > 1 && strcmp(argv[1], "-q") == 0;
+    num_items = quick ? 20000 : 2000000;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    max_producers = quick ? 2 : MPCLAMP(cpus, 2, MAX_PRODUCERS);
+
+    printf("%-18s %16s\n", "benchmark", "rate");
+    int first = quick ? 2 : 1;
+    for (int i = 0; i < sizeof(benches) / sizeof(benches[0]); i++)
+        if (bench_selected(argc, argv, first, benches[i].name)) benches[i].fn();
+    return 0;
+}
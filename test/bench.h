@@ -0,0 +1,68 @@
+// Copyright (c) 2023-2024 tsl0922. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+#ifndef MPV_PLUGIN_TEST_BENCH_H
+#define MPV_PLUGIN_TEST_BENCH_H
+
+#include <stdbool.h>
+#include "mpv_talloc.h"
+#include "test.h"
+
+// benchmark helpers, a benchmark program takes -q for a quick pass, which
+// is run as a smoke test, and the names of the benchmarks to run
+
+// latency samples in nanoseconds
+struct samples {
+    int64_t *values;
+    int num;
+};
+
+static inline void samples_add(struct samples *s, int64_t value) {
+    MP_TARRAY_APPEND(NULL, s->values, s->num, value);
+}
+
+static inline int compare_int64(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// p-th percentile (0-100) of sorted samples
+static inline int64_t percentile(struct samples *s, double p) {
+    if (s->num == 0) return 0;
+    int i = (int)(s->num * p / 100.0);
+    return s->values[i < s->num ? i : s->num - 1];
+}
+
+static inline const char *format_ns(char *buf, int64_t ns) {
+    if (ns < 10000) {
+        snprintf(buf, 16, "%dns", (int)ns);
+    } else if (ns < 10000000) {
+        snprintf(buf, 16, "%.1fus", ns / 1e3);
+    } else {
+        snprintf(buf, 16, "%.1fms", ns / 1e6);
+    }
+    return buf;
+}
+
+// print a result line: count per second over elapsed time, and latency
+// percentiles, the samples are sorted
+static inline void print_line(const char *name, const char *rate,
+                              struct samples *s) {
+    char p50[16], p99[16], p999[16], max[16];
+    qsort(s->values, s->num, sizeof(int64_t), compare_int64);
+    printf("%-18s %16s  p50 %8s  p99 %8s  p999 %8s  max %8s\n", name, rate,
+           format_ns(p50, percentile(s, 50)), format_ns(p99, percentile(s, 99)),
+           format_ns(p999, percentile(s, 99.9)),
+           format_ns(max, percentile(s, 100)));
+}
+
+// benchmark is selected by the command line, first is the index of the
+// first name argument
+static inline bool bench_selected(int argc, char **argv, int first,
+                                  const char *name) {
+    bool selected = argc <= first;
+    for (int k = first; k < argc; k++) selected |= strcmp(argv[k], name) == 0;
+    return selected;
+}
+
+#endif
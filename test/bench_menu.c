@@ -0,0 +1,504 @@
+// Copyright (c) 2023-2024 tsl0922. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+// menu core benchmarks, single threaded
+//
+// usage: bench-menu [-q] [name...]
+//
+// -q runs a quick pass, as a smoke test. names select the benchmarks to
+// run, all are run by default. each benchmark checks its result against a
+// reference implementation first, then compares their speed. the latency
+// is the time per call, averaged over batches of calls.
+
+#include "osdep/timer.h"
+#include "diff.h"
+#include "hist.h"
+#include "json.h"
+#include "keys.h"
+#include "model.h"
+#include "patch.h"
+#include "router.h"
+#include "stub.h"
+#include "bench.h"
+
+static bool quick;         // quick pass
+static volatile int sink;  // keeps the benchmarked results alive
+
+// call fn for n runs in batches, and print the calls per second and the
+// time per call of each batch
+static void measure(const char *name, int n, int batch,
+                    void (*fn)(void *arg, int i), void *arg) {
+    struct samples s = {0};
+    int64_t start = mp_time_ns();
+    for (int i = 0; i < n; i += batch) {
+        int64_t t = mp_time_ns();
+        for (int k = i; k < i + batch; k++) fn(arg, k);
+        samples_add(&s, (mp_time_ns() - t) / batch);
+    }
+    int64_t elapsed = mp_time_ns() - start;
+
+    char rate[32];
+    snprintf(rate, sizeof(rate), "%.0f/s", n * 1e9 / elapsed);
+    print_line(name, rate, &s);
+    talloc_free(s.values);
+}
+
+// keys: node_key() against a strcmp() chain, on the keys and values of
+// typical menu data, and strings that are not keys
+
+static const struct {
+    const char *str;
+    enum node_key key;
+} known_keys[] = {
+    {"type", KEY_TYPE},
+    {"title", KEY_TITLE},
+    {"cmd", KEY_CMD},
+    {"shortcut", KEY_SHORTCUT},
+    {"state", KEY_STATE},
+    {"submenu", KEY_SUBMENU},
+    {"separator", KEY_SEPARATOR},
+    {"hidden", KEY_HIDDEN},
+    {"checked", KEY_CHECKED},
+    {"disabled", KEY_DISABLED},
+    {"op", KEY_OP},
+    {"path", KEY_PATH},
+    {"item", KEY_ITEM},
+    {"set-state", KEY_SET_STATE},
+    {"set-title", KEY_SET_TITLE},
+    {"replace-submenu", KEY_REPLACE_SUBMENU},
+    {"insert", KEY_INSERT},
+    {"remove", KEY_REMOVE},
+    {"name", KEY_NAME},
+    {"spec", KEY_SPEC},
+};
+
+#define NUM_KNOWN_KEYS (int)(sizeof(known_keys) / sizeof(known_keys[0]))
+
+static enum node_key strcmp_key(const char *s) {
+    for (int i = 0; i < NUM_KNOWN_KEYS; i++)
+        if (strcmp(s, known_keys[i].str) == 0) return known_keys[i].key;
+    return KEY_UNKNOWN;
+}
+
+// keys in menu data order, with a few strings that are not keys
+static const char *key_input[] = {
+    "title", "cmd",       "shortcut",  "state",    "type",
+    "title", "submenu",   "checked",   "disabled", "hidden",
+    "",      "separator", "set-title", "tooltip",  "titles",
+    "set-x", "replace-submenu-2",      "c",        "insert",
+};
+
+#define NUM_KEY_INPUT (int)(sizeof(key_input) / sizeof(key_input[0]))
+
+static void switch_fn(void *arg, int i) {
+    sink += node_key(key_input[i % NUM_KEY_INPUT]);
+}
+
+static void strcmp_fn(void *arg, int i) {
+    sink += strcmp_key(key_input[i % NUM_KEY_INPUT]);
+}
+
+static void bench_keys(void) {
+    for (int i = 0; i < NUM_KNOWN_KEYS; i++)
+        check_int(node_key(known_keys[i].str), known_keys[i].key);
+    for (int i = 0; i < NUM_KEY_INPUT; i++)
+        check_int(node_key(key_input[i]), strcmp_key(key_input[i]));
+
+    int n = quick ? 100000 : 20000000;
+    measure("keys/switch", n, 1000, switch_fn, NULL);
+    measure("keys/strcmp", n, 1000, strcmp_fn, NULL);
+}
+
+// json: menu data parsed in place from a json string and built, against
+// the mpv_node path, where libmpv copies the property value into a tree of
+// separately allocated strings and lists, which is built and then freed.
+// there's no libmpv here, so copy_node() stands in for the copy made by
+// mpv_get_property(MPV_FORMAT_NODE).
+
+struct menu_data {
+    const char *json;  // menu data json
+    mpv_node node;     // parsed menu data, the source of the node copies
+    uint64_t hash;     // hash of the built model
+};
+
+// deep copy node, with an allocation for each string and list
+static void copy_node(void *talloc_ctx, mpv_node *dst, mpv_node *src) {
+    *dst = *src;
+    if (src->format == MPV_FORMAT_STRING) {
+        dst->u.string = talloc_strdup(talloc_ctx, src->u.string);
+    } else if (src->format == MPV_FORMAT_NODE_ARRAY ||
+               src->format == MPV_FORMAT_NODE_MAP) {
+        mpv_node_list *list = talloc_zero(talloc_ctx, mpv_node_list);
+        int num = src->u.list->num;
+        list->num = num;
+        list->values = talloc_array(list, mpv_node, num);
+        if (src->format == MPV_FORMAT_NODE_MAP)
+            list->keys = talloc_array(list, char *, num);
+        for (int i = 0; i < num; i++) {
+            copy_node(list, &list->values[i], &src->u.list->values[i]);
+            if (list->keys)
+                list->keys[i] = talloc_strdup(list, src->u.list->keys[i]);
+        }
+        dst->u.list = list;
+    }
+}
+
+// mpv_get_property_string() copy, parse in place, build
+static void json_fn(void *arg, int i) {
+    struct menu_data *d = arg;
+    char *buf = talloc_strdup(NULL, d->json), *p = buf;
+    mpv_node node;
+    check(json_parse(buf, &node, &p, JSON_MAX_DEPTH) == 0);
+    menu_model *m = model_build(NULL, &node);
+    sink += m->hash[0] == d->hash;
+    talloc_free(m);
+    talloc_free(buf);
+}
+
+// mpv_get_property() copy, build, mpv_free_node_contents()
+static void node_fn(void *arg, int i) {
+    struct menu_data *d = arg;
+    void *tmp = talloc_new(NULL);
+    mpv_node node;
+    copy_node(tmp, &node, &d->node);
+    menu_model *m = model_build(NULL, &node);
+    sink += m->hash[0] == d->hash;
+    talloc_free(m);
+    talloc_free(tmp);
+}
+
+static void bench_json(void) {
+    void *tmp = talloc_new(NULL);
+    uint64_t seed = 7;
+    struct menu_data d;
+    menu_model *m;
+    do {  // a random menu of at least 1000 items
+        d = (struct menu_data){.json = stub_menu_json(tmp, &seed, 24)};
+        char *buf = talloc_strdup(tmp, d.json), *p = buf;
+        check(json_parse(tmp, &d.node, &p, JSON_MAX_DEPTH) == 0);
+        m = model_build(tmp, &d.node);
+    } while (m->num_items < 1000);
+    d.hash = m->hash[0];
+    mpv_node copy;
+    copy_node(tmp, &copy, &d.node);
+    check(model_build(tmp, &copy)->hash[0] == d.hash);
+    printf("%-18s %d items, %d bytes\n", "json", m->num_items,
+           (int)strlen(d.json));
+
+    int n = quick ? 20 : 2000;
+    measure("json/in-place", n, 1, json_fn, &d);
+    measure("json/node-copy", n, 1, node_fn, &d);
+    talloc_free(tmp);
+}
+
+// diff: a deep menu of 4 items per submenu and 7 levels of submenus, with
+// every submenu loaded, as after the user opened all of them. one leaf is
+// changed, by a set-title patch or by new menu data that's rebuilt, and the
+// result is diffed against the presented model. the diff must skip every
+// subtree with the same hash, and update the one leaf only.
+
+#define TREE_WIDTH 4
+#define TREE_DEPTH 7
+
+struct tree_data {
+    const char *json;   // changed menu data json
+    mpv_node patch;     // set-title patch of the changed leaf
+    menu_model *shown;  // presented model, all submenus loaded
+    uint64_t hash;      // hash of the changed model
+    int num_ops;        // ops of the last diff, other than updates
+    int num_updates;    // updates of the last diff
+};
+
+static void count_insert(void *ctx, menu_model *m, int parent, int pos,
+                         int item) {
+    struct tree_data *d = ctx;
+    m->id[item] = ++d->num_ops;
+}
+
+static void count_remove(void *ctx, menu_model *m, int parent, int pos,
+                         int item) {
+    ((struct tree_data *)ctx)->num_ops++;
+}
+
+static void count_update(void *ctx, menu_model *m, int parent, int pos,
+                         int item, int changes) {
+    ((struct tree_data *)ctx)->num_updates++;
+}
+
+static const struct diff_ops count_ops = {
+    .insert = count_insert,
+    .remove = count_remove,
+    .update = count_update,
+};
+
+// append submenu items json, the leaf at path 2,2,... is titled changed,
+// if it's set
+static char *tree_json(char *json, int depth, bool on_path,
+                       const char *changed, int *num_leaves) {
+    json = talloc_strdup_append_buffer(json, "[");
+    for (int i = 0; i < TREE_WIDTH; i++) {
+        bool path = on_path && i == 1;
+        if (i) json = talloc_strdup_append_buffer(json, ",");
+        if (depth == TREE_DEPTH) {
+            char title[32];
+            int n = (*num_leaves)++;
+            snprintf(title, sizeof(title), "leaf %d", n);
+            json = talloc_asprintf_append_buffer(
+                json, "{\"title\":\"%s\",\"cmd\":\"leaf %d\"}",
+                path && changed ? changed : title, n);
+            continue;
+        }
+        json = talloc_asprintf_append_buffer(
+            json, "{\"title\":\"sub %d\",\"type\":\"submenu\",\"submenu\":",
+            i);
+        json = tree_json(json, depth + 1, path, changed, num_leaves);
+        json = talloc_strdup_append_buffer(json, "}");
+    }
+    return talloc_strdup_append_buffer(json, "]");
+}
+
+static menu_model *build_json(void *talloc_ctx, const char *json) {
+    char *buf = talloc_strdup(NULL, json), *p = buf;
+    mpv_node node;
+    check(json_parse(buf, &node, &p, JSON_MAX_DEPTH) == 0);
+    menu_model *m = model_build(talloc_ctx, &node);
+    talloc_free(buf);
+    return m;
+}
+
+static void diff_shown(struct tree_data *d, menu_model *m) {
+    d->num_ops = d->num_updates = 0;
+    menu_diff(d->shown, m, &count_ops, d);
+}
+
+// patch the presented model, diff
+static void patch_fn(void *arg, int i) {
+    struct tree_data *d = arg;
+    menu_model *m = patch_apply(NULL, d->shown, &d->patch);
+    diff_shown(d, m);
+    sink += m->hash[0] == d->hash;
+    talloc_free(m);
+}
+
+// parse and build the changed menu data, diff
+static void rebuild_fn(void *arg, int i) {
+    struct tree_data *d = arg;
+    menu_model *m = build_json(NULL, d->json);
+    diff_shown(d, m);
+    sink += m->hash[0] == d->hash;
+    talloc_free(m);
+}
+
+static void bench_diff(void) {
+    void *tmp = talloc_new(NULL);
+    struct tree_data d = {0};
+    int num_leaves = 0;
+    char *json = tree_json(talloc_strdup(tmp, ""), 1, true, NULL,
+                           &num_leaves);
+    d.shown = build_json(tmp, json);
+    menu_diff(model_build(tmp, NULL), d.shown, &count_ops, &d);
+    for (int i = 0; i < d.shown->num_items; i++)
+        menu_load(d.shown, i, &count_ops, &d);
+    check_int(d.num_ops, d.shown->num_items - 1);
+
+    num_leaves = 0;
+    d.json = tree_json(talloc_strdup(tmp, ""), 1, true, "changed",
+                       &num_leaves);
+    d.hash = build_json(tmp, d.json)->hash[0];
+    check(d.hash != d.shown->hash[0]);
+    char *path = talloc_strdup(tmp, "");
+    for (int i = 0; i < TREE_DEPTH; i++)
+        path = talloc_asprintf_append(path, "%s2", i ? "," : "");
+    char *buf = talloc_asprintf(
+        tmp, "[{\"op\":\"set-title\",\"path\":[%s],\"title\":\"changed\"}]",
+        path);
+    check(json_parse(tmp, &d.patch, &buf, JSON_MAX_DEPTH) == 0);
+    check(patch_apply(tmp, d.shown, &d.patch)->hash[0] == d.hash);
+
+    // both ways update the changed leaf only
+    patch_fn(&d, 0);
+    check_int(d.num_ops, 0);
+    check_int(d.num_updates, 1);
+    rebuild_fn(&d, 0);
+    check_int(d.num_ops, 0);
+    check_int(d.num_updates, 1);
+    printf("%-18s %d items, depth %d\n", "diff", d.shown->num_items,
+           TREE_DEPTH);
+
+    int n = quick ? 5 : 500;
+    measure("diff/patch", n, 1, patch_fn, &d);
+    measure("diff/rebuild", n, 1, rebuild_fn, &d);
+    talloc_free(tmp);
+}
+
+// router: client message dispatch through the router's hash table, against
+// the strcmp() chain it replaced, with the same argument check and latency
+// histogram. mpv broadcasts script messages to every client, so many of the
+// messages are for other scripts. the registry has the plugin's commands,
+// and more added ones in the second pass.
+
+static const struct {
+    const char *name;
+    int min_args;
+} commands[] = {
+    {"show", 0},
+    {"stats", 0},
+    {"patch", 1},
+    {"clipboard/get", 1},
+    {"clipboard/set", 1},
+    {"dialog/open", 1},
+    {"dialog/open-multi", 1},
+    {"dialog/open-folder", 1},
+    {"dialog/save", 1},
+    {"headless/click", 1},
+    {"headless/close", 0},
+};
+
+#define NUM_COMMANDS (int)(sizeof(commands) / sizeof(commands[0]))
+
+static const struct message {
+    int num_args;
+    const char *args[3];
+} messages[] = {
+    {1, {"show"}},
+    {3, {"patch", "[]", "4"}},
+    {2, {"uosc-version", "5.2.0"}},
+    {2, {"osc-visibility", "auto"}},
+    {2, {"clipboard/set", "text"}},
+    {1, {"dialog/save"}},  // rejected
+    {2, {"set", "user-data/osc/margins"}},
+    {2, {"dialog/open-folder", "menu"}},
+    {1, {"extra/40"}},
+    {2, {"headless/click", "3"}},
+    {1, {"key-binding"}},
+    {0, {NULL}},
+};
+
+#define NUM_MESSAGES (int)(sizeof(messages) / sizeof(messages[0]))
+
+struct route_data {
+    router *r;
+    char **names;        // registered commands, in registration order
+    int *min_args;       // required arguments of the commands
+    int num_routes;
+    int64_t *calls;      // strcmp() chain call counts
+    int64_t *rejected;   // strcmp() chain rejected counts
+    histogram *latency;  // strcmp() chain latency
+};
+
+static void command_fn(void *ctx, int num_args, const char **args) {
+    sink += num_args;
+}
+
+static bool strcmp_dispatch(struct route_data *d, int num_args,
+                            const char **args) {
+    if (num_args < 1) return false;
+
+    for (int i = 0; i < d->num_routes; i++) {
+        if (strcmp(d->names[i], args[0]) != 0) continue;
+        if (num_args - 1 < d->min_args[i]) {
+            d->rejected[i]++;
+            return false;
+        }
+        int64_t start = mpv_get_time_ns(NULL);
+        command_fn(d, num_args, args);
+        hist_add(&d->latency[i], mpv_get_time_ns(NULL) - start);
+        d->calls[i]++;
+        return true;
+    }
+    return false;
+}
+
+static void table_fn(void *arg, int i) {
+    struct route_data *d = arg;
+    const struct message *msg = &messages[i % NUM_MESSAGES];
+    router_dispatch(d->r, d, msg->num_args, (const char **)msg->args);
+}
+
+static void chain_fn(void *arg, int i) {
+    struct route_data *d = arg;
+    const struct message *msg = &messages[i % NUM_MESSAGES];
+    strcmp_dispatch(d, msg->num_args, (const char **)msg->args);
+}
+
+// get integer field of command metrics, 0 if the command isn't listed
+static int64_t route_metric(mpv_node *node, const char *name,
+                            const char *key) {
+    mpv_node_list *list = node->u.list;
+    for (int i = 0; i < list->num; i++) {
+        if (strcmp(list->keys[i], name) != 0) continue;
+        mpv_node_list *m = list->values[i].u.list;
+        for (int k = 0; k < m->num; k++)
+            if (strcmp(m->keys[k], key) == 0) return m->values[k].u.int64;
+    }
+    return 0;
+}
+
+static void bench_routes(void *tmp, int num_routes) {
+    struct route_data *d = talloc_zero(tmp, struct route_data);
+    d->r = router_create(d, NULL);
+    d->num_routes = num_routes;
+    d->names = talloc_zero_array(d, char *, num_routes);
+    d->min_args = talloc_zero_array(d, int, num_routes);
+    d->calls = talloc_zero_array(d, int64_t, num_routes);
+    d->rejected = talloc_zero_array(d, int64_t, num_routes);
+    d->latency = talloc_zero_array(d, histogram, num_routes);
+    for (int i = 0; i < num_routes; i++) {
+        if (i < NUM_COMMANDS) {
+            d->names[i] = talloc_strdup(d, commands[i].name);
+            d->min_args[i] = commands[i].min_args;
+        } else {
+            d->names[i] = talloc_asprintf(d, "extra/%d", i - NUM_COMMANDS);
+        }
+        router_add(d->r, d->names[i], d->min_args[i], command_fn);
+    }
+
+    // both dispatch the same messages to the same commands
+    for (int i = 0; i < NUM_MESSAGES * 3; i++) {
+        const struct message *msg = &messages[i % NUM_MESSAGES];
+        const char **args = (const char **)msg->args;
+        check(router_dispatch(d->r, d, msg->num_args, args) ==
+              strcmp_dispatch(d, msg->num_args, args));
+    }
+    mpv_node node;
+    router_metrics(d->r, tmp, &node);
+    for (int i = 0; i < num_routes; i++) {
+        check_int(route_metric(&node, d->names[i], "count"), d->calls[i]);
+        check_int(route_metric(&node, d->names[i], "rejected"),
+                  d->rejected[i]);
+    }
+
+    char name[32];
+    int n = quick ? 10000 : 10000000;
+    snprintf(name, sizeof(name), "router/table-%d", num_routes);
+    measure(name, n, 1000, table_fn, d);
+    snprintf(name, sizeof(name), "router/strcmp-%d", num_routes);
+    measure(name, n, 1000, chain_fn, d);
+}
+
+static void bench_router(void) {
+    void *tmp = talloc_new(NULL);
+    bench_routes(tmp, NUM_COMMANDS);
+    bench_routes(tmp, NUM_COMMANDS + 53);
+    talloc_free(tmp);
+}
+
+static const struct bench {
+    const char *name;
+    void (*fn)(void);
+} benches[] = {
+    {"keys", bench_keys},
+    {"json", bench_json},
+    {"diff", bench_diff},
+    {"router", bench_router},
+};
+
+int main(int argc, char **argv) {
+    quick = argc > 1 && strcmp(argv[1], "-q") == 0;
+
+    printf("%-18s %16s\n", "benchmark", "rate");
+    int first = quick ? 2 : 1;
+    for (int i = 0; i < sizeof(benches) / sizeof(benches[0]); i++)
+        if (bench_selected(argc, argv, first, benches[i].name)) benches[i].fn();
+    return 0;
+}
@@ -0,0 +1,75 @@
+// Copyright (c) 2023-2024 tsl0922. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+// plugin startup benchmark against libmpv
+//
+// usage: bench-startup [-q] <plugin>
+//
+// -q runs a quick pass, as a smoke test. each run loads the plugin in a new
+// player, with menu data set before, so the first build is part of the
+// startup. the headless backend stands in for the native menu, it's
+// created with the plugin context. the load time is from load-script to
+// the menu-init message, the others are the startup stats of the plugin.
+
+#include "bench.h"
+#include "libmpv.h"
+
+#define MENU_ITEMS 2000
+
+static const struct {
+    const char *name;
+    const char *path;  // stats path
+} metrics[] = {
+    {"startup/init", "startup/init-ns"},
+    {"startup/setup", "startup/setup-ns"},
+    {"startup/first-build", "startup/first-build-ns"},
+    {"startup/native-menu", "startup/native-menu-ns"},
+};
+
+#define NUM_METRICS (int)(sizeof(metrics) / sizeof(metrics[0]))
+
+int main(int argc, char **argv) {
+    bool quick = argc > 1 && strcmp(argv[1], "-q") == 0;
+    int first = quick ? 2 : 1;
+    if (argc != first + 1) {
+        fprintf(stderr, "usage: %s [-q] <plugin>\n", argv[0]);
+        return 1;
+    }
+
+    int runs = quick ? 3 : 100;
+    struct samples load = {0}, samples[NUM_METRICS] = {0};
+    for (int i = 0; i < runs; i++) {
+        mpv_handle *mpv = create_player();
+        set_menu(mpv, MENU_ITEMS, "item", "ignore");
+        int64_t start = mpv_get_time_ns(mpv);
+        load_plugin(mpv, argv[first]);
+        samples_add(&load, mpv_get_time_ns(mpv) - start);
+
+        // the initial notifications of both menu data properties are
+        // drained before the build, so it's built once, and there's no
+        // window with --vo=null
+        mpv_node stats;
+        wait_stats(mpv, &stats, "rebuilds/count", 1);
+        mpv_free_node_contents(&stats);
+        read_stats(mpv, &stats);
+        check_int(node_int(&stats, "rebuilds/count"), 1);
+        check_int(node_int(&stats, "menu-items"), 1 + MENU_ITEMS);
+        check_int(node_int(&stats, "startup/window-ns"), 0);
+        for (int k = 0; k < NUM_METRICS; k++)
+            samples_add(&samples[k], node_int(&stats, metrics[k].path));
+        mpv_free_node_contents(&stats);
+
+        mpv_terminate_destroy(mpv);
+    }
+
+    char rate[32];
+    snprintf(rate, sizeof(rate), "%d runs", runs);
+    printf("%-18s %16s\n", "benchmark", "runs");
+    print_line("startup/load", rate, &load);
+    talloc_free(load.values);
+    for (int k = 0; k < NUM_METRICS; k++) {
+        print_line(metrics[k].name, rate, &samples[k]);
+        talloc_free(samples[k].values);
+    }
+    return 0;
+}
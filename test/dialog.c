@@ -0,0 +1,84 @@
+// Copyright (c) 2023-2024 tsl0922. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+// fake blocking dialogs, see stub.h
+
+#include "mpv_talloc.h"
+#include "osdep/threads.h"
+#include "dialog.h"
+#include "stub.h"
+
+static mp_static_mutex lock = MP_STATIC_MUTEX_INITIALIZER;
+static mp_cond cond = MP_STATIC_COND_INITIALIZER;
+
+static bool shown;         // a dialog is shown
+static bool closed;        // the shown dialog is closed, result is set
+static bool cancel_all;    // dialogs are cancelled without being shown
+static int num_shown;      // dialogs shown so far
+static int num_closed;     // dialogs closed so far
+static const char *result;  // path of the closed dialog
+
+// show a dialog, and wait until it's closed
+static char *show(void *talloc_ctx) {
+    mp_mutex_lock(&lock);
+    char *path = NULL;
+    if (!cancel_all) {
+        shown = true;
+        num_shown++;
+        mp_cond_broadcast(&cond);
+        while (!closed && !cancel_all) mp_cond_wait(&cond, &lock);
+        if (closed && result) path = talloc_strdup(talloc_ctx, result);
+        shown = closed = false;
+        num_closed++;
+        mp_cond_broadcast(&cond);
+    }
+    mp_mutex_unlock(&lock);
+    return path;
+}
+
+int stub_dialog_wait(void) {
+    mp_mutex_lock(&lock);
+    while (!shown || closed) mp_cond_wait(&cond, &lock);
+    int n = num_shown;
+    mp_mutex_unlock(&lock);
+    return n;
+}
+
+void stub_dialog_close(const char *path) {
+    mp_mutex_lock(&lock);
+    while (!shown || closed) mp_cond_wait(&cond, &lock);
+    closed = true;
+    result = path;
+    mp_cond_broadcast(&cond);
+    // the result is read before the next dialog is shown
+    int n = num_closed;
+    while (num_closed == n) mp_cond_wait(&cond, &lock);
+    mp_mutex_unlock(&lock);
+}
+
+void stub_dialog_cancel_all(void) {
+    mp_mutex_lock(&lock);
+    cancel_all = true;
+    mp_cond_broadcast(&cond);
+    mp_mutex_unlock(&lock);
+}
+
+char *open_dialog(void *talloc_ctx, plugin_ctx *ctx) {
+    return show(talloc_ctx);
+}
+
+char **open_dialog_multi(void *talloc_ctx, plugin_ctx *ctx) {
+    char *path = show(talloc_ctx);
+    if (!path) return NULL;
+    char **paths = talloc_zero_array(talloc_ctx, char *, 2);
+    paths[0] = talloc_steal(paths, path);
+    return paths;
+}
+
+char *open_folder(void *talloc_ctx, plugin_ctx *ctx) {
+    return show(talloc_ctx);
+}
+
+char *save_dialog(void *talloc_ctx, plugin_ctx *ctx) {
+    return show(talloc_ctx);
+}
@@ -0,0 +1,238 @@
+// Copyright (c) 2023-2024 tsl0922. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+// menu diff tests: menu_diff() and menu_load() drive a recording mock
+// backend, and the recorded op sequence is checked. the last test builds a
+// 100k item menu, where only the top level items are created.
+
+#include "mpv_talloc.h"
+#include "osdep/timer.h"
+#include "diff.h"
+#include "json.h"
+#include "test.h"
+
+// mock backend, records ops as "op parent pos label", separated by "; "
+struct recorder {
+    char log[1024];
+    int num_ops;
+    unsigned int next_id;  // ids of inserted items, starting from 1
+};
+
+static const char *label(menu_model *m, int i) {
+    if (i == 0) return "root";
+    if (m->type[i] == MENU_SEPARATOR) return "-";
+    return model_str(m, m->label[i]);
+}
+
+static void record(struct recorder *r, const char *op, menu_model *m,
+                   int parent, int pos, int item) {
+    size_t len = strlen(r->log);
+    snprintf(r->log + len, sizeof(r->log) - len, "%s%s %s %d %s",
+             len ? "; " : "", op, label(m, parent), pos, label(m, item));
+    r->num_ops++;
+}
+
+static void mock_insert(void *ctx, menu_model *m, int parent, int pos,
+                        int item) {
+    struct recorder *r = ctx;
+    m->id[item] = ++r->next_id;
+    record(r, "insert", m, parent, pos, item);
+}
+
+static void mock_remove(void *ctx, menu_model *m, int parent, int pos,
+                        int item) {
+    record(ctx, "remove", m, parent, pos, item);
+}
+
+static void mock_update(void *ctx, menu_model *m, int parent, int pos,
+                        int item, int changes) {
+    const char *op = changes == (DIFF_TITLE | DIFF_FLAGS) ? "update-all"
+                     : changes == DIFF_TITLE              ? "update-title"
+                                                          : "update-flags";
+    record(ctx, op, m, parent, pos, item);
+}
+
+static const struct diff_ops mock_ops = {
+    .insert = mock_insert,
+    .remove = mock_remove,
+    .update = mock_update,
+};
+
+static menu_model *build(const char *json) {
+    void *tmp = talloc_new(NULL);
+    char *buf = talloc_strdup(tmp, json);
+    mpv_node node;
+    check(json_parse(tmp, &node, &buf, JSON_MAX_DEPTH) == 0);
+    menu_model *m = model_build(NULL, &node);
+    talloc_free(tmp);
+    return m;
+}
+
+// diff the current model with the new one, return the recorded ops, and
+// make the new model current
+static const char *diff(struct recorder *r, menu_model **cur,
+                        const char *json) {
+    menu_model *m = build(json);
+    r->log[0] = '\0';
+    r->num_ops = 0;
+    menu_diff(*cur, m, &mock_ops, r);
+    talloc_free(*cur);
+    *cur = m;
+    return r->log;
+}
+
+// find item by title in the submenu of parent
+static int find(menu_model *m, int parent, const char *title) {
+    for (int i = m->first[parent]; i < m->first[parent] + m->count[parent];
+         i++) {
+        if (strcmp(model_str(m, m->label[i]), title) == 0) return i;
+    }
+    check(!"item not found");
+    return -1;
+}
+
+static void test_items(void) {
+    struct recorder r = {0};
+    menu_model *m = model_build(NULL, NULL);
+
+    check_str(diff(&r, &m, "[{\"title\":\"a\"},{\"title\":\"b\"}]"),
+              "insert root 0 a; insert root 1 b");
+    check_str(diff(&r, &m, "[{\"title\":\"a\"},{\"title\":\"b\"}]"), "");
+
+    // matched items keep their ids
+    unsigned int id_a = m->id[find(m, 0, "a")];
+    unsigned int id_b = m->id[find(m, 0, "b")];
+    check_str(diff(&r, &m,
+                   "[{\"title\":\"a\"},{\"type\":\"separator\"},"
+                   "{\"title\":\"b\"}]"),
+              "insert root 1 -");
+    check_int(m->id[find(m, 0, "a")], id_a);
+    check_int(m->id[find(m, 0, "b")], id_b);
+
+    check_str(diff(&r, &m, "[{\"title\":\"a\"},{\"title\":\"b\"}]"),
+              "remove root 1 -");
+
+    // the middle is matched by position
+    check_str(diff(&r, &m,
+                   "[{\"title\":\"a\"},{\"title\":\"x\"},{\"title\":\"b\"}]"),
+              "insert root 1 x");
+    check_str(diff(&r, &m,
+                   "[{\"title\":\"a\"},{\"title\":\"y\"},{\"title\":\"b\"}]"),
+              "update-title root 1 y");
+    check_str(diff(&r, &m,
+                   "[{\"title\":\"a\"},{\"type\":\"separator\"},"
+                   "{\"title\":\"b\"}]"),
+              "remove root 1 y; insert root 1 -");
+
+    // state changes, hidden items have no native item, and items without a
+    // command are disabled
+    check_str(diff(&r, &m,
+                   "[{\"title\":\"a\",\"state\":[\"checked\"]},"
+                   "{\"title\":\"b\",\"state\":[\"hidden\"]}]"),
+              "update-flags root 0 a; remove root 1 -; remove root 1 b");
+    check_str(diff(&r, &m,
+                   "[{\"title\":\"a\"},{\"title\":\"b\"},{\"title\":\"c\"}]"),
+              "update-flags root 0 a; insert root 1 b; insert root 2 c");
+    check_str(diff(&r, &m,
+                   "[{\"title\":\"b\",\"cmd\":\"cmd b\"},{\"title\":\"c\"}]"),
+              "remove root 0 a; update-flags root 0 b");
+    check_str(diff(&r, &m, "[]"), "remove root 0 b; remove root 0 c");
+
+    talloc_free(m);
+}
+
+static void test_submenus(void) {
+    struct recorder r = {0};
+    menu_model *m = model_build(NULL, NULL);
+    const char *menu =
+        "[{\"title\":\"s\",\"type\":\"submenu\",\"submenu\":["
+        "{\"title\":\"x\"},{\"title\":\"y\"}]}]";
+
+    // submenu items are created when it's opened
+    check_str(diff(&r, &m, menu), "insert root 0 s");
+    int s = find(m, 0, "s");
+    check(!m->loaded[s]);
+
+    // changes of a submenu that is never opened have no ops
+    check_str(diff(&r, &m,
+                   "[{\"title\":\"s\",\"type\":\"submenu\",\"submenu\":["
+                   "{\"title\":\"x\"},{\"title\":\"z\"}]}]"),
+              "");
+
+    r.log[0] = '\0';
+    s = find(m, 0, "s");
+    menu_load(m, s, &mock_ops, &r);
+    check_str(r.log, "insert s 0 x; insert s 1 z");
+    check(m->loaded[s]);
+    r.log[0] = '\0';
+    menu_load(m, s, &mock_ops, &r);
+    check_str(r.log, "");
+
+    // loaded submenus are diffed, and stay loaded
+    check_str(diff(&r, &m,
+                   "[{\"title\":\"s\",\"type\":\"submenu\",\"submenu\":["
+                   "{\"title\":\"x\"},{\"title\":\"y\"},{\"title\":\"w\"}]}]"),
+              "update-title s 1 y; insert s 2 w");
+    check(m->loaded[find(m, 0, "s")]);
+
+    // a replaced submenu is not loaded
+    check_str(diff(&r, &m,
+                   "[{\"title\":\"a\"},{\"title\":\"t\",\"type\":\"submenu\","
+                   "\"submenu\":[{\"title\":\"x\"}]}]"),
+              "remove root 0 s; insert root 0 a; insert root 1 t");
+    check(!m->loaded[find(m, 0, "t")]);
+
+    // a submenu without visible items is disabled
+    check_str(diff(&r, &m,
+                   "[{\"title\":\"a\"},{\"title\":\"t\",\"type\":\"submenu\","
+                   "\"submenu\":[{\"title\":\"x\",\"state\":[\"hidden\"]}]}]"),
+              "update-flags root 1 t");
+
+    talloc_free(m);
+}
+
+// 100 submenus of 1000 items each, only the submenus are created, their
+// items are created when one is opened
+static void test_large(void) {
+    void *tmp = talloc_new(NULL);
+    char *json = talloc_strdup(tmp, "[");
+    for (int i = 0; i < 100; i++) {
+        json = talloc_asprintf_append_buffer(
+            json, "%s{\"title\":\"s%d\",\"type\":\"submenu\",\"submenu\":[",
+            i ? "," : "", i);
+        for (int j = 0; j < 1000; j++) {
+            json = talloc_asprintf_append_buffer(
+                json, "%s{\"title\":\"item %d\",\"cmd\":\"cmd %d\"}",
+                j ? "," : "", j, j);
+        }
+        json = talloc_strdup_append_buffer(json, "]}");
+    }
+    json = talloc_strdup_append_buffer(json, "]");
+
+    struct recorder r = {0};
+    menu_model *m = model_build(NULL, NULL);
+    int64_t start = mp_time_ns();
+    diff(&r, &m, json);
+    int64_t build_ns = mp_time_ns() - start;
+    check_int(m->num_items, 1 + 100 + 100 * 1000);
+    check_int(r.num_ops, 100);
+
+    r.log[0] = '\0';
+    r.num_ops = 0;
+    start = mp_time_ns();
+    menu_load(m, find(m, 0, "s50"), &mock_ops, &r);
+    int64_t load_ns = mp_time_ns() - start;
+    check_int(r.num_ops, 1000);
+
+    printf("100k items: build and diff %.2f ms, open submenu %.3f ms\n",
+           build_ns / 1e6, load_ns / 1e6);
+    talloc_free(m);
+    talloc_free(tmp);
+}
+
+int main(void) {
+    test_items();
+    test_submenus();
+    test_large();
+    return 0;
+}
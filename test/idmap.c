@@ -0,0 +1,237 @@
+// Copyright (c) 2023-2024 tsl0922. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+// menu identifier allocator tests: allocation, recycling order and
+// generation checks of idmap, a random alloc/free stress test against a
+// shadow allocator, and the ids of menu rebuilds and clicks with the diff
+// ops of the headless backend
+
+#include "mpv_talloc.h"
+#include "menu.h"
+#include "stub.h"
+#include "test.h"
+
+static void test_alloc(void) {
+    idmap *map = idmap_create(NULL, 100, 103);
+
+    for (int i = 0; i < 4; i++) check_int(idmap_alloc(map, i + 1), 100 + i);
+    check_int(idmap_alloc(map, 5), 0);  // all ids are in use
+    check_int(idmap_get(map, 102, 0), 3);
+
+    idmap_free(map, 101);
+    idmap_free(map, 101);  // double free is ignored
+    check_int(idmap_get(map, 101, 0), -1);
+    check_int(idmap_alloc(map, 6), 101);
+    check_int(idmap_alloc(map, 7), 0);
+
+    idmap_set(map, 101, 8);
+    check_int(idmap_get(map, 101, 0), 8);
+    idmap_free(map, 101);
+    idmap_set(map, 101, 9);  // free id is not set
+    check_int(idmap_get(map, 101, 0), -1);
+
+    // ids out of range
+    check_int(idmap_get(map, 99, 0), -1);
+    check_int(idmap_get(map, 104, 0), -1);
+    idmap_free(map, 99);
+    idmap_free(map, 104);
+    check_int(idmap_alloc(map, 10), 101);
+    check_int(idmap_alloc(map, 11), 0);
+
+    talloc_free(map);
+}
+
+// freed ids are reused after all other free ids
+static void test_recycle(void) {
+    idmap *map = idmap_create(NULL, 1, 8);
+
+    for (int i = 1; i <= 4; i++) check_int(idmap_alloc(map, i), i);
+    idmap_free(map, 2);
+    idmap_free(map, 1);
+    for (int i = 5; i <= 8; i++) check_int(idmap_alloc(map, i), i);
+    check_int(idmap_alloc(map, 9), 2);
+    check_int(idmap_alloc(map, 10), 1);
+    check_int(idmap_alloc(map, 11), 0);
+
+    talloc_free(map);
+}
+
+// ids allocated after a generation are rejected for it, even if they are
+// recycled
+static void test_generation(void) {
+    idmap *map = idmap_create(NULL, 1, 2);
+
+    unsigned int a = idmap_alloc(map, 1);
+    check_int(idmap_next_gen(map), 1);
+    unsigned int b = idmap_alloc(map, 2);
+    check_int(idmap_gen(map), 1);
+
+    check_int(idmap_get(map, a, 0), 1);
+    check_int(idmap_get(map, b, 0), -1);
+    check_int(idmap_get(map, b, 1), 2);
+
+    idmap_free(map, a);
+    idmap_next_gen(map);
+    check_int(idmap_alloc(map, 3), a);
+    check_int(idmap_get(map, a, 0), -1);
+    check_int(idmap_get(map, a, 1), -1);
+    check_int(idmap_get(map, a, 2), 3);
+
+    talloc_free(map);
+}
+
+// random alloc/free of the whole menu id range, checked against a shadow
+// allocator: a FIFO of free ids, and the index and generation of each id
+static void test_stress(void) {
+    enum { BASE = MENU_ID_BASE, SIZE = MENU_ID_MAX - MENU_ID_BASE + 1 };
+    idmap *map = idmap_create(NULL, BASE, MENU_ID_MAX);
+
+    void *tmp = talloc_new(NULL);
+    int *index = talloc_array(tmp, int, SIZE);  // -1 if free
+    uint32_t *gens = talloc_array(tmp, uint32_t, SIZE);
+    unsigned int *fifo = talloc_array(tmp, unsigned int, SIZE);
+    unsigned int *used = talloc_array(tmp, unsigned int, SIZE);
+    int head = 0, num_free = SIZE, num_used = 0;
+    for (int i = 0; i < SIZE; i++) {
+        index[i] = -1;
+        fifo[i] = BASE + i;
+    }
+
+    uint64_t seed = 0x9E3779B97F4A7C15ULL;
+    uint32_t gen = 0;
+    int alloc_pct = 70, full = 0, empty = 0;
+    for (int n = 0; n < 4000000; n++) {
+        // alternate between filling and draining, to reach both ends
+        if (n % 200000 == 0) alloc_pct = 100 - alloc_pct;
+
+        int r = test_rand_n(&seed, 100);
+        if (r == 0) {
+            check_int(idmap_next_gen(map), ++gen);
+        } else if (r <= alloc_pct) {
+            unsigned int id = idmap_alloc(map, n);
+            if (num_free == 0) {
+                check_int(id, 0);
+                full++;
+                continue;
+            }
+            check_int(id, fifo[head]);
+            head = (head + 1) % SIZE;
+            num_free--;
+            index[id - BASE] = n;
+            gens[id - BASE] = gen;
+            used[num_used++] = id;
+        } else if (num_used > 0) {
+            int k = test_rand_n(&seed, num_used);
+            unsigned int id = used[k];
+            used[k] = used[--num_used];
+            idmap_free(map, id);
+            index[id - BASE] = -1;
+            fifo[(head + num_free++) % SIZE] = id;
+            if (num_used == 0) empty++;
+        }
+
+        // a random id is only visible to the generations after its own
+        unsigned int id = BASE + test_rand_n(&seed, SIZE);
+        int i = index[id - BASE];
+        check_int(idmap_get(map, id, gen), i);
+        if (i >= 0 && gens[id - BASE] > 0)
+            check_int(idmap_get(map, id, gens[id - BASE] - 1), -1);
+    }
+    check(full > 0 && empty > 0);
+
+    talloc_free(tmp);
+    talloc_free(map);
+}
+
+// the plugin thread is the UI thread, like the headless backend
+static void apply_now(plugin_ctx *ctx) { apply_menu(ctx, &stub_diff_ops); }
+
+// rebuild random menus, opening random submenus in between, then remove
+// all items: every id must be released
+static void test_rebuild(void) {
+    plugin_ctx *ctx = stub_ctx_create();
+    stub_update = apply_now;
+    uint8_t *seen = talloc_size(ctx, MENU_ID_MAX + 1);
+    uint64_t seed = 42;
+
+    for (int n = 0; n < 2000; n++) {
+        char *json = stub_menu_json(NULL, &seed, 8);
+        update_menu_json(ctx, json);
+        talloc_free(json);
+
+        menu_model *m = atomic_load(&ctx->model);
+        for (int k = 0; k < 4 && m->num_items > 1; k++) {
+            int i = 1 + test_rand_n(&seed, m->num_items - 1);
+            if (m->loaded[m->parent[i]] && model_visible(m, i))
+                menu_load(m, i, &stub_diff_ops, ctx);
+        }
+        stub_check_ids(ctx, seen);
+    }
+
+    char empty[] = "[]";
+    update_menu_json(ctx, empty);
+    int size = MENU_ID_MAX - MENU_ID_BASE + 1;
+    for (int i = 0; i < size; i++) check(idmap_alloc(ctx->idmap, 1) != 0);
+    check_int(idmap_alloc(ctx->idmap, 1), 0);
+
+    stub_update = NULL;
+    stub_ctx_destroy(ctx);
+}
+
+// show menu, publish json while it's shown, and close it with a click on
+// the item at pos of the shown menu, return the command that is run
+static const char *click(plugin_ctx *ctx, const char *shown, const char *json,
+                         int pos) {
+    char *buf = talloc_strdup(NULL, shown);
+    update_menu_json(ctx, buf);
+    open_menu(ctx);
+
+    menu_model *m = atomic_load(&ctx->model);
+    unsigned int id = m->id[m->first[0] + pos];
+    talloc_free(buf);
+    buf = talloc_strdup(NULL, json);
+    update_menu_json(ctx, buf);
+    talloc_free(buf);
+
+    stub_command[0] = '\0';
+    close_menu(ctx, &stub_diff_ops, id);
+    return stub_command;
+}
+
+// a click is resolved against the shown menu, not the one published while
+// it's shown, which may move the id to another item, or release it
+static void test_click(void) {
+    plugin_ctx *ctx = stub_ctx_create();
+    stub_update = apply_now;
+    const char *menu =
+        "[{\"title\":\"a\",\"cmd\":\"cmd a\"},{\"title\":\"b\",\"cmd\":"
+        "\"cmd b\"},{\"title\":\"c\",\"cmd\":\"cmd c\"}]";
+
+    // the middle item is replaced, its id is kept by the new item
+    const char *moved =
+        "[{\"title\":\"a\",\"cmd\":\"cmd a\"},{\"title\":\"x\",\"cmd\":"
+        "\"cmd x\"},{\"title\":\"c\",\"cmd\":\"cmd c\"}]";
+    check_str(click(ctx, menu, moved, 1), "cmd b");
+
+    // the middle item is removed, its id is released
+    const char *removed =
+        "[{\"title\":\"a\",\"cmd\":\"cmd a\"},{\"title\":\"c\",\"cmd\":"
+        "\"cmd c\"}]";
+    check_str(click(ctx, menu, removed, 1), "cmd b");
+
+    // nothing is published while it's shown
+    check_str(click(ctx, menu, menu, 2), "cmd c");
+
+    stub_update = NULL;
+    stub_ctx_destroy(ctx);
+}
+
+int main(void) {
+    test_alloc();
+    test_recycle();
+    test_generation();
+    test_stress();
+    test_rebuild();
+    test_click();
+    return 0;
+}
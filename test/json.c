@@ -0,0 +1,123 @@
+// Copyright (c) 2023-2024 tsl0922. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+// json parser tests: the number and string grammar, escapes and surrogate
+// pairs, nesting depth, and input that strtod() or a lax parser accepts
+// but json doesn't
+
+#include "mpv_talloc.h"
+#include "json.h"
+#include "test.h"
+
+// parse whole input, return false if it's invalid or has trailing text
+static bool parse(void *talloc_ctx, const char *json, mpv_node *node) {
+    char *buf = talloc_strdup(talloc_ctx, json);
+    if (json_parse(talloc_ctx, node, &buf, JSON_MAX_DEPTH) < 0) return false;
+    json_skip_whitespace(&buf);
+    return *buf == '\0';
+}
+
+static void test_numbers(void) {
+    void *tmp = talloc_new(NULL);
+    mpv_node node;
+
+    static const struct {
+        const char *json;
+        double value;
+    } valid[] = {
+        {"0", 0},       {"-0", 0},        {"7", 7},        {"-12", -12},
+        {"1.5", 1.5},   {"-0.25", -0.25}, {"1e3", 1e3},    {"1E+3", 1e3},
+        {"2e-2", 2e-2}, {"10.5e1", 105},  {" 42 ", 42},
+    };
+    for (int i = 0; i < sizeof(valid) / sizeof(valid[0]); i++) {
+        check(parse(tmp, valid[i].json, &node));
+        check(node.format == MPV_FORMAT_DOUBLE);
+        check(node.u.double_ == valid[i].value);
+    }
+
+    // strtod() accepts all of these
+    static const char *invalid[] = {
+        "+1",   "0x10", "-0x1", "inf", "-inf", "nan",  "-nan", "infinity",
+        "01",   "-01",  ".5",   "1.",  "-",    "1e",   "1e+",  "1.e5",
+        "- 1",  "1 2",
+    };
+    for (int i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++)
+        check(!parse(tmp, invalid[i], &node));
+
+    talloc_free(tmp);
+}
+
+static void test_strings(void) {
+    void *tmp = talloc_new(NULL);
+    mpv_node node;
+
+    static const struct {
+        const char *json;
+        const char *value;
+    } valid[] = {
+        {"\"\"", ""},
+        {"\"a b\"", "a b"},
+        {"\"\\\"\\\\\\/\\b\\f\\n\\r\\t\"", "\"\\/\b\f\n\r\t"},
+        {"\"\\u0041\\u00e9\\u4e2d\"", "A\xc3\xa9\xe4\xb8\xad"},
+        {"\"\\ud83d\\ude00\"", "\xf0\x9f\x98\x80"},  // surrogate pair
+        {"\"\\ud83d\"", "\xef\xbf\xbd"},             // lone surrogate
+        {"\"\\ude00\\ud83d\"", "\xef\xbf\xbd\xef\xbf\xbd"},
+        {"\"\xe4\xb8\xad\x7f\"", "\xe4\xb8\xad\x7f"},  // raw utf8 and DEL
+    };
+    for (int i = 0; i < sizeof(valid) / sizeof(valid[0]); i++) {
+        check(parse(tmp, valid[i].json, &node));
+        check(node.format == MPV_FORMAT_STRING);
+        check_str(node.u.string, valid[i].value);
+    }
+
+    static const char *invalid[] = {
+        "\"a",   "\"\\x\"", "\"\\u12\"", "\"\\u12g4\"", "\"a\nb\"",
+        "\"\t\"", "\"\x01\"", "\"\x1f\"", "{\"a\x02\":1}",
+    };
+    for (int i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++)
+        check(!parse(tmp, invalid[i], &node));
+
+    talloc_free(tmp);
+}
+
+static void test_structure(void) {
+    void *tmp = talloc_new(NULL);
+    mpv_node node;
+
+    check(parse(tmp, "{\"a\":[1,true,null,{\"b\":\"c\"}],\"d\":false}",
+                &node));
+    check(node.format == MPV_FORMAT_NODE_MAP);
+    check_int(node.u.list->num, 2);
+    check_str(node.u.list->keys[0], "a");
+    mpv_node *a = &node.u.list->values[0];
+    check(a->format == MPV_FORMAT_NODE_ARRAY);
+    check_int(a->u.list->num, 4);
+    check(a->u.list->values[1].format == MPV_FORMAT_FLAG);
+    check(a->u.list->values[2].format == MPV_FORMAT_NONE);
+    check_str(a->u.list->values[3].u.list->values[0].u.string, "c");
+
+    static const char *invalid[] = {
+        "[1,]", "[,1]", "{\"a\"}", "{\"a\":}", "{1:2}", "[1 2]", "tru", "[",
+    };
+    for (int i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++)
+        check(!parse(tmp, invalid[i], &node));
+
+    // nesting deeper than the max depth
+    char *deep = talloc_strdup(tmp, "");
+    for (int i = 0; i < JSON_MAX_DEPTH; i++)
+        deep = talloc_strdup_append(deep, "[");
+    for (int i = 0; i < JSON_MAX_DEPTH; i++)
+        deep = talloc_strdup_append(deep, "]");
+    check(parse(tmp, deep, &node));
+    deep = talloc_asprintf(tmp, "[%s]", deep);
+    check(!parse(tmp, deep, &node));
+
+    talloc_free(tmp);
+}
+
+int main(void) {
+    test_numbers();
+    test_strings();
+    test_structure();
+    return 0;
+}
@@ -0,0 +1,221 @@
+// Copyright (c) 2023-2024 tsl0922. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+// plugin tests against libmpv, the plugin is loaded by a headless player
+//
+// usage: test-libmpv <plugin> <name>
+//
+// plugin is the path of the built plugin, name selects the test to run in a
+// new player.
+
+#include "libmpv.h"
+
+#define NUM_COMMITS 100
+
+// menu data json of n items, titled "item <i>", free with free()
+static char *menu_json(int n) {
+    size_t size = 16 + n * 48;
+    char *json = malloc(size);
+    check(json != NULL);
+
+    size_t len = snprintf(json, size, "[");
+    for (int i = 0; i < n; i++) {
+        len += snprintf(json + len, size - len,
+                        "%s{\"title\":\"item %d\",\"cmd\":\"ignore\"}",
+                        i ? "," : "", i);
+    }
+    snprintf(json + len, size - len, "]");
+    return json;
+}
+
+// a burst of menu data commits is built once the plugin's event queue is
+// drained, and the menu is the last commit
+//
+// the commits are prepared first, so they are set faster than the plugin
+// builds them, and a build never reads more notifications than it got.
+static void test_coalesce(mpv_handle *mpv) {
+    char *commits[NUM_COMMITS];
+    for (int i = 0; i < NUM_COMMITS; i++) commits[i] = menu_json(1000 + i);
+
+    mpv_node stats;
+    read_stats(mpv, &stats);
+    int64_t builds = node_int(&stats, "rebuilds/count");
+    int64_t changes = node_int(&stats, "events/property-change/count");
+    check(node_get(&stats, "skipped-updates") != NULL);
+    mpv_free_node_contents(&stats);
+
+    for (int i = 0; i < NUM_COMMITS; i++)
+        check(mpv_set_property_string(mpv, MENU_JSON_PROP, commits[i]) >= 0);
+
+    wait_stats(mpv, &stats, "menu-items", 1 + 1000 + NUM_COMMITS - 1);
+    int64_t rebuilds = node_int(&stats, "rebuilds/count") - builds;
+    changes = node_int(&stats, "events/property-change/count") - changes;
+    check(rebuilds >= 1);
+    check(rebuilds <= changes);
+    check(rebuilds < NUM_COMMITS / 2);
+    mpv_free_node_contents(&stats);
+
+    // a commit after the burst is built again
+    set_menu(mpv, 10, "item", "ignore");
+    wait_stats(mpv, &stats, "menu-items", 1 + 10);
+    check(node_int(&stats, "rebuilds/count") > builds + rebuilds);
+    mpv_free_node_contents(&stats);
+
+    for (int i = 0; i < NUM_COMMITS; i++) free(commits[i]);
+}
+
+#define NUM_CLICKS 8
+
+// clicked menu commands run asynchronously, at most max_inflight at a
+// time, each statement after the previous one replies, and every command
+// is counted once it's done
+static void test_commands(mpv_handle *mpv) {
+    set_menu(mpv, NUM_CLICKS, "item", "set user-data/test/item-%d yes");
+    for (int i = 0; i < NUM_CLICKS; i++) {
+        char path[16];
+        snprintf(path, sizeof(path), "%d", i + 1);
+        send_message(mpv, "show");
+        send_message(mpv, "headless/click", path);
+    }
+
+    mpv_node stats;
+    wait_stats(mpv, &stats, "menu-commands/count", NUM_CLICKS);
+    check_int(node_int(&stats, "click-to-command/count"), NUM_CLICKS);
+    check_int(node_int(&stats, "menu-commands/max-in-flight"), 2);
+    check_int(node_int(&stats, "menu-commands/in-flight"), 0);
+    check_int(node_int(&stats, "menu-commands/queued"), 0);
+    check_int(node_int(&stats, "menu-commands/failed"), 0);
+    check_int(node_int(&stats, "menu-commands/fallback"), 0);
+    mpv_free_node_contents(&stats);
+
+    for (int i = 0; i < NUM_CLICKS; i++) {
+        char name[64];
+        snprintf(name, sizeof(name), "user-data/test/item-%d", i);
+        char *value = mpv_get_property_string(mpv, name);
+        check(value != NULL);
+        check_str(value, "yes");
+        mpv_free(value);
+    }
+
+    // statements run in order, a failed one is counted, and the rest run
+    set_menu(mpv, 1, "item",
+             "set user-data/test/seq a; no-such-command; "
+             "set user-data/test/seq b");
+    send_message(mpv, "show");
+    send_message(mpv, "headless/click", "1");
+    wait_stats(mpv, &stats, "menu-commands/count", NUM_CLICKS + 1);
+    check_int(node_int(&stats, "menu-commands/failed"), 1);
+    mpv_free_node_contents(&stats);
+
+    char *value = mpv_get_property_string(mpv, "user-data/test/seq");
+    check(value != NULL);
+    check_str(value, "b");
+    mpv_free(value);
+}
+
+// check string property value
+static void check_property(mpv_handle *mpv, const char *name,
+                           const char *value) {
+    char *str = mpv_get_property_string(mpv, name);
+    check(str != NULL);
+    check_str(str, value);
+    mpv_free(str);
+}
+
+#define SMOKE_MENU                                                       \
+    "[{\"title\":\"a\",\"cmd\":\"set user-data/test/clicked a\"},"       \
+    "{\"title\":\"sub\",\"type\":\"submenu\",\"submenu\":["              \
+    "{\"title\":\"b\",\"cmd\":\"set user-data/test/clicked b\"},"        \
+    "{\"title\":\"c\",\"cmd\":\"set user-data/test/clicked c\","         \
+    "\"state\":[\"disabled\"]}]}]"
+
+// the whole pipeline with the headless backend: menu data, show and click,
+// patches, the clipboard and dialogs, stats, and the shutdown of the player
+static void test_smoke(mpv_handle *mpv) {
+    mpv_node stats;
+    const char *client = mpv_client_name(mpv);
+    check(mpv_set_property_string(mpv, MENU_JSON_PROP, SMOKE_MENU) >= 0);
+    wait_stats(mpv, &stats, "menu-items", 1 + 2 + 2);
+    mpv_free_node_contents(&stats);
+
+    // click a submenu item, a disabled one, and close without a click
+    send_message(mpv, "show");
+    send_message(mpv, "headless/click", "2/1");
+    wait_stats(mpv, &stats, "menu-commands/count", 1);
+    mpv_free_node_contents(&stats);
+    check_property(mpv, "user-data/test/clicked", "b");
+
+    send_message(mpv, "show");
+    send_message(mpv, "headless/click", "2/2");
+    send_message(mpv, "show");
+    send_message(mpv, "headless/close");
+    read_stats(mpv, &stats);
+    check_int(node_int(&stats, "menu-commands/count"), 1);
+    check_int(node_int(&stats, "commands/show/count"), 3);
+    mpv_node *click = node_get(&stats, "commands");
+    click = node_field(click, "headless/click", strlen("headless/click"));
+    check_int(node_int(click, "count"), 2);
+    mpv_free_node_contents(&stats);
+
+    // enable the disabled item by a patch, and click it
+    send_message(mpv, "patch",
+                 "[{\"op\":\"set-state\",\"path\":[2,2],\"state\":[]}]");
+    send_message(mpv, "show");
+    send_message(mpv, "headless/click", "2/2");
+    wait_stats(mpv, &stats, "menu-commands/count", 2);
+    check_int(node_int(&stats, "patches/count"), 1);
+    mpv_free_node_contents(&stats);
+    check_property(mpv, "user-data/test/clicked", "c");
+
+    // clipboard and dialog requests, replied with the request id
+    send_message(mpv, "clipboard/set", "text");
+    send_message(mpv, "clipboard/get", client, "clip");
+    mpv_event_client_message *msg =
+        wait_message(mpv, "clipboard-get-reply", "clip");
+    check_int(msg->num_args, 3);
+    check_str(msg->args[2], "text");
+
+    check(mpv_set_property_string(mpv, "user-data/menu/headless/dialog",
+                                  "/a\n/b") >= 0);
+    send_message(mpv, "dialog/open-multi", client, "multi");
+    msg = wait_message(mpv, "dialog-open-multi-reply", "multi");
+    check_int(msg->num_args, 4);
+    check_str(msg->args[2], "/a");
+    check_str(msg->args[3], "/b");
+    send_message(mpv, "dialog/save", client, "save");
+    msg = wait_message(mpv, "dialog-save-reply", "save");
+    check_int(msg->num_args, 3);
+    check_str(msg->args[2], "/a");
+}
+
+static const struct test {
+    const char *name;
+    const char *script_opts;  // set before the plugin is loaded
+    void (*fn)(mpv_handle *mpv);
+} tests[] = {
+    {"coalesce", "", test_coalesce},
+    {"commands", "menu-max_inflight=2", test_commands},
+    {"smoke", "", test_smoke},
+};
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <plugin> <name>\n", argv[0]);
+        return 1;
+    }
+
+    for (int i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        if (strcmp(argv[2], tests[i].name) != 0) continue;
+
+        mpv_handle *mpv = create_player();
+        check(mpv_set_property_string(mpv, "script-opts",
+                                      tests[i].script_opts) >= 0);
+        load_plugin(mpv, argv[1]);
+        tests[i].fn(mpv);
+        mpv_terminate_destroy(mpv);
+        return 0;
+    }
+
+    fprintf(stderr, "unknown test: %s\n", argv[2]);
+    return 1;
+}
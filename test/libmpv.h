@@ -0,0 +1,167 @@
+// Copyright (c) 2023-2024 tsl0922. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+#ifndef MPV_PLUGIN_TEST_LIBMPV_H
+#define MPV_PLUGIN_TEST_LIBMPV_H
+
+#include <mpv/client.h>
+#include "menu.h"
+#include "test.h"
+
+// libmpv test helpers, the plugin is loaded as a cplugin by a player with
+// no video and audio output, so it runs with the headless backend. the
+// player's client sends the plugin client messages, like a lua client, and
+// the replies are sent to it by name.
+
+#define PLUGIN_NAME "menu"  // client name of the plugin, from its file name
+#define TEST_TIMEOUT 10     // seconds to wait for the plugin
+
+// create and init a player without config files and outputs
+static inline mpv_handle *create_player(void) {
+    mpv_handle *mpv = mpv_create();
+    check(mpv != NULL);
+    check(mpv_set_option_string(mpv, "config", "no") >= 0);
+    check(mpv_set_option_string(mpv, "load-scripts", "no") >= 0);
+    check(mpv_set_option_string(mpv, "vo", "null") >= 0);
+    check(mpv_set_option_string(mpv, "ao", "null") >= 0);
+    check(mpv_set_option_string(mpv, "idle", "yes") >= 0);
+    check(mpv_initialize(mpv) >= 0);
+    return mpv;
+}
+
+// wait for client message name, and its first argument id if it's set,
+// the message is valid until the next event is read
+static inline mpv_event_client_message *wait_message(mpv_handle *mpv,
+                                                     const char *name,
+                                                     const char *id) {
+    while (true) {
+        mpv_event *event = mpv_wait_event(mpv, TEST_TIMEOUT);
+        check(event->event_id != MPV_EVENT_NONE);  // timed out
+        check(event->event_id != MPV_EVENT_SHUTDOWN);
+        if (event->event_id != MPV_EVENT_CLIENT_MESSAGE) continue;
+
+        mpv_event_client_message *msg = event->data;
+        if (msg->num_args < 1 || strcmp(msg->args[0], name) != 0) continue;
+        if (id && (msg->num_args < 2 || strcmp(msg->args[1], id) != 0))
+            continue;
+        return msg;
+    }
+}
+
+// load plugin from path, and wait until its event loop runs
+static inline void load_plugin(mpv_handle *mpv, const char *path) {
+    check(mpv_command(mpv, (const char *[]){"load-script", path, NULL}) >= 0);
+    wait_message(mpv, "menu-init", NULL);
+}
+
+// send client message to the plugin, args is NULL terminated
+static inline void send_args(mpv_handle *mpv, const char **args) {
+    const char *cmd[16] = {"script-message-to", PLUGIN_NAME};
+    int n = 2;
+    while (*args && n < 15) cmd[n++] = *args++;
+    cmd[n] = NULL;
+    check(mpv_command(mpv, cmd) >= 0);
+}
+
+#define send_message(mpv, ...) \
+    send_args(mpv, (const char *[]){__VA_ARGS__, NULL})
+
+// wait until the plugin handled the messages sent before, they are handled
+// in order, and an empty clipboard/get with a request id is replied
+static inline void sync_plugin(mpv_handle *mpv) {
+    static int next_id;
+    char id[16];
+    snprintf(id, sizeof(id), "sync-%d", ++next_id);
+    send_message(mpv, "clipboard/get", mpv_client_name(mpv), id);
+    wait_message(mpv, "clipboard-get-reply", id);
+}
+
+// get node of map key, its first len chars, NULL if it's not set
+static inline mpv_node *node_field(mpv_node *node, const char *key,
+                                   size_t len) {
+    if (node == NULL || node->format != MPV_FORMAT_NODE_MAP) return NULL;
+
+    mpv_node_list *list = node->u.list;
+    for (int i = 0; i < list->num; i++) {
+        if (strlen(list->keys[i]) == len &&
+            strncmp(list->keys[i], key, len) == 0)
+            return &list->values[i];
+    }
+    return NULL;
+}
+
+// get node of a "/" separated path of map keys, NULL if it's not set
+static inline mpv_node *node_get(mpv_node *node, const char *path) {
+    while (*path && node) {
+        size_t len = strcspn(path, "/");
+        node = node_field(node, path, len);
+        path += len;
+        if (*path == '/') path++;
+    }
+    return node;
+}
+
+// get integer of path, it must be set
+static inline int64_t node_int(mpv_node *node, const char *path) {
+    mpv_node *value = node_get(node, path);
+    check(value && value->format == MPV_FORMAT_INT64);
+    return value->u.int64;
+}
+
+// publish and read plugin stats, free with mpv_free_node_contents()
+static inline void read_stats(mpv_handle *mpv, mpv_node *stats) {
+    send_message(mpv, "stats");
+    sync_plugin(mpv);
+    check(mpv_get_property(mpv, MENU_STATS_PROP, MPV_FORMAT_NODE, stats) >=
+          0);
+}
+
+// read stats until the integer of path is value
+//
+// menu data changes are built when the plugin's event queue is drained, so
+// stats published by a message right after a change may not include it.
+static inline void wait_stats(mpv_handle *mpv, mpv_node *stats,
+                              const char *path, int64_t value) {
+    int64_t deadline = mpv_get_time_ns(mpv) + TEST_TIMEOUT * (int64_t)1e9;
+    while (true) {
+        read_stats(mpv, stats);
+        if (node_int(stats, path) == value) return;
+        check(mpv_get_time_ns(mpv) < deadline);
+        mpv_free_node_contents(stats);
+    }
+}
+
+// set menu data of n items, titled "<title> <i>", cmd is the command of
+// each item, a printf format of i
+static inline void set_menu(mpv_handle *mpv, int n, const char *title,
+                            const char *cmd) {
+    static char *keys[] = {"title", "cmd"};
+    mpv_node *items = calloc(n, sizeof(mpv_node));
+    mpv_node_list *maps = calloc(n, sizeof(mpv_node_list));
+    mpv_node *values = calloc(n * 2, sizeof(mpv_node));
+    char *strings = calloc(n * 2, 64);
+    check(items && maps && values && strings);
+
+    for (int i = 0; i < n; i++) {
+        char *s = strings + i * 2 * 64;
+        snprintf(s, 64, "%s %d", title, i);
+        snprintf(s + 64, 64, cmd, i);
+        values[i * 2] = (mpv_node){.format = MPV_FORMAT_STRING, .u.string = s};
+        values[i * 2 + 1] =
+            (mpv_node){.format = MPV_FORMAT_STRING, .u.string = s + 64};
+        maps[i] = (mpv_node_list){.num = 2, .values = &values[i * 2],
+                                  .keys = keys};
+        items[i] =
+            (mpv_node){.format = MPV_FORMAT_NODE_MAP, .u.list = &maps[i]};
+    }
+    mpv_node_list list = {.num = n, .values = items};
+    mpv_node node = {.format = MPV_FORMAT_NODE_ARRAY, .u.list = &list};
+    check(mpv_set_property(mpv, MENU_DATA_PROP, MPV_FORMAT_NODE, &node) >= 0);
+
+    free(strings);
+    free(values);
+    free(maps);
+    free(items);
+}
+
+#endif
@@ -0,0 +1,190 @@
+// Copyright (c) 2023-2024 tsl0922. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+// menu publishing tests: the plugin thread publishes random menus and
+// patches, while the UI thread applies them, opens submenus, and shows the
+// menu and clicks its items. every published menu must be the expected
+// one, and the presented menu must end up as the last one, with valid ids.
+// build with sanitizers to catch races and use after free of the replaced
+// models.
+
+#include <stdatomic.h>
+#include "mpv_talloc.h"
+#include "osdep/threads.h"
+#include "json.h"
+#include "menu.h"
+#include "patch.h"
+#include "stub.h"
+#include "test.h"
+
+#define NUM_PUBLISH 20000
+
+struct state {
+    plugin_ctx *ctx;
+    atomic_bool done;    // plugin thread is done publishing
+    uint64_t last_hash;  // hash of the last expected model
+    int num_patched;     // patches that are applied, plugin thread
+    int num_clicks;      // clicks with a command, UI thread
+};
+
+// random patch op of a top level item, the item may not exist
+static char *random_patch(void *talloc_ctx, uint64_t *seed) {
+    int pos = 1 + test_rand_n(seed, 8);
+    int n = test_rand_n(seed, 16);
+    switch (test_rand_n(seed, 4)) {
+        case 0:
+            return talloc_asprintf(talloc_ctx,
+                                   "[{\"op\":\"set-state\",\"path\":[%d],"
+                                   "\"state\":[\"checked\"]}]",
+                                   pos);
+        case 1:
+            return talloc_asprintf(talloc_ctx,
+                                   "[{\"op\":\"set-title\",\"path\":[%d],"
+                                   "\"title\":\"item %d\"}]",
+                                   pos, n);
+        case 2:
+            return talloc_asprintf(
+                talloc_ctx,
+                "[{\"op\":\"insert\",\"path\":[%d],\"item\":{\"title\":"
+                "\"item %d\",\"cmd\":\"cmd %d\"}}]",
+                pos, n, n);
+        default:
+            return talloc_asprintf(
+                talloc_ctx, "[{\"op\":\"remove\",\"path\":[%d]}]", pos);
+    }
+}
+
+// build the expected model of menu data, or patch ops applied to m, like
+// the plugin thread does
+static menu_model *build_expected(menu_model *m, const char *json,
+                                  bool patch) {
+    void *tmp = talloc_new(NULL);
+    char *buf = talloc_strdup(tmp, json);
+    mpv_node node;
+    check(json_parse(tmp, &node, &buf, JSON_MAX_DEPTH) == 0);
+    menu_model *next =
+        patch ? patch_apply(NULL, m, &node) : model_build(NULL, &node);
+    talloc_free(tmp);
+    return next;
+}
+
+// publish random menus and patches, a patch must apply to the last
+// published menu, even if it's not presented yet
+static MP_THREAD_VOID plugin_thread(void *arg) {
+    struct state *s = arg;
+    plugin_ctx *ctx = s->ctx;
+    menu_model *expected = model_build(NULL, NULL);
+    uint64_t seed = 42;
+
+    for (int n = 0; n < NUM_PUBLISH; n++) {
+        void *tmp = talloc_new(NULL);
+        bool patch = test_rand_n(&seed, 4) == 0;
+        char *json = patch ? random_patch(tmp, &seed)
+                           : stub_menu_json(tmp, &seed, 8);
+        menu_model *next = build_expected(expected, json, patch);
+        if (patch) {
+            check(patch_menu(ctx, json) == (next != NULL));
+            s->num_patched += next != NULL;
+        } else {
+            update_menu_json(ctx, json);
+        }
+        talloc_free(tmp);
+        if (next) {
+            talloc_free(expected);
+            expected = next;
+        }
+
+        epoch_enter(ctx->epoch, MENU_READER_PLUGIN);
+        check(ctx->latest->hash[0] == expected->hash[0]);
+        epoch_leave(ctx->epoch, MENU_READER_PLUGIN);
+    }
+    s->last_hash = expected->hash[0];
+    talloc_free(expected);
+    atomic_store(&s->done, true);
+    MP_THREAD_RETURN();
+}
+
+// random native item of the presented model, 0 if there's none
+static int random_item(menu_model *m, uint64_t *seed) {
+    if (m->num_items < 2) return 0;
+    int i = 1 + test_rand_n(seed, m->num_items - 1);
+    return model_visible(m, i) && m->loaded[m->parent[i]] ? i : 0;
+}
+
+// close the shown menu with a click on a random item, the command of the
+// item in the shown model must be run
+static void click(struct state *s, uint64_t *seed) {
+    plugin_ctx *ctx = s->ctx;
+    menu_model *m = atomic_load(&ctx->model);
+    int i = random_item(m, seed);
+    const char *cmd = i && m->cmd[i] ? model_str(m, m->cmd[i]) : "";
+    char expected[256];
+    snprintf(expected, sizeof(expected), "%s", cmd);
+
+    stub_command[0] = '\0';
+    close_menu(ctx, &stub_diff_ops, i ? m->id[i] : 0);
+    check_str(stub_command, expected);
+    if (expected[0]) s->num_clicks++;
+}
+
+static MP_THREAD_VOID ui_thread(void *arg) {
+    struct state *s = arg;
+    plugin_ctx *ctx = s->ctx;
+    uint8_t *seen = talloc_size(NULL, MENU_ID_MAX + 1);
+    uint64_t seed = 7;
+
+    // a menu published while it's shown is pending until it's closed
+    for (int n = 0; !atomic_load(&s->done) || atomic_load(&ctx->pending) ||
+                    ctx->menu_open;
+         n++) {
+        int r = test_rand_n(&seed, 16);
+        if (ctx->menu_open) {
+            if (r < 2) click(s, &seed);
+        } else if (r == 0) {
+            open_menu(ctx);
+        } else {
+            apply_menu(ctx, &stub_diff_ops);
+        }
+
+        menu_model *m = atomic_load(&ctx->model);
+        int i = random_item(m, &seed);
+        if (i) menu_load(m, i, &stub_diff_ops, ctx);
+        if (n % 64 == 0) stub_check_ids(ctx, seen);
+    }
+    stub_check_ids(ctx, seen);
+
+    talloc_free(seen);
+    MP_THREAD_RETURN();
+}
+
+static void test_publish(void) {
+    struct state s = {.ctx = stub_ctx_create()};
+    atomic_init(&s.done, false);
+    plugin_ctx *ctx = s.ctx;
+
+    mp_thread plugin, ui;
+    check(mp_thread_create(&ui, ui_thread, &s) == 0);
+    check(mp_thread_create(&plugin, plugin_thread, &s) == 0);
+    mp_thread_join(plugin);
+    mp_thread_join(ui);
+
+    check(!ctx->menu_open);
+    check(atomic_load(&ctx->pending) == NULL);
+    check(atomic_load(&ctx->model)->hash[0] == s.last_hash);
+    check(s.num_patched > 0 && s.num_clicks > 0);
+
+    // every id is released with the items
+    char empty[] = "[]";
+    update_menu_json(ctx, empty);
+    apply_menu(ctx, &stub_diff_ops);
+    int size = MENU_ID_MAX - MENU_ID_BASE + 1;
+    for (int i = 0; i < size; i++) check(idmap_alloc(ctx->idmap, 1) != 0);
+    check_int(idmap_alloc(ctx->idmap, 1), 0);
+
+    stub_ctx_destroy(ctx);
+}
+
+int main(void) {
+    test_publish();
+    return 0;
+}
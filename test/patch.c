@@ -0,0 +1,130 @@
+// Copyright (c) 2023-2024 tsl0922. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+// menu patch tests: patch_apply() is checked against menu data with the
+// patch applied, which must build the same model
+
+#include "mpv_talloc.h"
+#include "json.h"
+#include "patch.h"
+#include "test.h"
+
+// build model from menu data json
+static menu_model *build(void *talloc_ctx, const char *json) {
+    char *buf = talloc_strdup(talloc_ctx, json);
+    mpv_node node;
+    check(json_parse(talloc_ctx, &node, &buf, JSON_MAX_DEPTH) == 0);
+    return model_build(talloc_ctx, &node);
+}
+
+// apply patch ops json to m, return NULL if it's rejected
+static menu_model *patch(void *talloc_ctx, menu_model *m, const char *json) {
+    void *tmp = talloc_new(NULL);
+    char *buf = talloc_strdup(tmp, json);
+    mpv_node node;
+    check(json_parse(tmp, &node, &buf, JSON_MAX_DEPTH) == 0);
+    menu_model *c = patch_apply(talloc_ctx, m, &node);
+    talloc_free(tmp);
+    return c;
+}
+
+#define MENU                                                              \
+    "[{\"title\":\"a\",\"cmd\":\"x\"},{\"title\":\"b\",\"cmd\":\"y\"}]"
+
+// path indexes out of the int range, or not integral, are rejected
+static void test_path(void) {
+    void *tmp = talloc_new(NULL);
+    menu_model *m = build(tmp, MENU);
+
+    static const char *invalid[] = {
+        "0", "-1", "3", "1.5", "4294967297", "4294967298", "1e300", "\"1\"",
+    };
+    for (int i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        char *ops = talloc_asprintf(
+            tmp, "[{\"op\":\"set-state\",\"path\":[%s],\"state\":[]}]",
+            invalid[i]);
+        check(patch(tmp, m, ops) == NULL);
+    }
+
+    menu_model *c = patch(
+        tmp, m, "[{\"op\":\"set-title\",\"path\":[2.0],\"title\":\"c\"}]");
+    check(c != NULL);
+    check_str(model_str(c, c->label[2]), "c");
+
+    talloc_free(tmp);
+}
+
+// set-title recomputes the flags of the item, and the empty flag of its
+// submenu, like the menu data with the new title does
+static void test_title(void) {
+    void *tmp = talloc_new(NULL);
+    menu_model *m = build(
+        tmp,
+        "[{\"type\":\"submenu\",\"title\":\"s\",\"submenu\":["
+        "{\"cmd\":\"x\"},{\"title\":\"b\",\"state\":[\"hidden\"]}]}]");
+    check(m->flags[2] & MENU_HIDDEN);
+    check(m->flags[1] & MENU_EMPTY);
+
+    menu_model *c = patch(
+        tmp, m,
+        "[{\"op\":\"set-title\",\"path\":[1,1],\"title\":\"a\"},"
+        "{\"op\":\"set-title\",\"path\":[1,2],\"title\":\"c\"}]");
+    check(c != NULL);
+    check(!(c->flags[2] & MENU_HIDDEN));
+    check(c->flags[3] & MENU_HIDDEN);  // hidden by state
+    check(!(c->flags[1] & MENU_EMPTY));
+
+    menu_model *e = build(
+        tmp,
+        "[{\"type\":\"submenu\",\"title\":\"s\",\"submenu\":["
+        "{\"title\":\"a\",\"cmd\":\"x\"},"
+        "{\"title\":\"c\",\"state\":[\"hidden\"]}]}]");
+    check(c->hash[0] == e->hash[0]);
+
+    // the state is kept by later patches
+    c = patch(tmp, c,
+              "[{\"op\":\"set-title\",\"path\":[1,2],\"title\":\"b\"},"
+              "{\"op\":\"set-state\",\"path\":[1,1],\"state\":[]}]");
+    check(c != NULL);
+    check(c->flags[3] & MENU_HIDDEN);
+    check(!(c->flags[2] & MENU_HIDDEN));
+
+    talloc_free(tmp);
+}
+
+// the arena of a patched model doesn't grow with the number of patches,
+// once the titles have the same length. a splice keeps the space reserved
+// for the titles of the same patch.
+static void test_arena(void) {
+    void *tmp = talloc_new(NULL);
+    menu_model *m = build(tmp, MENU);
+    size_t max_bytes = 0;
+
+    for (int n = 0; n < 1000; n++) {
+        char *ops = talloc_asprintf(
+            tmp,
+            "[{\"op\":\"set-title\",\"path\":[1],\"title\":\"a %03d\"},"
+            "{\"op\":\"insert\",\"path\":[3],\"item\":{\"title\":\"c\"}},"
+            "{\"op\":\"set-title\",\"path\":[2],\"title\":\"b %03d\"},"
+            "{\"op\":\"remove\",\"path\":[3]}]",
+            n, n);
+        menu_model *c = patch(NULL, m, ops);
+        check(c != NULL);
+        check_str(model_str(c, c->label[1]), talloc_asprintf(tmp, "a %03d", n));
+        check_str(model_str(c, c->label[2]), talloc_asprintf(tmp, "b %03d", n));
+        if (n == 1) max_bytes = c->max_bytes;
+        if (n > 1) check_int(c->max_bytes, max_bytes);
+
+        if (n > 0) talloc_free(m);
+        m = c;
+    }
+    talloc_free(m);
+    talloc_free(tmp);
+}
+
+int main(void) {
+    test_path();
+    test_title();
+    test_arena();
+    return 0;
+}
@@ -0,0 +1,132 @@
+// Copyright (c) 2023-2024 tsl0922. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+// plugin stats tests: the histogram summary and the stats nodes published
+// to user-data/menu/stats, and the dispatch queue depth, which is read by
+// the plugin thread on every wakeup without taking the queue lock
+
+#include "mpv_talloc.h"
+#include "misc/dispatch.h"
+#include "osdep/timer.h"
+#include "stats.h"
+#include "test.h"
+
+// get node of map field, NULL if it's not set
+static mpv_node *field(mpv_node *node, const char *key) {
+    check(node->format == MPV_FORMAT_NODE_MAP);
+    mpv_node_list *list = node->u.list;
+    for (int i = 0; i < list->num; i++)
+        if (strcmp(list->keys[i], key) == 0) return &list->values[i];
+    return NULL;
+}
+
+// get integer map field, the field must be set
+static int64_t int_field(mpv_node *node, const char *key) {
+    mpv_node *value = field(node, key);
+    check(value && value->format == MPV_FORMAT_INT64);
+    return value->u.int64;
+}
+
+static void test_hist(void) {
+    void *tmp = talloc_new(NULL);
+    histogram h = {0};
+    mpv_node node;
+
+    stats_hist_node(&h, tmp, &node, 0);
+    check_int(int_field(&node, "count"), 0);
+    check_int(int_field(&node, "mean-ns"), 0);
+    check_int(int_field(&node, "p99-ns"), 0);
+
+    // 1000 values of 100, and 10 of 100000
+    for (int i = 0; i < 1000; i++) hist_add(&h, 100);
+    for (int i = 0; i < 10; i++) hist_add(&h, 100000);
+
+    mpv_node_list *list = stats_hist_node(&h, tmp, &node, 1);
+    stats_add_int(list, "extra", 42);
+    check_int(list->num, 7);
+    check_int(int_field(&node, "count"), 1010);
+    check_int(int_field(&node, "mean-ns"), (100 * 1000 + 100000 * 10) / 1010);
+    check_int(int_field(&node, "p50-ns"), 127);  // upper bound of [64, 128)
+    check_int(int_field(&node, "p99-ns"), 127);
+    check_int(int_field(&node, "p999-ns"), 100000);  // capped by max
+    check_int(int_field(&node, "max-ns"), 100000);
+    check_int(int_field(&node, "extra"), 42);
+
+    talloc_free(tmp);
+}
+
+// events that are never handled, or have no name, are left out
+static void test_events(void) {
+    void *tmp = talloc_new(NULL);
+    plugin_stats *s = talloc_zero(tmp, plugin_stats);
+    hist_add(&s->events[MPV_EVENT_PROPERTY_CHANGE], 1000);
+    hist_add(&s->events[MPV_EVENT_PROPERTY_CHANGE], 3000);
+    hist_add(&s->events[MPV_EVENT_CLIENT_MESSAGE], 500);
+    hist_add(&s->events[STATS_MAX_EVENTS - 1], 500);
+
+    mpv_node node;
+    stats_events_node(s, tmp, &node);
+    check_int(node.u.list->num, 2);
+    check(field(&node, "shutdown") == NULL);
+    check_int(int_field(field(&node, "property-change"), "count"), 2);
+    check_int(int_field(field(&node, "property-change"), "mean-ns"), 2000);
+    check_int(int_field(field(&node, "client-message"), "max-ns"), 500);
+
+    s->init_ns = 1;
+    s->first_build_ns = 3;
+    atomic_store(&s->native_menu_ns, 5);
+    stats_startup_node(s, tmp, &node);
+    check_int(int_field(&node, "init-ns"), 1);
+    check_int(int_field(&node, "setup-ns"), 0);
+    check_int(int_field(&node, "first-build-ns"), 3);
+    check_int(int_field(&node, "window-ns"), 0);
+    check_int(int_field(&node, "native-menu-ns"), 5);
+
+    s->dispatch_depth = 7;
+    hist_add(&s->dispatch, 2000);
+    stats_dispatch_node(s, tmp, &node);
+    check_int(int_field(&node, "count"), 1);
+    check_int(int_field(&node, "max-depth"), 7);
+
+    talloc_free(tmp);
+}
+
+static int num_runs;
+
+static void count_fn(void *data) { num_runs++; }
+
+// the depth counts queued items of all lanes, merged items once, and
+// delayed items only once they are due
+static void test_depth(void) {
+    mp_dispatch_queue *queue = mp_dispatch_create(NULL);
+    int key;
+
+    check_int(mp_dispatch_queue_depth(queue), 0);
+    mp_dispatch_enqueue(queue, count_fn, NULL);
+    mp_dispatch_enqueue_copy(queue, MP_DISPATCH_BACKGROUND, count_fn, &key,
+                             sizeof(key));
+    mp_dispatch_enqueue_notify(queue, count_fn, &key);
+    mp_dispatch_enqueue_notify(queue, count_fn, &key);  // merged
+    check_int(mp_dispatch_queue_depth(queue), 3);
+
+    mp_dispatch_enqueue_after(queue, 3600, count_fn, NULL);
+    mp_dispatch_enqueue_after(queue, 0, count_fn, &num_runs);
+    check_int(mp_dispatch_queue_depth(queue), 3);
+
+    mp_dispatch_cancel_fn(queue, count_fn, &key);
+    check_int(mp_dispatch_queue_depth(queue), 2);
+
+    mp_dispatch_queue_process(queue, 0);
+    check_int(num_runs, 3);
+    check_int(mp_dispatch_queue_depth(queue), 0);
+
+    mp_dispatch_cancel_fn(queue, count_fn, NULL);
+    talloc_free(queue);
+}
+
+int main(void) {
+    test_hist();
+    test_events();
+    test_depth();
+    return 0;
+}
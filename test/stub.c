@@ -0,0 +1,130 @@
+// Copyright (c) 2023-2024 tsl0922. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+#include <stdio.h>
+#include <string.h>
+#include "mpv_talloc.h"
+#include "osdep/timer.h"
+#include "backend.h"
+#include "menu.h"
+#include "stub.h"
+#include "test.h"
+
+void (*stub_update)(plugin_ctx *ctx) = NULL;
+char stub_command[256];
+
+int64_t mpv_get_time_ns(mpv_handle *ctx) { return mp_time_ns(); }
+
+const char *mpv_event_name(mpv_event_id event) {
+    switch (event) {
+        case MPV_EVENT_SHUTDOWN:
+            return "shutdown";
+        case MPV_EVENT_CLIENT_MESSAGE:
+            return "client-message";
+        case MPV_EVENT_PROPERTY_CHANGE:
+            return "property-change";
+        default:
+            return NULL;
+    }
+}
+
+void backend_update(plugin_ctx *ctx) {
+    if (stub_update) stub_update(ctx);
+}
+
+void mp_command_async(const char *args, bool clicked) {
+    if (strncmp(args, "script-message menu-", 20) == 0) return;
+    snprintf(stub_command, sizeof(stub_command), "%s", args);
+}
+
+// create plugin context with the menu state only, like create_plugin_ctx()
+plugin_ctx *stub_ctx_create(void) {
+    plugin_ctx *ctx = talloc_zero(NULL, plugin_ctx);
+    ctx->latest = model_build(NULL, NULL);
+    atomic_init(&ctx->model, ctx->latest);
+    atomic_init(&ctx->pending, NULL);
+    ctx->epoch = epoch_create(ctx, MENU_READER_SLOTS);
+    ctx->idmap = idmap_create(ctx, MENU_ID_BASE, MENU_ID_MAX);
+    return ctx;
+}
+
+void stub_ctx_destroy(plugin_ctx *ctx) {
+    talloc_free(atomic_exchange(&ctx->pending, NULL));
+    talloc_free(atomic_exchange(&ctx->model, NULL));
+    talloc_free(ctx);
+}
+
+static void diff_insert(void *data, menu_model *m, int parent, int pos,
+                        int item) {
+    plugin_ctx *ctx = data;
+    m->id[item] = idmap_alloc(ctx->idmap, item);
+}
+
+static void diff_remove(void *data, menu_model *m, int parent, int pos,
+                        int item) {
+    free_menu_ids(data, m, item);
+}
+
+static void diff_update(void *data, menu_model *m, int parent, int pos,
+                        int item, int changes) {}
+
+const struct diff_ops stub_diff_ops = {
+    .insert = diff_insert,
+    .remove = diff_remove,
+    .update = diff_update,
+};
+
+// every native item of the presented model has a unique id, which maps to
+// its index. seen is scratch space of MENU_ID_MAX + 1 bytes.
+void stub_check_ids(plugin_ctx *ctx, uint8_t *seen) {
+    menu_model *m = atomic_load(&ctx->model);
+    memset(seen, 0, MENU_ID_MAX + 1);
+    for (int i = 1; i < m->num_items; i++) {
+        if (!model_visible(m, i) || !m->loaded[m->parent[i]]) continue;
+
+        unsigned int id = m->id[i];
+        check(id >= MENU_ID_BASE && id <= MENU_ID_MAX);
+        check(!seen[id]);
+        seen[id] = 1;
+        check_int(idmap_get(ctx->idmap, id, idmap_gen(ctx->idmap)), i);
+    }
+}
+
+// append random menu items, titles are taken from a small set, so that the
+// menus of consecutive calls share items
+static char *add_items(char *json, uint64_t *seed, int depth, int max_items) {
+    static const char *states[] = {"", "\"checked\"", "\"disabled\"",
+                                   "\"hidden\""};
+    int count = test_rand_n(seed, max_items + 1);
+
+    json = talloc_strdup_append_buffer(json, "[");
+    for (int i = 0; i < count; i++) {
+        if (i > 0) json = talloc_strdup_append_buffer(json, ",");
+
+        int type = test_rand_n(seed, 10);
+        if (type == 0) {
+            json =
+                talloc_strdup_append_buffer(json, "{\"type\":\"separator\"}");
+            continue;
+        }
+
+        int n = test_rand_n(seed, 16);
+        int state = test_rand_n(seed, 8);
+        json = talloc_asprintf_append_buffer(
+            json, "{\"title\":\"item %d\",\"cmd\":\"cmd %d\",\"state\":[%s]", n,
+            n, states[state < 4 ? state : 0]);
+        if (type <= 3 && depth > 0) {
+            json = talloc_strdup_append_buffer(
+                json, ",\"type\":\"submenu\",\"submenu\":");
+            json = add_items(json, seed, depth - 1, max_items);
+        }
+        json = talloc_strdup_append_buffer(json, "}");
+    }
+    return talloc_strdup_append_buffer(json, "]");
+}
+
+// build random menu data in json, submenus are nested up to 3 levels, with
+// at most max_items items each
+char *stub_menu_json(void *talloc_ctx, uint64_t *seed, int max_items) {
+    return add_items(talloc_strdup(talloc_ctx, ""), seed, 3, max_items);
+}
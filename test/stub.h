@@ -0,0 +1,38 @@
+// Copyright (c) 2023-2024 tsl0922. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+#ifndef MPV_PLUGIN_TEST_STUB_H
+#define MPV_PLUGIN_TEST_STUB_H
+
+#include "diff.h"
+#include "plugin.h"
+
+// stubs of the plugin and mpv client functions called by the menu core, so
+// menu.c is tested without the event loop and a backend
+//
+// backend_update() calls stub_update, if it's set. mp_command_async()
+// records the command in stub_command, the menu-open and menu-close
+// messages are ignored. mpv_event_name() only knows the events handled by
+// the plugin.
+extern void (*stub_update)(plugin_ctx *ctx);
+extern char stub_command[256];
+
+// diff ops of the headless backend, ids are allocated for inserted items
+extern const struct diff_ops stub_diff_ops;
+
+// fake blocking dialogs of dialog.h, a dialog blocks the calling thread
+// until it's closed, like a modal dialog waits for the user. the result of
+// a closed dialog is the path it's closed with, or NULL if it's cancelled.
+// stub_dialog_wait() waits until a dialog is shown, and returns the number
+// of dialogs shown so far. stub_dialog_cancel_all() cancels the shown
+// dialog and every later one.
+int stub_dialog_wait(void);
+void stub_dialog_close(const char *path);
+void stub_dialog_cancel_all(void);
+
+plugin_ctx *stub_ctx_create(void);
+void stub_ctx_destroy(plugin_ctx *ctx);
+char *stub_menu_json(void *talloc_ctx, uint64_t *seed, int max_items);
+void stub_check_ids(plugin_ctx *ctx, uint8_t *seen);
+
+#endif
@@ -0,0 +1,60 @@
+// Copyright (c) 2023-2024 tsl0922. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+#ifndef MPV_PLUGIN_TEST_H
+#define MPV_PLUGIN_TEST_H
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// test helpers, a failed check prints its location and exits, so a test is
+// a plain program that returns 0 if all checks pass
+
+#define check(cond)                                                      \
+    do {                                                                 \
+        if (!(cond)) {                                                   \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__,       \
+                    __LINE__, #cond);                                    \
+            exit(1);                                                     \
+        }                                                                \
+    } while (0)
+
+#define check_int(a, b)                                                  \
+    do {                                                                 \
+        int64_t a_ = (a), b_ = (b);                                      \
+        if (a_ != b_) {                                                  \
+            fprintf(stderr, "%s:%d: check failed: %s == %s (%" PRId64    \
+                    " != %" PRId64 ")\n",                                \
+                    __FILE__, __LINE__, #a, #b, a_, b_);                 \
+            exit(1);                                                     \
+        }                                                                \
+    } while (0)
+
+#define check_str(a, b)                                                  \
+    do {                                                                 \
+        const char *a_ = (a), *b_ = (b);                                 \
+        if (strcmp(a_, b_) != 0) {                                       \
+            fprintf(stderr, "%s:%d: check failed: %s == %s (\"%s\" != "  \
+                    "\"%s\")\n",                                         \
+                    __FILE__, __LINE__, #a, #b, a_, b_);                 \
+            exit(1);                                                     \
+        }                                                                \
+    } while (0)
+
+// deterministic xorshift64 random numbers, so a failure can be replayed
+static inline uint64_t test_rand(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+// random number in range [0, n)
+static inline int test_rand_n(uint64_t *state, int n) {
+    return (int)(test_rand(state) % (uint64_t)n);
+}
+
+#endif
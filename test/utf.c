@@ -0,0 +1,290 @@
+// Copyright (c) 2023-2024 tsl0922. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+// utf conversion tests: the vectorized converters are checked against
+// scalar reference converters, on hand picked invalid and surrogate input,
+// and on random input, where ascii runs cross the vector block boundaries.
+//
+// the utf8 reference doesn't decode by rules, it looks up the prefixes of
+// the encodings of all unicode scalar values, so a wrong byte range in the
+// converter can't be repeated by the reference.
+
+#include "mpv_talloc.h"
+#include "utf.h"
+#include "test.h"
+
+#define REPLACEMENT_CHAR 0xFFFD
+
+// encode code point as utf8, return the number of bytes
+static int encode_utf8(unsigned char *d, uint32_t cp) {
+    if (cp < 0x80) {
+        d[0] = cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        d[0] = 0xC0 | (cp >> 6);
+        d[1] = 0x80 | (cp & 0x3F);
+        return 2;
+    }
+    if (cp < 0x10000) {
+        d[0] = 0xE0 | (cp >> 12);
+        d[1] = 0x80 | ((cp >> 6) & 0x3F);
+        d[2] = 0x80 | (cp & 0x3F);
+        return 3;
+    }
+    d[0] = 0xF0 | (cp >> 18);
+    d[1] = 0x80 | ((cp >> 12) & 0x3F);
+    d[2] = 0x80 | ((cp >> 6) & 0x3F);
+    d[3] = 0x80 | (cp & 0x3F);
+    return 4;
+}
+
+// well-formed utf8 prefixes of 1 to 3 bytes, and the sequence length of
+// each lead byte, built from the encodings of all scalar values
+static uint8_t *prefix[4];
+static int seq_len[256];
+
+static void set_bit(uint8_t *map, uint32_t i) { map[i >> 3] |= 1 << (i & 7); }
+
+static bool get_bit(const uint8_t *map, uint32_t i) {
+    return map[i >> 3] & (1 << (i & 7));
+}
+
+static void init_prefixes(void *talloc_ctx) {
+    for (int k = 1; k <= 3; k++)
+        prefix[k] = talloc_zero_size(talloc_ctx, ((size_t)1 << (8 * k)) / 8);
+
+    for (uint32_t cp = 0; cp <= 0x10FFFF; cp++) {
+        if (cp >= 0xD800 && cp <= 0xDFFF) continue;
+        unsigned char b[4];
+        int n = encode_utf8(b, cp);
+        seq_len[b[0]] = n;
+        uint32_t key = 0;
+        for (int k = 1; k <= n && k <= 3; k++) {
+            key = key << 8 | b[k - 1];
+            set_bit(prefix[k], key);
+        }
+    }
+}
+
+// reference utf8 to utf16 conversion: the longest well-formed prefix at
+// each position is either a whole sequence, or a maximal subpart which is
+// replaced by one U+FFFD
+static size_t ref_utf8_to_utf16(uint16_t *dst, const unsigned char *s,
+                                size_t len) {
+    size_t i = 0, j = 0;
+    while (i < len) {
+        int n = seq_len[s[i]];
+        int k = 0;
+        uint32_t key = 0;
+        while (k < 3 && i + k < len) {
+            uint32_t next = key << 8 | s[i + k];
+            if (!get_bit(prefix[k + 1], next)) break;
+            key = next, k++;
+        }
+        // a valid 3 byte prefix of a 4 byte sequence takes any continuation
+        if (k == 3 && n == 4 && i + 3 < len && (s[i + 3] & 0xC0) == 0x80)
+            key = key << 8 | s[i + 3], k++;
+
+        if (n == 0 || k < n) {
+            dst[j++] = REPLACEMENT_CHAR;
+            i += k ? k : 1;
+            continue;
+        }
+
+        uint32_t cp = n == 1 ? s[i] : (s[i] & (0x7F >> n)) << (6 * (n - 1));
+        for (int m = 1; m < n; m++)
+            cp |= (s[i + m] & 0x3F) << (6 * (n - 1 - m));
+        if (cp >= 0x10000) {
+            dst[j++] = 0xD800 | ((cp - 0x10000) >> 10);
+            dst[j++] = 0xDC00 | ((cp - 0x10000) & 0x3FF);
+        } else {
+            dst[j++] = cp;
+        }
+        i += n;
+    }
+    return j;
+}
+
+// reference utf16 to utf8 conversion, unpaired surrogates are replaced
+static size_t ref_utf16_to_utf8(unsigned char *dst, const uint16_t *s,
+                                size_t len) {
+    size_t j = 0;
+    for (size_t i = 0; i < len; i++) {
+        uint32_t cp = s[i];
+        bool high = cp >= 0xD800 && cp <= 0xDBFF;
+        bool low_next = i + 1 < len && s[i + 1] >= 0xDC00 && s[i + 1] <= 0xDFFF;
+        if (high && low_next) {
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (s[++i] - 0xDC00);
+        } else if (cp >= 0xD800 && cp <= 0xDFFF) {
+            cp = REPLACEMENT_CHAR;
+        }
+        j += encode_utf8(dst + j, cp);
+    }
+    return j;
+}
+
+// convert with both converters and compare, the output buffers are
+// canaried, so a write past the returned length is caught
+static void check_utf8(const char *src, size_t len) {
+    uint16_t *out = talloc_array(NULL, uint16_t, UTF16_MAX_LEN(len) + 1);
+    uint16_t *ref = talloc_array(NULL, uint16_t, UTF16_MAX_LEN(len) + 1);
+    out[UTF16_MAX_LEN(len)] = 0xABCD;
+
+    size_t n = utf8_to_utf16(out, src, len);
+    size_t r = ref_utf8_to_utf16(ref, (const unsigned char *)src, len);
+    check_int(n, r);
+    check(memcmp(out, ref, n * sizeof(uint16_t)) == 0);
+    check_int(out[UTF16_MAX_LEN(len)], 0xABCD);
+
+    talloc_free(out);
+    talloc_free(ref);
+}
+
+static void check_utf16(const uint16_t *src, size_t len) {
+    char *out = talloc_array(NULL, char, UTF8_MAX_LEN(len) + 1);
+    unsigned char *ref = talloc_array(NULL, unsigned char, UTF8_MAX_LEN(len));
+    out[UTF8_MAX_LEN(len)] = 0x5A;
+
+    size_t n = utf16_to_utf8(out, src, len);
+    size_t r = ref_utf16_to_utf8(ref, src, len);
+    check_int(n, r);
+    check(memcmp(out, ref, n) == 0);
+    check_int(out[UTF8_MAX_LEN(len)], 0x5A);
+
+    talloc_free(out);
+    talloc_free(ref);
+}
+
+// hand picked utf8 input, with the expected utf16 output
+static void test_utf8_cases(void) {
+    static const struct {
+        const char *src;
+        uint16_t out[8];
+        int num;
+    } cases[] = {
+        {"a\xc3\xa9", {'a', 0xE9}, 2},
+        {"\xe4\xb8\xad", {0x4E2D}, 1},
+        {"\xf0\x9f\x98\x80", {0xD83D, 0xDE00}, 2},
+        {"\xf4\x8f\xbf\xbf", {0xDBFF, 0xDFFF}, 2},  // U+10FFFF
+        {"\xc0\xaf", {0xFFFD, 0xFFFD}, 2},          // overlong '/'
+        {"\xe0\x80\xaf", {0xFFFD, 0xFFFD, 0xFFFD}, 3},
+        {"\xed\xa0\x80", {0xFFFD, 0xFFFD, 0xFFFD}, 3},  // surrogate D800
+        {"\xed\xbf\xbf", {0xFFFD, 0xFFFD, 0xFFFD}, 3},  // surrogate DFFF
+        {"\xed\x9f\xbf", {0xD7FF}, 1},
+        {"\xf4\x90\x80\x80", {0xFFFD, 0xFFFD, 0xFFFD, 0xFFFD}, 4},
+        {"\xf5\x80", {0xFFFD, 0xFFFD}, 2},
+        {"\xe4\xb8", {0xFFFD}, 1},      // truncated
+        {"\xe4\xb8x", {0xFFFD, 'x'}, 2},
+        {"\xf0\x9f\x98", {0xFFFD}, 1},  // truncated
+        {"\x80\xbf", {0xFFFD, 0xFFFD}, 2},
+        {"\xfe\xff", {0xFFFD, 0xFFFD}, 2},
+    };
+    for (int i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        uint16_t out[16];
+        size_t n = utf8_to_utf16(out, cases[i].src, strlen(cases[i].src));
+        check_int(n, cases[i].num);
+        check(memcmp(out, cases[i].out, n * sizeof(uint16_t)) == 0);
+        check_utf8(cases[i].src, strlen(cases[i].src));
+    }
+}
+
+// hand picked utf16 input, with the expected utf8 output
+static void test_utf16_cases(void) {
+    static const struct {
+        uint16_t src[4];
+        int len;
+        const char *out;
+    } cases[] = {
+        {{'a', 0xE9}, 2, "a\xc3\xa9"},
+        {{0xD83D, 0xDE00}, 2, "\xf0\x9f\x98\x80"},
+        {{0xD83D}, 1, "\xef\xbf\xbd"},             // lone high surrogate
+        {{0xDE00, 'a'}, 2, "\xef\xbf\xbd" "a"},    // lone low surrogate
+        {{0xDE00, 0xD83D}, 2, "\xef\xbf\xbd\xef\xbf\xbd"},
+        {{0xD83D, 0xD83D, 0xDE00}, 3, "\xef\xbf\xbd\xf0\x9f\x98\x80"},
+        {{0xFFFF, 0x7FF, 0x800}, 3, "\xef\xbf\xbf\xdf\xbf\xe0\xa0\x80"},
+    };
+    for (int i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        char out[16];
+        size_t n = utf16_to_utf8(out, cases[i].src, cases[i].len);
+        check_int(n, strlen(cases[i].out));
+        check(memcmp(out, cases[i].out, n) == 0);
+        check_utf16(cases[i].src, cases[i].len);
+    }
+}
+
+// random input, ascii runs of random length, so the vector loops exit at
+// every offset, mixed with valid sequences and random bytes or units
+static void test_random(void) {
+    uint64_t seed = 42;
+    char src[256];
+    uint16_t src16[256];
+
+    for (int round = 0; round < 20000; round++) {
+        size_t len = 0;
+        while (len < sizeof(src) - 8) {
+            int kind = test_rand_n(&seed, 4);
+            if (kind == 0) {
+                int run = test_rand_n(&seed, 40);
+                for (int k = 0; k < run && len < sizeof(src) - 8; k++)
+                    src[len++] = 0x20 + test_rand_n(&seed, 0x5F);
+            } else if (kind == 1) {
+                uint32_t cp = test_rand_n(&seed, 0x110000);
+                if (cp >= 0xD800 && cp <= 0xDFFF) cp = 0xE000;
+                len += encode_utf8((unsigned char *)src + len, cp);
+            } else if (kind == 2) {
+                // lead byte with random continuations, often invalid
+                src[len++] = 0xC0 + test_rand_n(&seed, 0x40);
+                int n = test_rand_n(&seed, 4);
+                for (int k = 0; k < n; k++)
+                    src[len++] = 0x80 + test_rand_n(&seed, 0x40);
+            } else {
+                src[len++] = test_rand_n(&seed, 256);
+            }
+            if (test_rand_n(&seed, 16) == 0) break;
+        }
+        check_utf8(src, len);
+
+        size_t len16 = 0;
+        while (len16 < 256) {
+            int kind = test_rand_n(&seed, 4);
+            if (kind == 0) {
+                int run = test_rand_n(&seed, 40);
+                for (int k = 0; k < run && len16 < 256; k++)
+                    src16[len16++] = 0x20 + test_rand_n(&seed, 0x5F);
+            } else if (kind == 1) {
+                src16[len16++] = 0xD800 + test_rand_n(&seed, 0x800);
+            } else {
+                src16[len16++] = test_rand_n(&seed, 0x10000);
+            }
+            if (test_rand_n(&seed, 16) == 0) break;
+        }
+        check_utf16(src16, len16);
+    }
+}
+
+// every scalar value survives a round trip
+static void test_round_trip(void) {
+    unsigned char buf[4];
+    uint16_t mid[2];
+    char back[8];
+    for (uint32_t cp = 0; cp <= 0x10FFFF; cp++) {
+        if (cp >= 0xD800 && cp <= 0xDFFF) continue;
+        int n = encode_utf8(buf, cp);
+        size_t m = utf8_to_utf16(mid, (const char *)buf, n);
+        check_int(m, cp >= 0x10000 ? 2 : 1);
+        check_int(utf16_to_utf8(back, mid, m), n);
+        check(memcmp(back, buf, n) == 0);
+    }
+}
+
+int main(void) {
+    void *tmp = talloc_new(NULL);
+    init_prefixes(tmp);
+    test_utf8_cases();
+    test_utf16_cases();
+    test_random();
+    test_round_trip();
+    talloc_free(tmp);
+    return 0;
+}
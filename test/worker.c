@@ -0,0 +1,137 @@
+// Copyright (c) 2023-2024 tsl0922. All rights reserved.
+// SPDX-License-Identifier: GPL-2.0-only
+
+// worker tests: requests open fake blocking dialogs on the worker thread,
+// the replies must run in order on the reply queue, which is never blocked
+// by a shown dialog. freeing the worker while a dialog is shown must wait
+// for it, and drop the queued requests. build with sanitizers to catch
+// leaked requests.
+
+#include <stdatomic.h>
+#include <unistd.h>
+#include "mpv_talloc.h"
+#include "osdep/threads.h"
+#include "osdep/timer.h"
+#include "dialog.h"
+#include "stub.h"
+#include "test.h"
+#include "worker.h"
+
+static atomic_int num_init, num_uninit;
+static int num_runs;  // worker thread only
+
+static void thread_init(void) { atomic_fetch_add(&num_init, 1); }
+
+static void thread_uninit(void) { atomic_fetch_add(&num_uninit, 1); }
+
+struct request {
+    char *log;     // replies so far, on the reply queue
+    char *result;  // path of the dialog, set on the worker thread
+};
+
+static void run_dialog(void *data) {
+    struct request *req = data;
+    req->result = open_dialog(req, NULL);
+    num_runs++;
+}
+
+static void reply_dialog(void *data) {
+    struct request *req = data;
+    size_t len = strlen(req->log);
+    snprintf(req->log + len, 64 - len, "%s%s", len ? " " : "",
+             req->result ? req->result : "-");
+}
+
+static void submit(worker *w, char *log) {
+    struct request *req = talloc_zero(NULL, struct request);
+    req->log = log;
+    worker_submit(w, run_dialog, reply_dialog, req);
+}
+
+static void nop_fn(void *data) { *(bool *)data = true; }
+
+// process the reply queue until log has n replies
+static void wait_replies(mp_dispatch_queue *queue, const char *log, int n) {
+    int64_t timeout = mp_time_ns() + 5000000000;
+    while (mp_time_ns() < timeout) {
+        int count = log[0] != '\0';
+        for (const char *p = log; *p; p++) count += *p == ' ';
+        if (count >= n) return;
+        mp_dispatch_queue_process(queue, 0.01);
+    }
+    check(!"timeout waiting for replies");
+}
+
+static void test_order(void) {
+    mp_dispatch_queue *queue = mp_dispatch_create(NULL);
+    worker *w = worker_create(NULL, queue, thread_init, thread_uninit);
+    char log[64] = "";
+    num_runs = 0;
+
+    for (int i = 0; i < 3; i++) submit(w, log);
+    check_int(stub_dialog_wait(), 1);
+    check_int(worker_pending(w), 3);
+
+    // the reply queue runs while the dialog is shown
+    bool ran = false;
+    mp_dispatch_enqueue(queue, nop_fn, &ran);
+    mp_dispatch_queue_process(queue, 0);
+    check(ran);
+    check_str(log, "");
+
+    stub_dialog_close("a");
+    stub_dialog_close(NULL);
+    stub_dialog_close("c");
+    // a request is done after its reply is queued
+    int64_t timeout = mp_time_ns() + 5000000000;
+    while (worker_pending(w) && mp_time_ns() < timeout)
+        mp_dispatch_queue_process(queue, 0.001);
+    check_int(worker_pending(w), 0);
+    wait_replies(queue, log, 3);
+    check_str(log, "a - c");
+    check_int(num_runs, 3);
+
+    talloc_free(w);
+    check_int(atomic_load(&num_init), 1);
+    check_int(atomic_load(&num_uninit), 1);
+    talloc_free(queue);
+}
+
+static MP_THREAD_VOID cancel_thread(void *arg) {
+    usleep(50000);  // long enough for the worker to be freed first
+    stub_dialog_cancel_all();
+    MP_THREAD_RETURN();
+}
+
+// freeing the worker waits for the shown dialog, the queued requests are
+// dropped and freed without running. the dialogs stay cancelled, so this
+// test is the last one.
+static void test_destroy(void) {
+    mp_dispatch_queue *queue = mp_dispatch_create(NULL);
+    worker *w = worker_create(NULL, queue, NULL, NULL);
+    char log[64] = "";
+    num_runs = 0;
+
+    for (int i = 0; i < 4; i++) submit(w, log);
+    stub_dialog_wait();
+
+    mp_thread cancel;
+    check(mp_thread_create(&cancel, cancel_thread, NULL) == 0);
+    talloc_free(w);
+    mp_thread_join(cancel);
+
+    // the worker thread is joined, the requests that ran are cancelled, and
+    // their replies are still run
+    check(num_runs >= 1 && num_runs < 4);
+    char expected[64] = "";
+    for (int i = 0; i < num_runs; i++) strcat(expected, i ? " -" : "-");
+    wait_replies(queue, log, num_runs);
+    check_str(log, expected);
+    talloc_free(queue);
+}
+
+int main(void) {
+    test_order();
+    test_destroy();
+    return 0;
+}